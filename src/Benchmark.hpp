@@ -0,0 +1,932 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <thread>
+#include <memory>
+#include <stdio.h>
+#include <math.h>
+#include "Math.hpp"
+#include "Bounds.hpp"
+#include "Entity.hpp"
+#include "Scene.hpp"
+#include "Vertex.hpp"
+#include "ObjLoader.hpp"
+#include "CookedMesh.hpp"
+#include "MeshGenerator.hpp"
+#include "Drawable.hpp"
+#include "FrameArena.hpp"
+#include "Light.hpp"
+#include "ShadowMap.hpp"
+#include "Pipeline.hpp"
+#include "GBuffer.hpp"
+#include "VisibilityBuffer.hpp"
+#include "SpanBuffer.hpp"
+#include "Rasterizer.hpp"
+#include "JobSystem.hpp"
+#include "RenderQueue.hpp"
+#include "Screen.hpp"
+
+namespace paint {
+
+//offline measurements, run with: Paint --benchmark
+//nothing here needs a window except runPresent(), run with: Paint --benchmark present
+class Benchmark {
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    static double getMilliseconds(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+public:
+    static void runAll() {
+        runCulling();
+        runShading();
+        runShadows();
+        runPipeline();
+        runTiledLighting();
+        runVisibility();
+        runSpanBuffer();
+        runTriangleSoup();
+        runJobs();
+        runCommandBuffers();
+        runObjParsing();
+    }
+
+    //culling cost against entity count: linear bounds test vs scene hierarchy traversal
+    //entity density is constant, so the world grows with the count while the visible set stays about the same
+    static void runCulling() {
+        const unsigned int iterations = 20;
+        const float spacing = 400.0f;
+        Frustum frustum = Frustum::fromMatrix(Mat4::perspective()); //camera at origin looking down +z
+
+        std::cout << "culling (ms per frame)" << std::endl;
+        std::cout << std::setw(10) << "entities" << std::setw(10) << "visible" << std::setw(12) << "linear"
+                  << std::setw(12) << "bvh" << std::setw(12) << "bvh nodes" << std::endl;
+
+        for (unsigned int count : {1000u, 10000u, 100000u, 1000000u}) {
+            std::mt19937 rng(count);
+            float side = spacing * sqrt(float(count));
+            std::uniform_real_distribution<float> position(-side / 2.0f, side / 2.0f);
+            std::uniform_real_distribution<float> angle(0.0f, 6.28f);
+
+            Scene scene;
+            Vertex cube = MeshGenerator::makeBox(50.0f);
+            for (unsigned int i = 0; i < count; ++i) {
+                Entity e(cube);
+                e.moveTo({position(rng), 0.0f, position(rng)});
+                e.rotateTo(angle(rng));
+                scene.add(e);
+            }
+
+            unsigned int linearVisible = 0;
+            Clock::time_point start = Clock::now();
+            for (unsigned int k = 0; k < iterations; ++k) {
+                linearVisible = 0;
+                for (EntityId id = 0; id < scene.size(); ++id) {
+                    if (scene.isVisible(frustum, id))
+                        ++linearVisible;
+                }
+            }
+            double linearTime = getMilliseconds(start) / iterations;
+
+            std::vector<EntityId> visible;
+            unsigned int nodes = 0;
+            start = Clock::now();
+            for (unsigned int k = 0; k < iterations; ++k) {
+                visible.clear();
+                nodes = scene.query(frustum, visible);
+            }
+            double bvhTime = getMilliseconds(start) / iterations;
+
+            std::cout << std::setw(10) << count << std::setw(10) << visible.size() << std::setw(12) << std::fixed
+                      << std::setprecision(3) << linearTime << std::setw(12) << bvhTime << std::setw(12) << nodes
+                      << std::endl;
+            if (linearVisible != visible.size())
+                std::cout << "  linear test found " << linearVisible << " visible" << std::endl;
+        }
+    }
+
+    //lighting cost per draw of a closed mesh against light count: a normal per triangle (flat) vs a cached
+    //normal per vertex (Gouraud), one directional light plus point lights that all reach the mesh
+    //only the lighting step is timed, culling has already flagged the back faces
+    static void runShading() {
+        const unsigned int iterations = 20;
+        Entity sphere(MeshGenerator::makeIcosphere(1000.0f, 6));
+        sphere.moveTo({0.0f, 0.0f, 5000.0f});
+        Frustum frustum = Frustum::fromMatrix(Mat4::perspective());
+        FrameArena arena;
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<float> offset(-1500.0f, 1500.0f);
+
+        std::cout << "shading (ms per draw, " << sphere.getMesh().triangleCount << " triangles, "
+                  << sphere.getMesh().vertexCount << " vertices)" << std::endl;
+        std::cout << std::setw(10) << "lights" << std::setw(12) << "flat" << std::setw(12) << "gouraud" << std::endl;
+        for (unsigned int count : {1u, 8u, 32u}) {
+            LightSet lights;
+            lights.add(Light::directional({-1.0f, -1.0f, 1.0f}));
+            for (unsigned int k = 1; k < count; ++k)
+                lights.add(Light::point({offset(rng), offset(rng), 5000.0f + offset(rng)}, 4000.0f, 0.5f));
+
+            double times[2] = {0.0, 0.0};
+            for (unsigned int k = 0; k < iterations; ++k) {
+                for (unsigned int mode = 0; mode < 2; ++mode) {
+                    arena.reset();
+                    Drawable drawable = sphere.getDrawable();
+                    drawable.clearCullFlags();
+                    drawable.cullBackfaces(arena, frustum);
+                    Clock::time_point start = Clock::now();
+                    if (mode == 0)
+                        drawable.computeFlatShading(lights, arena);
+                    else
+                        drawable.computeGouraudShading(lights, arena);
+                    times[mode] += getMilliseconds(start);
+                }
+            }
+            std::cout << std::setw(10) << count << std::setw(12) << std::fixed << std::setprecision(3)
+                      << times[0] / iterations << std::setw(12) << times[1] / iterations << std::endl;
+        }
+    }
+
+    //cost of one shadowed directional light: rendering its map (300 icospheres, depth only) against map size,
+    //then Gouraud lighting of a mesh with the map looked up at every lit vertex, hard and filtered
+    static void runShadows() {
+        const unsigned int iterations = 10;
+        Scene scene;
+        AABB region;
+        region.min = {-6000.0f, -3000.0f, 2000.0f};
+        region.max = {6000.0f, 3000.0f, 20000.0f};
+        MeshGenerator::populateScene(scene, MeshGenerator::makeIcosphere(150.0f, 3), 300, region, 1);
+        Light sun = Light::directional({-1.0f, -1.0f, 1.0f});
+
+        Entity sphere(MeshGenerator::makeIcosphere(1000.0f, 6));
+        sphere.moveTo({0.0f, 0.0f, 5000.0f});
+        Frustum frustum = Frustum::fromMatrix(Mat4::perspective());
+        FrameArena arena;
+        JobSystem single(1);
+
+        std::cout << "shadows (ms, " << 300 * scene.get(0).getMesh().triangleCount << " caster triangles, "
+                  << sphere.getMesh().vertexCount << " receiver vertices)" << std::endl;
+        std::cout << std::setw(10) << "map size" << std::setw(12) << "render" << std::setw(12) << "unshadowed"
+                  << std::setw(12) << "hard" << std::setw(12) << "pcf 3x3" << std::setw(12) << "pcf 5x5" << std::endl;
+        for (unsigned int size : {512u, 1024u, 2048u}) {
+            ShadowMap map;
+            double renderTime = 0.0;
+            double lightingTimes[4] = {0.0, 0.0, 0.0, 0.0};
+            for (unsigned int radius = 0; radius < 3; ++radius) {
+                for (unsigned int k = 0; k < iterations; ++k) {
+                    Clock::time_point start = Clock::now();
+                    map.begin(scene.getBounds(), sun.direction, size, radius);
+                    for (EntityId id = 0; id < scene.size(); ++id)
+                        map.addCaster(scene.get(id).getMesh(), scene.get(id).getModelMatrix());
+                    map.render(single);
+                    renderTime += getMilliseconds(start);
+
+                    for (unsigned int column = radius == 0 ? 0 : radius + 1; column <= radius + 1; ++column) {
+                        LightSet lights;
+                        if (column == 0)
+                            lights.add(sun);
+                        else
+                            lights.add(sun, &map, map.getWorldToMap()); //receiver positions are in world space
+                        arena.reset();
+                        Drawable drawable = sphere.getDrawable();
+                        drawable.clearCullFlags();
+                        drawable.cullBackfaces(arena, frustum);
+                        start = Clock::now();
+                        drawable.computeGouraudShading(lights, arena);
+                        lightingTimes[column] += getMilliseconds(start);
+                    }
+                }
+            }
+            std::cout << std::setw(10) << size << std::setw(12) << std::fixed << std::setprecision(3)
+                      << renderTime / (3 * iterations);
+            for (double time : lightingTimes)
+                std::cout << std::setw(12) << time / iterations;
+            std::cout << std::endl;
+        }
+    }
+
+    //shader pipelines against loops written out by hand for the same effect, and against a pixel shader
+    //called through a virtual function, on random screen space triangles covering the target several times
+    //fastest of several runs
+    static void runPipeline() {
+        const unsigned int iterations = 20;
+        const int width = 1280;
+        const int height = 720;
+        std::vector<uint32_t> color(width * height);
+        std::vector<float> depth(width * height);
+        RenderTarget target = {color.data(), depth.data(), width, {0, 0, width, height}, 0};
+
+        std::mt19937 rng(11);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        Vertex buffer;
+        for (unsigned int k = 0; k < 20000; ++k) {
+            float cx = width * unit(rng);
+            float cy = height * unit(rng);
+            float z = 1000.0f * unit(rng);
+            unsigned int first = buffer.positions.size();
+            for (unsigned int corner = 0; corner < 3; ++corner) {
+                buffer.positions.emplace_back(cx + 60.0f * (unit(rng) - 0.5f), cy + 60.0f * (unit(rng) - 0.5f),
+                                              z + 10.0f * unit(rng), 1.0f);
+                buffer.vertexLight.push_back(unit(rng));
+            }
+            buffer.indices.emplace_back(first, first + 1, first + 2);
+            buffer.shadingLevel.push_back(unit(rng));
+        }
+        buffer.cullFlags.assign(buffer.indices.size(), false);
+
+        std::cout << "pipeline (ms per " << buffer.indices.size() << " triangles at " << width << "x" << height << ")"
+                  << std::endl;
+        std::cout << std::setw(10) << "shading" << std::setw(12) << "by hand" << std::setw(12) << "pipeline"
+                  << std::setw(12) << "virtual" << std::endl;
+
+        const uint32_t white = 0xffffffff;
+        VirtualGray virtualGray;
+        const GrayInterface* grayInterface = &virtualGray;
+        double flat[2] = {
+            timeDraw(target, iterations, [&]() { drawSolidByHand(buffer, white, target); }),
+            timeDraw(target, iterations, [&]() { makePipeline(PositionShader(), SolidColorShader{white}).draw(buffer, target); })
+        };
+        double gouraud[3] = {
+            timeDraw(target, iterations, [&]() { drawGrayByHand(buffer, target); }),
+            timeDraw(target, iterations, [&]() { makePipeline(VertexGrayShader(), GrayShader()).draw(buffer, target); }),
+            timeDraw(target, iterations, [&]() {
+                makePipeline(VertexGrayShader(), VirtualGrayShader{grayInterface}).draw(buffer, target);
+            })
+        };
+        std::cout << std::setw(10) << "solid" << std::setw(12) << std::fixed << std::setprecision(3) << flat[0]
+                  << std::setw(12) << flat[1] << std::endl;
+        std::cout << std::setw(10) << "gouraud" << std::setw(12) << gouraud[0] << std::setw(12) << gouraud[1]
+                  << std::setw(12) << gouraud[2] << std::endl;
+    }
+
+    //deferred lighting pass against point light count: every light for every pixel vs lights culled per screen tile,
+    //on a synthetic G-buffer (a floor going away from the camera) with lights of range 600 spread over the view
+    //both passes must produce the same image, lights beyond their range add exactly nothing
+    static void runTiledLighting() {
+        const unsigned int iterations = 3;
+        const int width = 1280;
+        const int height = 720;
+        const unsigned int threads = std::max(std::thread::hardware_concurrency(), 1u);
+        JobSystem single(1);
+        JobSystem workers(threads);
+        Mat4 projection = Mat4::perspective();
+        Vec3 viewportScale(width / 2.0f, -height / 2.0f, 1.0f);
+        Vec3 viewportOffset(width / 2.0f, height / 2.0f, 0.0f);
+
+        GBuffer gBuffer;
+        gBuffer.resize(width, height);
+        gBuffer.clear();
+        std::vector<float> depth(width * height);
+        std::vector<uint32_t> albedo(width * height, 0xffffffff);
+        std::vector<uint32_t> color(width * height);
+        std::vector<uint32_t> reference(width * height);
+        for (int y = 0; y < height; ++y) {
+            float viewZ = 1000.0f + 9000.0f * float(y) / float(height);
+            for (int x = 0; x < width; ++x) {
+                depth[y * width + x] = projection.thirdCol.z + projection.fourthCol.z / viewZ;
+                gBuffer.write(y * width + x, 0.0f, 1.0f, -0.3f, GBuffer::Lit);
+            }
+        }
+        RenderTarget target = {color.data(), depth.data(), width, {0, 0, width, height}, 0};
+
+        std::cout << "tiled lighting (ms per pass at " << width << "x" << height << ", " << GBuffer::TILE_SIZE
+                  << " pixel tiles, " << threads << " threads)" << std::endl;
+        std::cout << std::setw(10) << "lights" << std::setw(12) << "all" << std::setw(12) << "tiled 1t"
+                  << std::setw(12) << "tiled" << std::setw(12) << "per tile" << std::endl;
+        std::mt19937 rng(5);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (unsigned int count : {16u, 256u, 1024u, 4096u}) {
+            LightSet lights;
+            lights.add(Light::directional({-1.0f, -1.0f, 1.0f}, 0.3f));
+            for (unsigned int k = 0; k < count; ++k) {
+                float z = 1000.0f + 9000.0f * unit(rng);
+                lights.add(Light::point({(unit(rng) - 0.5f) * 1.33f * z, (unit(rng) - 0.5f) * z, z}, 600.0f, 0.5f));
+            }
+
+            auto pass = [&](JobSystem& jobs, bool cull, GBuffer::LightingStats& stats) {
+                double best = 0.0;
+                for (unsigned int k = 0; k < iterations; ++k) {
+                    std::copy(albedo.begin(), albedo.end(), color.begin());
+                    Clock::time_point start = Clock::now();
+                    stats = gBuffer.resolve(target, lights, projection, viewportScale, viewportOffset, jobs, cull);
+                    double time = getMilliseconds(start);
+                    best = k == 0 ? time : std::min(best, time);
+                }
+                return best;
+            };
+
+            GBuffer::LightingStats stats;
+            bool compare = count <= 256; //every light for every pixel takes seconds beyond that
+            double all = compare ? pass(workers, false, stats) : 0.0;
+            reference = color;
+            double singleTime = pass(single, true, stats);
+            double tiled = pass(workers, true, stats);
+            std::cout << std::setw(10) << count << std::setw(12) << std::fixed << std::setprecision(3);
+            if (compare)
+                std::cout << all;
+            else
+                std::cout << "-";
+            std::cout << std::setw(12) << singleTime << std::setw(12) << tiled << std::setw(12) << std::setprecision(1)
+                      << float(stats.tileLights) / float(std::max(stats.tiles, 1u)) << std::endl;
+            if (compare && reference != color)
+                std::cout << "  tiled image differs" << std::endl;
+        }
+    }
+
+    //deferred shading through a G-buffer vs a visibility buffer against overdraw: random Gouraud quads in random
+    //depth order covering the target that many times, lit by a directional and 64 point lights
+    //raster is the geometry pass (clear included), shade the lighting pass, fastest of several runs each
+    static void runVisibility() {
+        const unsigned int iterations = 5;
+        const int width = 1280;
+        const int height = 720;
+        const float side = 64.0f;
+        JobSystem single(1);
+        Mat4 projection = Mat4::perspective();
+        Vec3 viewportScale(width / 2.0f, -height / 2.0f, 1.0f);
+        Vec3 viewportOffset(width / 2.0f, height / 2.0f, 0.0f);
+        std::vector<uint32_t> color(width * height);
+        std::vector<float> depth(width * height);
+        RenderTarget target = {color.data(), depth.data(), width, {0, 0, width, height}, 0};
+        GBuffer gBuffer;
+        gBuffer.resize(width, height);
+        VisibilityBuffer visibility;
+        visibility.resize(width, height);
+
+        std::mt19937 rng(17);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        LightSet lights;
+        lights.add(Light::directional({-1.0f, -1.0f, 1.0f}, 0.3f));
+        for (unsigned int k = 0; k < 64; ++k) {
+            float z = 1000.0f + 9000.0f * unit(rng);
+            lights.add(Light::point({(unit(rng) - 0.5f) * 1.33f * z, (unit(rng) - 0.5f) * z, z}, 2000.0f, 0.5f));
+        }
+
+        std::cout << "visibility buffer (ms per frame at " << width << "x" << height << ")" << std::endl;
+        std::cout << std::setw(10) << "overdraw" << std::setw(12) << "triangles" << std::setw(14) << "gbuf raster"
+                  << std::setw(12) << "gbuf shade" << std::setw(14) << "vis raster" << std::setw(12) << "vis shade"
+                  << std::setw(12) << "vis KB" << std::endl;
+        for (unsigned int overdraw : {1u, 4u, 16u}) {
+            Vertex buffer;
+            unsigned int quads = unsigned(overdraw * width * height / (side * side));
+            for (unsigned int k = 0; k < quads; ++k) {
+                float x = (width + side) * unit(rng) - side;
+                float y = (height + side) * unit(rng) - side;
+                float z = projection.thirdCol.z + projection.fourthCol.z / (1000.0f + 9000.0f * unit(rng));
+                unsigned int first = buffer.positions.size();
+                for (unsigned int corner = 0; corner < 4; ++corner) {
+                    buffer.positions.emplace_back(x + side * (corner & 1), y + side * (corner >> 1), z, 1.0f);
+                    buffer.viewNormals.emplace_back(unit(rng) - 0.5f, unit(rng) - 0.5f, -1.0f);
+                }
+                buffer.indices.emplace_back(first, first + 1, first + 2);
+                buffer.indices.emplace_back(first + 1, first + 3, first + 2);
+            }
+            buffer.cullFlags.assign(buffer.indices.size(), false);
+
+            auto best = [&](auto&& pass) {
+                double time = 0.0;
+                for (unsigned int k = 0; k < iterations; ++k) {
+                    Clock::time_point start = Clock::now();
+                    pass();
+                    time = k == 0 ? getMilliseconds(start) : std::min(time, getMilliseconds(start));
+                }
+                return time;
+            };
+            auto clearTarget = [&]() {
+                std::fill(color.begin(), color.end(), 0u);
+                std::fill(depth.begin(), depth.end(), 10000.0f);
+            };
+            double gBufferRaster = best([&]() {
+                clearTarget();
+                gBuffer.clear();
+                makePipeline(VertexNormalShader(), GBufferShader{&gBuffer, GBuffer::Lit}).draw(buffer, target);
+            });
+            double gBufferShade = best([&]() {
+                gBuffer.resolve(target, lights, projection, viewportScale, viewportOffset, single);
+            });
+            double visibilityRaster = best([&]() {
+                clearTarget();
+                visibility.clear();
+                visibility.draw(buffer, ShadingMode::Gouraud, target);
+            });
+            double visibilityShade = best([&]() {
+                visibility.resolve(target, lights, projection, viewportScale, viewportOffset, single);
+            });
+            std::cout << std::setw(10) << overdraw << std::setw(12) << buffer.indices.size() << std::setw(14)
+                      << std::fixed << std::setprecision(3) << gBufferRaster << std::setw(12) << gBufferShade
+                      << std::setw(14) << visibilityRaster << std::setw(12) << visibilityShade << std::setw(12)
+                      << visibility.getBytes() / 1024 << std::endl;
+        }
+    }
+
+    //span buffer against the z-buffer for opaque flat shaded scenes drawn in scene order (no depth sorting)
+    //z-buffer: depth clear and depth tested raster, spans: clear, insert and resolve (every pixel written once)
+    //memory is the depth plane against the row heads and the span pool
+    static void runSpanBuffer() {
+        const unsigned int iterations = 10;
+        const int width = 800;
+        const int height = 600;
+        std::vector<uint32_t> color(width * height);
+        std::vector<float> depth(width * height);
+        RenderTarget target = {color.data(), depth.data(), width, {0, 0, width, height}, 0};
+        SpanBuffer spans;
+        spans.resize(height);
+
+        AABB region;
+        region.min = {-6000.0f, -3000.0f, 2000.0f};
+        region.max = {6000.0f, 3000.0f, 20000.0f};
+        Scene boxes;
+        MeshGenerator::populateScene(boxes, MeshGenerator::makeBox(400.0f), 40, region, 3);
+        Scene spheres;
+        MeshGenerator::populateScene(spheres, MeshGenerator::makeIcosphere(150.0f, 3), 150, region, 1);
+        Scene floor;
+        MeshGenerator::populateScene(floor, MeshGenerator::makeIcosphere(150.0f, 3), 150, region, 1);
+        Entity grid(MeshGenerator::makeGrid(region.max.x - region.min.x, region.max.z - region.min.z, 120, 160));
+        grid.moveTo({0.0f, region.min.y - 400.0f, (region.min.z + region.max.z) * 0.5f});
+        floor.add(grid);
+
+        std::cout << "span buffer (ms per frame at " << width << "x" << height << ")" << std::endl;
+        std::cout << std::setw(18) << "scene" << std::setw(12) << "triangles" << std::setw(10) << "overdraw"
+                  << std::setw(12) << "z-buffer" << std::setw(12) << "spans" << std::setw(10) << "z KB"
+                  << std::setw(10) << "span KB" << std::setw(10) << "spans" << std::setw(10) << "differ" << std::endl;
+        std::pair<const char*, const Scene*> scenes[3] = {{"40 boxes", &boxes}, {"150 spheres", &spheres},
+                                                          {"spheres + floor", &floor}};
+        for (const auto& scene : scenes) {
+            Vertex buffer = projectScene(*scene.second, width, height);
+            target.pixelsWritten = 0;
+            double zBufferTime = timeDraw(target, iterations, [&]() {
+                makePipeline(FaceGrayShader(), GrayShader()).draw(buffer, target);
+            });
+            std::vector<uint32_t> reference = color;
+            unsigned int zBufferPixels = target.pixelsWritten / iterations;
+
+            unsigned int spanPixels = 0;
+            double spanTime = timeDraw(target, iterations, [&]() {
+                spans.clear();
+                for (unsigned int k = 0; k < buffer.indices.size(); ++k) {
+                    const Index& i = buffer.indices[k];
+                    Vec3 a(buffer.positions[i.x].x, buffer.positions[i.x].y, buffer.positions[i.x].z);
+                    Vec3 b(buffer.positions[i.y].x, buffer.positions[i.y].y, buffer.positions[i.y].z);
+                    Vec3 c(buffer.positions[i.z].x, buffer.positions[i.z].y, buffer.positions[i.z].z);
+                    TriangleSetup t;
+                    if (!t.setup(a, b, c))
+                        continue;
+                    float gray = 230.0f * buffer.shadingLevel[k] + 25.0f;
+                    scanTriangle(t, target.rect, [&](int y, int xStart, int xEnd) {
+                        float z = t.valueAt(t.top->z, t.dzdx, t.dzdy, xStart, float(y) + 0.5f);
+                        spans.insert(y, xStart, xEnd, z, t.dzdx, 0xffffffff, gray, 0.0f);
+                    });
+                }
+                spanPixels = spans.resolve(target.color, width);
+            });
+            unsigned int differ = 0;
+            for (unsigned int k = 0; k < color.size(); ++k)
+                differ += color[k] != reference[k];
+            std::cout << std::setw(18) << scene.first << std::setw(12) << buffer.indices.size() << std::setw(10)
+                      << std::fixed << std::setprecision(2) << float(zBufferPixels) / float(std::max(spanPixels, 1u))
+                      << std::setw(12) << std::setprecision(3) << zBufferTime << std::setw(12) << spanTime
+                      << std::setw(10) << width * height * sizeof(float) / 1024 << std::setw(10)
+                      << spans.getBytes() / 1024 << std::setw(10) << spans.getSpanCount() << std::setw(10) << differ
+                      << std::endl;
+        }
+    }
+
+    //raster throughput of unconnected triangles against their count and size, sizes are circumradii in world units
+    //drawn uniform or log uniform between the bounds, the area column is the mean projected area of the front faces
+    static void runTriangleSoup() {
+        const unsigned int iterations = 3;
+        const int width = 800;
+        const int height = 600;
+        std::vector<uint32_t> color(width * height);
+        std::vector<float> depth(width * height);
+        RenderTarget target = {color.data(), depth.data(), width, {0, 0, width, height}, 0};
+
+        AABB region;
+        region.min = {-3000.0f, -2200.0f, 4000.0f};
+        region.max = {3000.0f, 2200.0f, 8000.0f};
+        struct Sizes {
+            const char* name;
+            float min;
+            float max;
+            SizeDistribution distribution;
+        };
+        const Sizes sizes[] = {{"2-8", 2.0f, 8.0f, SizeDistribution::Uniform},
+                               {"8-32", 8.0f, 32.0f, SizeDistribution::Uniform},
+                               {"32-128", 32.0f, 128.0f, SizeDistribution::Uniform},
+                               {"128-512", 128.0f, 512.0f, SizeDistribution::Uniform},
+                               {"log 2-512", 2.0f, 512.0f, SizeDistribution::LogUniform}};
+
+        std::cout << "triangle soup (ms per frame at " << width << "x" << height << ")" << std::endl;
+        std::cout << std::setw(12) << "size" << std::setw(10) << "count" << std::setw(10) << "drawn" << std::setw(12)
+                  << "area px" << std::setw(12) << "pixels" << std::setw(12) << "raster" << std::setw(12) << "Mtris/s"
+                  << std::endl;
+        for (const Sizes& size : sizes) {
+            for (unsigned int count : {10000u, 100000u}) {
+                Scene scene;
+                scene.add(Entity(MeshGenerator::makeTriangleSoup(count, region, size.min, size.max, size.distribution, count)));
+                Vertex buffer = projectScene(scene, width, height);
+                double area = 0.0;
+                for (const Index& i : buffer.indices) {
+                    const Vec4& a = buffer.positions[i.x];
+                    const Vec4& b = buffer.positions[i.y];
+                    const Vec4& c = buffer.positions[i.z];
+                    area += fabs((b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y)) * 0.5;
+                }
+                target.pixelsWritten = 0;
+                double time = timeDraw(target, iterations, [&]() {
+                    makePipeline(FaceGrayShader(), GrayShader()).draw(buffer, target);
+                });
+                unsigned int drawn = buffer.indices.size();
+                std::cout << std::setw(12) << size.name << std::setw(10) << count << std::setw(10) << drawn
+                          << std::setw(12) << std::fixed << std::setprecision(1) << area / std::max(drawn, 1u)
+                          << std::setw(12) << target.pixelsWritten / iterations << std::setw(12) << std::setprecision(3)
+                          << time << std::setw(12) << std::setprecision(2) << drawn / std::max(time, 1e-6) / 1000.0
+                          << std::endl;
+            }
+        }
+    }
+
+    //geometry stage (culling, Gouraud lighting with 8 lights, projection, clipping) of 64 small spheres and a
+    //large one split into batches, against the number of job system workers
+    static void runJobs() {
+        const unsigned int iterations = 10;
+        std::vector<Entity> entities;
+        std::mt19937 rng(11);
+        std::uniform_real_distribution<float> offset(-3000.0f, 3000.0f);
+        Vertex small = MeshGenerator::makeIcosphere(200.0f, 4);
+        for (unsigned int k = 0; k < 64; ++k) {
+            entities.emplace_back(small);
+            entities.back().moveTo({offset(rng), offset(rng), 9000.0f + offset(rng)});
+        }
+        entities.emplace_back(MeshGenerator::makeIcosphere(1500.0f, 7));
+        entities.back().moveTo({0.0f, 0.0f, 6000.0f});
+        LightSet lights;
+        lights.add(Light::directional({-1.0f, -1.0f, 1.0f}));
+        for (unsigned int k = 1; k < 8; ++k)
+            lights.add(Light::point({offset(rng), offset(rng), 8000.0f + offset(rng)}, 5000.0f, 0.5f));
+        Frustum frustum = Frustum::fromMatrix(Mat4::perspective());
+
+        std::vector<std::pair<const Entity*, const MeshBatch*>> batches;
+        for (const Entity& entity : entities) {
+            for (const MeshBatch& batch : entity.getBatches())
+                batches.push_back({&entity, &batch});
+        }
+
+        std::cout << "job system (ms per frame, " << entities.size() << " entities in " << batches.size()
+                  << " batches)" << std::endl;
+        std::cout << std::setw(10) << "workers" << std::setw(12) << "geometry" << std::setw(12) << "steals"
+                  << std::setw(14) << "utilization" << std::endl;
+        unsigned int maxWorkers = std::max(std::thread::hardware_concurrency(), 4u);
+        for (unsigned int workers = 1; ; workers = std::min(workers * 2, maxWorkers)) {
+            JobSystem jobs(workers);
+            std::vector<FrameArena> arenas(workers);
+            double time = 0.0;
+            for (unsigned int k = 0; k < iterations; ++k) {
+                for (FrameArena& arena : arenas)
+                    arena.reset();
+                Clock::time_point start = Clock::now();
+                jobs.parallelFor(batches.size(), 1, [&](unsigned int begin, unsigned int end, unsigned int worker) {
+                    for (unsigned int b = begin; b < end; ++b) {
+                        Drawable drawable = batches[b].first->getDrawable(*batches[b].second);
+                        drawable.clearCullFlags();
+                        drawable.cullBackfaces(arenas[worker], frustum);
+                        drawable.computeGouraudShading(lights, arenas[worker]);
+                        drawable.applyTransformation(Mat4::perspective());
+                        drawable.clipTriangles(arenas[worker]);
+                    }
+                });
+                time += getMilliseconds(start);
+            }
+            unsigned int steals = 0;
+            float utilization = 0.0f;
+            for (unsigned int w = 0; w < workers; ++w) {
+                steals += jobs.getStats(w).steals;
+                utilization += jobs.getUtilization(w) / float(workers);
+            }
+            std::cout << std::setw(10) << workers << std::setw(12) << std::fixed << std::setprecision(2)
+                      << time / iterations << std::setw(12) << steals / iterations << std::setw(13)
+                      << std::setprecision(0) << utilization * 100.0f << "%" << std::endl;
+            if (workers == maxWorkers)
+                break;
+        }
+    }
+
+    //render queue filled with 200000 draws: submitted and sorted on one thread, against recorded into a command
+    //buffer per worker, sorted there and merged by key
+    static void runCommandBuffers() {
+        const unsigned int iterations = 10;
+        const unsigned int count = 200000;
+        std::mt19937 rng(13);
+        std::uniform_real_distribution<float> depth(10.0f, 20000.0f);
+        std::vector<float> depths(count);
+        std::vector<Material> materials(count);
+        for (unsigned int k = 0; k < count; ++k) {
+            depths[k] = depth(rng);
+            materials[k].shading = ShadingMode(rng() % 3);
+            materials[k].opacity = rng() % 8 == 0 ? 0.5f : 1.0f;
+        }
+        RenderQueue queue(Mat4::perspective());
+
+        std::cout << "render queue (ms per frame, " << count << " draws)" << std::endl;
+        std::cout << std::setw(10) << "workers" << std::setw(12) << "record" << std::setw(12) << "merge" << std::endl;
+        double time = 0.0;
+        for (unsigned int k = 0; k < iterations; ++k) {
+            Clock::time_point start = Clock::now();
+            queue.clear();
+            for (unsigned int d = 0; d < count; ++d)
+                queue.submit(d, materials[d], depths[d]);
+            queue.sort();
+            time += getMilliseconds(start);
+        }
+        std::cout << std::setw(10) << "serial" << std::setw(12) << std::fixed << std::setprecision(2)
+                  << time / iterations << std::setw(12) << "-" << std::endl;
+
+        unsigned int maxWorkers = std::max(std::thread::hardware_concurrency(), 4u);
+        for (unsigned int workers = 1; ; workers = std::min(workers * 2, maxWorkers)) {
+            JobSystem jobs(workers);
+            std::vector<RenderQueue::CommandBuffer> buffers(workers);
+            double recordTime = 0.0;
+            double mergeTime = 0.0;
+            for (unsigned int k = 0; k < iterations; ++k) {
+                Clock::time_point start = Clock::now();
+                queue.clear();
+                jobs.parallelFor(count, 1024, [&](unsigned int begin, unsigned int end, unsigned int worker) {
+                    for (unsigned int d = begin; d < end; ++d)
+                        queue.record(buffers[worker], d, materials[d], depths[d]);
+                });
+                jobs.parallelFor(workers, 1, [&](unsigned int begin, unsigned int end, unsigned int) {
+                    for (unsigned int b = begin; b < end; ++b)
+                        buffers[b].sort();
+                });
+                recordTime += getMilliseconds(start);
+                start = Clock::now();
+                queue.merge(buffers);
+                mergeTime += getMilliseconds(start);
+            }
+            std::cout << std::setw(10) << workers << std::setw(12) << std::fixed << std::setprecision(2)
+                      << recordTime / iterations << std::setw(12) << mergeTime / iterations << std::endl;
+            if (workers == maxWorkers)
+                break;
+        }
+    }
+
+    //cost of getting a frame to the window before the wait for the vertical blank, at 1080p and 4K: the framebuffer
+    //copied into a static texture with SDL_UpdateTexture, against drawn straight into a locked streaming texture
+    static void runPresent() {
+        const unsigned int frames = 60;
+        std::cout << "present (ms per frame, without the vsync wait)" << std::endl;
+        std::cout << std::setw(12) << "size" << std::setw(12) << "update" << std::setw(12) << "streaming" << std::endl;
+        for (std::pair<int, int> size : {std::make_pair(1920, 1080), std::make_pair(3840, 2160)}) {
+            std::cout << std::setw(12) << std::to_string(size.first) + "x" + std::to_string(size.second);
+            for (PresentMode mode : {PresentMode::Update, PresentMode::Streaming}) {
+                Screen screen(size.first, size.second);
+                if (!screen.setPresentMode(mode)) {
+                    std::cout << std::setw(12) << "-";
+                    screen.close();
+                    continue;
+                }
+                double time = 0.0;
+                for (unsigned int k = 0; k < frames; ++k) {
+                    screen.setColor(uint32_t(k * 0x01020300u) | 0xff);
+                    screen.clear();
+                    screen.render();
+                    time += screen.getPresentMilliseconds();
+                }
+                std::cout << std::setw(12) << std::fixed << std::setprecision(3) << time / frames
+                          << (mode == PresentMode::Streaming && !screen.isZeroCopy() ? " (padded)" : "");
+                screen.close();
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    //OBJ parse throughput against thread count on a generated height field (quads with normals)
+    static void runObjParsing() {
+        const unsigned int side = 1000;
+        std::mt19937 rng(side);
+        std::uniform_real_distribution<float> height(-1.0f, 1.0f);
+        std::string text;
+        for (unsigned int y = 0; y < side; ++y) {
+            for (unsigned int x = 0; x < side; ++x) {
+                text += "v " + std::to_string(x * 0.1f) + " " + std::to_string(height(rng)) + " " + std::to_string(y * 0.1f) + "\n";
+                text += "vn 0.000000 1.000000 0.000000\n";
+            }
+        }
+        for (unsigned int y = 0; y + 1 < side; ++y) {
+            for (unsigned int x = 0; x + 1 < side; ++x) {
+                unsigned int a = y * side + x + 1;
+                std::string b = std::to_string(a), c = std::to_string(a + 1);
+                std::string d = std::to_string(a + side + 1), e = std::to_string(a + side);
+                text += "f " + b + "//" + b + " " + c + "//" + c + " " + d + "//" + d + " " + e + "//" + e + "\n";
+            }
+        }
+
+        std::cout << "obj parsing (" << text.size() / (1024 * 1024) << " MB)" << std::endl;
+        std::cout << std::setw(10) << "threads" << std::setw(12) << "parse ms" << std::setw(12) << "build ms"
+                  << std::setw(12) << "MB/s" << std::setw(12) << "triangles" << std::endl;
+        unsigned int maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+        Vertex mesh;
+        for (unsigned int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+            ObjStats stats;
+            ObjLoader::parse(text.data(), text.data() + text.size(), mesh, &stats, threads);
+            std::cout << std::setw(10) << stats.threads << std::setw(12) << std::fixed << std::setprecision(1)
+                      << stats.parseSeconds * 1000.0 << std::setw(12) << stats.buildSeconds * 1000.0 << std::setw(12)
+                      << stats.getMegabytesPerSecond() << std::setw(12) << stats.triangles << std::endl;
+            if (threads == maxThreads)
+                break;
+        }
+
+        runCookedLoading(mesh);
+    }
+
+    //cooked mesh load time for the same mesh: mapping and validating, touching every page in place, and making an
+    //entity from the mapping, against an entity made from the parsed mesh (which builds clusters and face planes)
+    static void runCookedLoading(const Vertex& mesh) {
+        const char* filename = "paint_benchmark.mesh";
+        if (!CookedMesh::cook(mesh, filename)) {
+            std::cout << "could not write " << filename << std::endl;
+            return;
+        }
+
+        Clock::time_point start = Clock::now();
+        std::shared_ptr<CookedMesh> cooked = std::make_shared<CookedMesh>();
+        bool opened = cooked->open(filename);
+        double openTime = getMilliseconds(start);
+
+        //reading one float per page faults the whole mesh in without any parsing
+        start = Clock::now();
+        volatile float sum = 0.0f; //keeps the reads
+        const Vec4* positions = opened ? cooked->getPositions() : nullptr;
+        for (unsigned int i = 0; opened && i < cooked->getVertexCount(); i += 4096 / sizeof(Vec4))
+            sum = sum + positions[i].x;
+        double touchTime = getMilliseconds(start);
+
+        start = Clock::now();
+        unsigned int triangles = opened ? Entity(cooked).getMesh().triangleCount : 0;
+        double cookedTime = getMilliseconds(start);
+
+        start = Clock::now();
+        Entity parsed(mesh);
+        double parsedTime = getMilliseconds(start);
+
+        std::cout << "cooked mesh (" << (mesh.positions.size() * (sizeof(Vec4) + sizeof(Vec3)) +
+                                         mesh.indices.size() * sizeof(Index)) / (1024 * 1024) << " MB)" << std::endl;
+        std::cout << std::setw(10) << "open ms" << std::setw(12) << "touch ms" << std::setw(12) << "entity ms"
+                  << std::setw(12) << "parsed ms" << std::setw(12) << "triangles" << std::endl;
+        std::cout << std::setw(10) << std::fixed << std::setprecision(3) << openTime << std::setw(12) << touchTime
+                  << std::setw(12) << cookedTime << std::setw(12) << parsedTime << std::setw(12) << triangles << std::endl;
+        cooked->close();
+        remove(filename);
+    }
+
+private:
+    //pixel shader behind an interface, the dispatch a pipeline avoids
+    struct GrayInterface
+    {
+        virtual ~GrayInterface() {}
+        virtual uint32_t shade(float gray) const = 0;
+    };
+
+    struct VirtualGray : GrayInterface
+    {
+        uint32_t shade(float gray) const override {
+            return GrayShader()(Varyings<1>{{gray}}, 0);
+        }
+    };
+
+    struct VirtualGrayShader
+    {
+        const GrayInterface* shader;
+
+        uint32_t operator()(const Varyings<1>& in, unsigned int) const {
+            return shader->shade(in.v[0]);
+        }
+    };
+
+    //front facing triangles of every entity in screen space for a camera at the origin looking down +z, in scene
+    //order with a random flat shading level each, triangles reaching in front of the near plane are left out
+    static Vertex projectScene(const Scene& scene, int width, int height) {
+        Mat4 viewport = Mat4::translate({width / 2.0f, height / 2.0f, 0.0f}) * Mat4::scale({width / 2.0f, -height / 2.0f, 1.0f});
+        std::mt19937 rng(23);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        Vertex buffer;
+        for (EntityId id = 0; id < scene.size(); ++id) {
+            MeshData mesh = scene.get(id).getMesh();
+            Mat4 model = scene.get(id).getModelMatrix();
+            for (unsigned int k = 0; k < mesh.triangleCount; ++k) {
+                const Index& i = mesh.indices[k];
+                Vec4 view[3] = {model * mesh.positions[i.x], model * mesh.positions[i.y], model * mesh.positions[i.z]};
+                Vec3 a = {view[1].x - view[0].x, view[1].y - view[0].y, view[1].z - view[0].z};
+                Vec3 b = {view[2].x - view[0].x, view[2].y - view[0].y, view[2].z - view[0].z};
+                Vec3 normal = a.crossProduct(b);
+                if (normal.x * view[0].x + normal.y * view[0].y + normal.z * view[0].z >= 0.0f)
+                    continue;
+                unsigned int first = buffer.positions.size();
+                bool nearPlane = false;
+                for (const Vec4& v : view) {
+                    Vec4 clip = Mat4::perspective() * v;
+                    nearPlane = nearPlane || clip.w < 200.0f;
+                    buffer.positions.push_back(viewport * Vec4(clip.x / clip.w, clip.y / clip.w, clip.z / clip.w, 1.0f));
+                }
+                if (nearPlane) {
+                    buffer.positions.resize(first);
+                    continue;
+                }
+                buffer.indices.emplace_back(first, first + 1, first + 2);
+                buffer.shadingLevel.push_back(unit(rng));
+            }
+        }
+        buffer.cullFlags.assign(buffer.indices.size(), false);
+        return buffer;
+    }
+
+    //clears target before every run, returns the fastest run in ms
+    template<typename Draw>
+    static double timeDraw(RenderTarget& target, unsigned int iterations, Draw&& draw) {
+        double best = 0.0;
+        unsigned int pixels = target.rect.x1 * target.rect.y1;
+        for (unsigned int k = 0; k < iterations; ++k) {
+            std::fill(target.color, target.color + pixels, 0u);
+            std::fill(target.depth, target.depth + pixels, 10000.0f);
+            Clock::time_point start = Clock::now();
+            draw();
+            double time = getMilliseconds(start);
+            best = k == 0 ? time : std::min(best, time);
+        }
+        return best;
+    }
+
+    //the raster loop Screen had before shaders were pipelines: one color, depth tested and written
+    static void drawSolidByHand(const Vertex& buffer, uint32_t color, RenderTarget& target) {
+        unsigned int written = 0;
+        for (const Index& i : buffer.indices) {
+            Vec3 a(buffer.positions[i.x].x, buffer.positions[i.x].y, buffer.positions[i.x].z);
+            Vec3 b(buffer.positions[i.y].x, buffer.positions[i.y].y, buffer.positions[i.y].z);
+            Vec3 c(buffer.positions[i.z].x, buffer.positions[i.z].y, buffer.positions[i.z].z);
+            TriangleSetup t;
+            if (!t.setup(a, b, c))
+                continue;
+            scanTriangle(t, target.rect, [&](int y, int xStart, int xEnd) {
+                float z = t.valueAt(t.top->z, t.dzdx, t.dzdy, xStart, float(y) + 0.5f);
+                uint32_t* colorRow = target.color + y * target.width;
+                float* depthRow = target.depth + y * target.width;
+                for (int x = xStart; x < xEnd; ++x) {
+                    if (z < depthRow[x]) {
+                        depthRow[x] = z;
+                        colorRow[x] = color;
+                        ++written;
+                    }
+                    z += t.dzdx;
+                }
+            });
+        }
+        target.pixelsWritten += written;
+    }
+
+    //same with a gray level per corner
+    static void drawGrayByHand(const Vertex& buffer, RenderTarget& target) {
+        unsigned int written = 0;
+        for (const Index& i : buffer.indices) {
+            Vec3 a(buffer.positions[i.x].x, buffer.positions[i.x].y, buffer.positions[i.x].z);
+            Vec3 b(buffer.positions[i.y].x, buffer.positions[i.y].y, buffer.positions[i.y].z);
+            Vec3 c(buffer.positions[i.z].x, buffer.positions[i.z].y, buffer.positions[i.z].z);
+            TriangleSetup t;
+            if (!t.setup(a, b, c))
+                continue;
+            float grays[3] = {230.0f * buffer.vertexLight[i.x] + 25.0f, 230.0f * buffer.vertexLight[i.y] + 25.0f,
+                              230.0f * buffer.vertexLight[i.z] + 25.0f};
+            float topGray = grays[t.order[0]];
+            float dgdx, dgdy;
+            t.gradient(topGray, grays[t.order[1]], grays[t.order[2]], dgdx, dgdy);
+            scanTriangle(t, target.rect, [&](int y, int xStart, int xEnd) {
+                float yc = float(y) + 0.5f;
+                float z = t.valueAt(t.top->z, t.dzdx, t.dzdy, xStart, yc);
+                float gray = t.valueAt(topGray, dgdx, dgdy, xStart, yc);
+                uint32_t* colorRow = target.color + y * target.width;
+                float* depthRow = target.depth + y * target.width;
+                for (int x = xStart; x < xEnd; ++x) {
+                    if (z < depthRow[x]) {
+                        uint32_t g = uint32_t(std::min(std::max(gray, 0.0f), 255.0f));
+                        depthRow[x] = z;
+                        colorRow[x] = g << 24 | g << 16 | g << 8 | 0xff;
+                        ++written;
+                    }
+                    z += t.dzdx;
+                    gray += dgdx;
+                }
+            });
+        }
+        target.pixelsWritten += written;
+    }
+};
+
+}
+
+#endif //BENCHMARK_H
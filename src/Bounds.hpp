@@ -0,0 +1,200 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "Math.hpp"
+
+namespace paint {
+
+enum class Containment {
+    Outside = 0,
+    Intersects,
+    Inside
+};
+
+//axis aligned bounding box, empty if min > max
+struct AABB
+{
+    Vec3 min {1.0f, 1.0f, 1.0f};
+    Vec3 max {-1.0f, -1.0f, -1.0f};
+
+    bool isEmpty() const {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    Vec3 center() const {
+        return (min + max) * 0.5f;
+    }
+
+    //half size along each axis
+    Vec3 extents() const {
+        return (max - min) * 0.5f;
+    }
+
+    //sum of edge lengths, used as insertion cost by the scene hierarchy
+    float perimeter() const {
+        Vec3 d = max - min;
+        return 4.0f * (d.x + d.y + d.z);
+    }
+
+    bool contains(const AABB& other) const {
+        return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z &&
+               max.x >= other.max.x && max.y >= other.max.y && max.z >= other.max.z;
+    }
+
+    static AABB merge(const AABB& a, const AABB& b) {
+        if (a.isEmpty())
+            return b;
+        if (b.isEmpty())
+            return a;
+        AABB ret;
+        ret.min = {std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z)};
+        ret.max = {std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z)};
+        return ret;
+    }
+
+    void expand(const Vec3& point) {
+        if (isEmpty()) {
+            min = point;
+            max = point;
+            return;
+        }
+        min = {std::min(min.x, point.x), std::min(min.y, point.y), std::min(min.z, point.z)};
+        max = {std::max(max.x, point.x), std::max(max.y, point.y), std::max(max.z, point.z)};
+    }
+};
+
+struct BoundingSphere
+{
+    Vec3 center;
+    float radius = -1.0f; //negative radius is an empty sphere
+
+    bool isEmpty() const {
+        return radius < 0.0f;
+    }
+};
+
+inline AABB computeAABB(const std::vector<Vec4>& positions) {
+    AABB box;
+    for (const Vec4& p : positions)
+        box.expand({p.x, p.y, p.z});
+    return box;
+}
+
+//sphere centered on the box, radius is the farthest vertex from the center
+inline BoundingSphere computeBoundingSphere(const std::vector<Vec4>& positions) {
+    BoundingSphere sphere;
+    AABB box = computeAABB(positions);
+    if (box.isEmpty())
+        return sphere;
+
+    sphere.center = box.center();
+    float radiusSquared = 0.0f;
+    for (const Vec4& p : positions) {
+        Vec3 d = Vec3(p.x, p.y, p.z) - sphere.center;
+        radiusSquared = std::max(radiusSquared, d * d);
+    }
+    sphere.radius = sqrt(radiusSquared);
+    return sphere;
+}
+
+//largest axis scale of the upper 3x3 of an affine transform
+inline float getMaxScale(const Mat4& m) {
+    Vec3 x = {m.firstCol.x, m.firstCol.y, m.firstCol.z};
+    Vec3 y = {m.secondCol.x, m.secondCol.y, m.secondCol.z};
+    Vec3 z = {m.thirdCol.x, m.thirdCol.y, m.thirdCol.z};
+    return sqrt(std::max(x * x, std::max(y * y, z * z)));
+}
+
+inline BoundingSphere transformBoundingSphere(const BoundingSphere& sphere, const Mat4& m) {
+    if (sphere.isEmpty())
+        return sphere;
+    Vec4 c = m * Vec4(sphere.center.x, sphere.center.y, sphere.center.z, 1.0f);
+    BoundingSphere ret;
+    ret.center = {c.x, c.y, c.z};
+    ret.radius = sphere.radius * getMaxScale(m);
+    return ret;
+}
+
+//box enclosing the transformed box (Arvo's method)
+inline AABB transformAABB(const AABB& box, const Mat4& m) {
+    if (box.isEmpty())
+        return box;
+    Vec3 c = box.center();
+    Vec3 e = box.extents();
+    Vec4 center = m * Vec4(c.x, c.y, c.z, 1.0f);
+    Vec3 extents = {fabs(m.firstCol.x) * e.x + fabs(m.secondCol.x) * e.y + fabs(m.thirdCol.x) * e.z,
+                    fabs(m.firstCol.y) * e.x + fabs(m.secondCol.y) * e.y + fabs(m.thirdCol.y) * e.z,
+                    fabs(m.firstCol.z) * e.x + fabs(m.secondCol.z) * e.y + fabs(m.thirdCol.z) * e.z};
+    AABB ret;
+    ret.min = Vec3(center.x, center.y, center.z) - extents;
+    ret.max = Vec3(center.x, center.y, center.z) + extents;
+    return ret;
+}
+
+//six planes (xyz normal pointing inside, w offset) extracted from a projection matrix
+//a point p is inside when plane * (p, 1) >= 0
+struct Frustum
+{
+    Vec4 planes[6];
+
+    //planes of clip space NDC x:[-1, 1], y:[-1, 1], z:[0,1] in the space the matrix transforms from
+    static Frustum fromMatrix(const Mat4& m) {
+        Vec4 row0 = {m.firstCol.x, m.secondCol.x, m.thirdCol.x, m.fourthCol.x};
+        Vec4 row1 = {m.firstCol.y, m.secondCol.y, m.thirdCol.y, m.fourthCol.y};
+        Vec4 row2 = {m.firstCol.z, m.secondCol.z, m.thirdCol.z, m.fourthCol.z};
+        Vec4 row3 = {m.firstCol.w, m.secondCol.w, m.thirdCol.w, m.fourthCol.w};
+
+        Frustum f;
+        f.planes[0] = row3 + row0; //left
+        f.planes[1] = row3 - row0; //right
+        f.planes[2] = row3 + row1; //bottom
+        f.planes[3] = row3 - row1; //top
+        f.planes[4] = row2;        //near
+        f.planes[5] = row3 - row2; //far
+
+        for (Vec4& p : f.planes) {
+            float length = sqrt(p.x * p.x + p.y * p.y + p.z * p.z);
+            p = p * (1.0f / length);
+        }
+        return f;
+    }
+
+    bool intersects(const BoundingSphere& sphere) const {
+        if (sphere.isEmpty())
+            return false;
+        for (const Vec4& p : planes) {
+            if (p.x * sphere.center.x + p.y * sphere.center.y + p.z * sphere.center.z + p.w < -sphere.radius)
+                return false;
+        }
+        return true;
+    }
+
+    bool intersects(const AABB& box) const {
+        return classify(box) != Containment::Outside;
+    }
+
+    //Inside if the whole box is inside all planes, used to skip tests for entire subtrees
+    Containment classify(const AABB& box) const {
+        if (box.isEmpty())
+            return Containment::Outside;
+        Vec3 c = box.center();
+        Vec3 e = box.extents();
+        Containment ret = Containment::Inside;
+        for (const Vec4& p : planes) {
+            float r = fabs(p.x) * e.x + fabs(p.y) * e.y + fabs(p.z) * e.z;
+            float d = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+            if (d < -r)
+                return Containment::Outside;
+            if (d < r)
+                ret = Containment::Intersects;
+        }
+        return ret;
+    }
+};
+
+} // namespace paint
+
+#endif //BOUNDS_H
@@ -3,30 +3,441 @@
 
 #include "CoordinateTransformer.hpp"
 #include "Drawable.hpp"
+#include "Entity.hpp"
+#include "Scene.hpp"
+#include "Bounds.hpp"
+#include "Stats.hpp"
+#include "OcclusionBuffer.hpp"
+#include "RenderQueue.hpp"
+#include "Material.hpp"
+#include "FrameArena.hpp"
+#include "Light.hpp"
+#include "ShadowMap.hpp"
+#include "GBuffer.hpp"
+#include "VisibilityBuffer.hpp"
+#include "JobSystem.hpp"
 #include "Math.hpp"
+#include <limits>
+#include <chrono>
 
 namespace paint {
 
 class Camera {
 private:
+    //visible entities per occlusion test and recording job
+    static constexpr unsigned int BATCH_ENTITIES = 64;
+
+    //part of a render queue entry on its way through the job system
+    struct GeometryBatch
+    {
+        unsigned int command; //render queue position
+        Material material;
+        const Entity* entity;
+        const MeshBatch* mesh; //of the entity's current level
+        Drawable drawable; //made by the job
+    };
+
     CoordinateTransformer m_CT;
     Vec3 m_translation;
     Vec3 m_scale;
     float m_angle;
     float m_tiltAngle;
     Vec3 m_rotationAxis;
+    Frustum m_frustum; //view space
+    FrameStats m_stats;
+    std::vector<EntityId> m_visible; //reused between frames
+    OcclusionBuffer m_occlusionBuffer;
+    RenderQueue m_renderQueue;
+    Material m_material; //state of the last draw
+    FrameArena m_arena; //pipeline temporaries, reset by beginFrame()
+    std::vector<Light> m_viewLights; //view space copies of the lights, updated once per frame
+    LightSet m_entityLights; //lights that reach the entity being drawn
+    std::vector<ShadowMap> m_shadowMaps; //per scene light, only rendered for lights casting shadows
+    std::vector<const ShadowMap*> m_viewShadows; //per view light, nullptr if unshadowed this frame
+    std::vector<Mat4> m_viewToShadowMap; //per view light, view space to map space
+    RenderPath m_renderPath;
+    GBuffer m_gBuffer; //deferred path only, sized to the screen
+    VisibilityBuffer m_visibility; //visibility path only, sized to the screen
+    LightSet m_frameLights; //every view light, for the deferred lighting pass
+    JobSystem* m_jobs; //geometry of scene draws is processed in batches on its workers when set
+    JobSystem m_callerJobs; //a single worker, runs shadow maps and lighting on the calling thread without m_jobs
+    std::vector<FrameArena> m_workerArenas; //per worker, reset by beginFrame()
+    std::vector<RenderQueue::CommandBuffer> m_commandBuffers; //per worker, merged into the render queue
+    std::vector<GeometryBatch> m_batches; //of the current frame in queue order
+    std::vector<Vertex> m_vertexBuffers; //storage of the drawables, per batch, taken back after every draw
+    std::vector<LightSet> m_commandLights; //per render queue entry
+    std::vector<unsigned int> m_shadowLights; //scene lights rendering a shadow map this frame
+    std::vector<double> m_shadowMilliseconds; //per shadow light
 public:
     Camera(CoordinateTransformer ct) : m_CT(ct), m_translation({0.0f, 0.0f, 0.0f}), m_scale({1.0f, 1.0f, 1.0f}),
-                                       m_angle(0.0f), m_tiltAngle(0.0f), m_rotationAxis({0.0f, 1.0f, 0.0f}) {};
+                                       m_angle(0.0f), m_tiltAngle(0.0f), m_rotationAxis({0.0f, 1.0f, 0.0f}),
+                                       m_frustum(Frustum::fromMatrix(Mat4::perspective())),
+                                       m_renderQueue(Mat4::perspective()), m_renderPath(RenderPath::Forward),
+                                       m_jobs(nullptr), m_callerJobs(1) {
+        m_CT.setMaterial(m_material);
+    };
 
     Vec3 getLocation() const {
         return m_translation;
     }
 
+    Mat4 getViewMatrix() const {
+        return Mat4::rotate(-m_tiltAngle, {1.0f, 0.0f, 0.0f}) * Mat4::rotate(-m_angle, m_rotationAxis) * Mat4::scale(m_scale) * Mat4::translate(m_translation * (-1));
+    }
+
     //view transforms
     void draw(Drawable&& drawable) {
-        drawable.applyTransformation(Mat4::rotate(-m_tiltAngle, {1.0f, 0.0f, 0.0f}) * Mat4::rotate(-m_angle, m_rotationAxis) * Mat4::scale(m_scale) * Mat4::translate(m_translation * (-1)));
-        m_CT.draw(drawable); //passes to coordinate transform
+        m_stats.trianglesSubmitted += drawable.getVertexIndexSize();
+        drawable.applyTransformation(getViewMatrix());
+        m_CT.draw(drawable, m_arena); //passes to coordinate transform
+        m_stats.clustersCulled += drawable.getClustersCulled();
+        m_stats.clusterTrianglesCulled += drawable.getClusterTrianglesCulled();
+        m_stats.arenaBytes = m_arena.getStats().bytesUsed;
+        m_vertexBuffers.resize(std::max<size_t>(m_vertexBuffers.size(), 1));
+        m_vertexBuffers[0] = drawable.releaseVertexBuffer(); //reused by the next entity draw
+    }
+
+    //test entity bounds against the view frustum before any vertex processing
+    //drawn immediately, draw order is up to the caller
+    void draw(Entity& entity) {
+        if (!isVisible(entity)) {
+            ++m_stats.entitiesCulled;
+            return;
+        }
+        ++m_stats.entitiesDrawn;
+        entity.selectLod(getScreenSize(entity));
+        setMaterial(entity.getMaterial());
+        gatherLights(entity);
+        draw(entity.getDrawable(takeVertexBuffer(0)));
+    }
+
+    //world space lights used by following draws, moved into view space once
+    //drawing a scene sets its lights
+    void setLights(const std::vector<Light>& lights) {
+        Mat4 view = getViewMatrix();
+        m_viewLights.clear();
+        for (const Light& light : lights)
+            m_viewLights.push_back(light.transformed(view));
+        m_viewShadows.assign(lights.size(), nullptr);
+        m_viewToShadowMap.assign(lights.size(), Mat4());
+    }
+
+    //depth of every scene entity seen from light, at full detail, rendered on the workers of jobs
+    static void renderShadowMap(const Scene& scene, const Light& light, ShadowMap& map, JobSystem& jobs) {
+        map.begin(scene.getBounds(), light.direction, light.shadowMapSize, light.shadowFilterRadius);
+        for (EntityId id = 0; id < scene.size(); ++id) {
+            const Entity& entity = scene.get(id);
+            map.addCaster(entity.getMesh(), entity.getModelMatrix());
+        }
+        map.render(jobs);
+    }
+
+    //lights whose range reaches the entity bounds go to the lighting stage, the rest are skipped for this draw
+    void gatherLights(const Entity& entity) {
+        gatherLights(entity, m_entityLights);
+        m_CT.setLights(&m_entityLights);
+    }
+
+    //as above, into lights
+    void gatherLights(const Entity& entity, LightSet& lights) {
+        lights.clear();
+        if (entity.getMaterial().shading == ShadingMode::Unlit)
+            return;
+        BoundingSphere sphere = transformBoundingSphere(entity.getBoundingSphere(), getViewMatrix() * entity.getModelMatrix());
+        for (unsigned int k = 0; k < m_viewLights.size(); ++k) {
+            const Light& light = m_viewLights[k];
+            if (light.affects(sphere))
+                lights.add(light, m_viewShadows[k], m_viewToShadowMap[k]);
+            else
+                ++m_stats.lightsCulled;
+        }
+    }
+
+    //hierarchical frustum culling through the scene hierarchy, then occlusion culling against the
+    //visible occluders, entities passing both go through the render queue (opaque front to back so
+    //the depth test rejects hidden pixels early, then translucent back to front)
+    //shadow maps are rendered first, each spread over the workers in bands of rows
+    void draw(Scene& scene) {
+        const std::vector<Light>& lights = scene.getLights();
+        setLights(lights);
+        m_shadowMaps.resize(lights.size());
+        m_shadowLights.clear();
+        for (unsigned int k = 0; k < lights.size(); ++k) {
+            if (lights[k].castsShadows && lights[k].type == LightType::Directional)
+                m_shadowLights.push_back(k);
+        }
+        m_shadowMilliseconds.assign(m_shadowLights.size(), 0.0);
+        for (unsigned int k = 0; k < m_shadowLights.size(); ++k) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            unsigned int light = m_shadowLights[k];
+            renderShadowMap(scene, lights[light], m_shadowMaps[light], getJobs());
+            m_shadowMilliseconds[k] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        Mat4 viewProjection = Mat4::perspective() * getViewMatrix();
+        Frustum frustum = Frustum::fromMatrix(viewProjection); //world space
+        m_visible.clear();
+        m_stats.bvhNodesVisited += scene.query(frustum, m_visible);
+        m_stats.entitiesCulled += scene.size() - m_visible.size();
+
+        //occlusion pass
+        bool hasOccluders = false;
+        m_occlusionBuffer.clear();
+        for (EntityId id : m_visible) {
+            const Entity& entity = scene.get(id);
+            if (entity.isOccluder()) {
+                m_occlusionBuffer.addOccluder(entity.getMesh(), viewProjection * entity.getModelMatrix());
+                hasOccluders = true;
+            }
+        }
+        m_stats.occluderTriangles += m_occlusionBuffer.getTriangleCount();
+
+        //with a job system the visible entities are tested and recorded by the workers, each into its own command
+        //buffer, the buffers are sorted there too and merged by key into the queue
+        m_renderQueue.clear();
+        Mat4 view = getViewMatrix();
+        auto submit = [&](EntityId id, RenderQueue::CommandBuffer* buffer) {
+            const Entity& entity = scene.get(id);
+            if (hasOccluders && !entity.isOccluder() &&
+                !m_occlusionBuffer.isVisible(entity.getAABB(), viewProjection * entity.getModelMatrix()))
+                return;
+            const Vec3& c = entity.getBoundingSphere().center;
+            Vec4 center = view * entity.getModelMatrix() * Vec4(c.x, c.y, c.z, 1.0f);
+            if (buffer != nullptr)
+                m_renderQueue.record(*buffer, id, entity.getMaterial(), center.z);
+            else
+                m_renderQueue.submit(id, entity.getMaterial(), center.z);
+        };
+        if (m_jobs != nullptr) {
+            m_jobs->parallelFor(m_visible.size(), BATCH_ENTITIES, [&](unsigned int begin, unsigned int end, unsigned int worker) {
+                for (unsigned int k = begin; k < end; ++k)
+                    submit(m_visible[k], &m_commandBuffers[worker]);
+            });
+            m_jobs->parallelFor(m_commandBuffers.size(), 1, [&](unsigned int begin, unsigned int end, unsigned int) {
+                for (unsigned int k = begin; k < end; ++k)
+                    m_commandBuffers[k].sort();
+            });
+            m_renderQueue.merge(m_commandBuffers);
+        } else {
+            for (EntityId id : m_visible)
+                submit(id, nullptr);
+            m_renderQueue.sort();
+        }
+        m_stats.entitiesOccluded += m_visible.size() - m_renderQueue.size();
+
+        Mat4 viewToWorld = view.inverseAffine();
+        for (unsigned int k = 0; k < m_shadowLights.size(); ++k) {
+            unsigned int light = m_shadowLights[k];
+            m_viewShadows[light] = &m_shadowMaps[light];
+            m_viewToShadowMap[light] = m_shadowMaps[light].getWorldToMap() * viewToWorld;
+            m_stats.shadowMilliseconds.push_back(m_shadowMilliseconds[k]);
+            m_stats.shadowTriangles += m_shadowMaps[light].getStats().triangles;
+        }
+
+        //deferred and visibility: opaque entities fill the G-buffer or the visibility buffer, lit in one pass
+        //before the translucent ones blend over them, recorded frames are always forward
+        bool recording = m_CT.isRecording();
+        bool deferred = m_renderPath != RenderPath::Forward && !recording;
+        if (deferred) {
+            Screen& screen = m_CT.getScreen();
+            if (m_renderPath == RenderPath::Visibility) {
+                m_visibility.resize(screen.getWidth(), screen.getHeight());
+                m_visibility.clear();
+                m_CT.setVisibilityBuffer(&m_visibility);
+            } else {
+                m_gBuffer.resize(screen.getWidth(), screen.getHeight());
+                m_gBuffer.clear();
+                m_CT.setGBuffer(&m_gBuffer);
+            }
+        }
+        if (m_jobs != nullptr) {
+            deferred = drawBatches(scene, deferred);
+        } else {
+            for (const DrawCommand& command : m_renderQueue) {
+                if (deferred && command.material.isTranslucent()) {
+                    resolveLighting();
+                    deferred = false;
+                }
+                const Entity& entity = scene.get(command.entity);
+                ++m_stats.entitiesDrawn;
+                scene.selectLod(command.entity, getScreenSize(entity));
+                setMaterial(command.material);
+                gatherLights(entity);
+                draw(entity.getDrawable(takeVertexBuffer(0)));
+            }
+        }
+        if (deferred)
+            resolveLighting();
+        if (recording)
+            return; //raster statistics come from the thread drawing the list
+        Screen& screen = m_CT.getScreen();
+        if (screen.getHiddenSurface() == HiddenSurface::SpanBuffer) {
+            screen.resolve();
+            m_stats.spans = screen.getSpanCount();
+            m_stats.spanBytes = screen.getHiddenSurfaceBytes();
+        }
+        m_stats.pixelsWritten = m_CT.getPixelsWritten();
+    }
+
+    //render queue through the job system: lod selection and light gathering on this thread, then the geometry of
+    //every entity in batches of up to MeshBatch::MAX_TRIANGLES spread over the workers, then rasterized (or recorded) here
+    //in queue order, so the frame does not depend on which worker took which batch
+    //returns whether lighting is still to be resolved, as the serial loop would leave it
+    bool drawBatches(Scene& scene, bool deferred) {
+        Mat4 view = getViewMatrix();
+        m_batches.clear();
+        m_commandLights.resize(std::max<size_t>(m_commandLights.size(), m_renderQueue.size()));
+        unsigned int command = 0;
+        for (const DrawCommand& entry : m_renderQueue) {
+            const Entity& entity = scene.get(entry.entity);
+            ++m_stats.entitiesDrawn;
+            scene.selectLod(entry.entity, getScreenSize(entity));
+            gatherLights(entity, m_commandLights[command]);
+            for (const MeshBatch& batch : entity.getBatches()) {
+                m_batches.push_back({command, entry.material, &entity, &batch, Drawable(Vertex())});
+                m_stats.trianglesSubmitted += batch.triangleCount;
+            }
+            ++command;
+        }
+
+        //translucent entities come after the opaque ones, lighting is resolved before the first
+        m_vertexBuffers.resize(std::max(m_vertexBuffers.size(), m_batches.size()));
+        m_jobs->parallelFor(m_batches.size(), 1, [&](unsigned int begin, unsigned int end, unsigned int worker) {
+            for (unsigned int k = begin; k < end; ++k) {
+                GeometryBatch& batch = m_batches[k];
+                batch.drawable = batch.entity->getDrawable(*batch.mesh, takeVertexBuffer(k));
+                batch.drawable.applyTransformation(view);
+                m_CT.process(batch.drawable, batch.material.shading, deferred && !batch.material.isTranslucent(),
+                             m_commandLights[batch.command], m_workerArenas[worker]);
+            }
+        });
+
+        for (unsigned int k = 0; k < m_batches.size(); ++k) {
+            GeometryBatch& batch = m_batches[k];
+            if (deferred && batch.material.isTranslucent()) {
+                resolveLighting();
+                deferred = false;
+            }
+            setMaterial(batch.material);
+            m_CT.submit(batch.drawable);
+            m_stats.clustersCulled += batch.drawable.getClustersCulled();
+            m_stats.clusterTrianglesCulled += batch.drawable.getClusterTrianglesCulled();
+            m_vertexBuffers[k] = batch.drawable.releaseVertexBuffer();
+        }
+
+        m_stats.arenaBytes = m_arena.getStats().bytesUsed;
+        for (const FrameArena& arena : m_workerArenas)
+            m_stats.arenaBytes += arena.getStats().bytesUsed;
+        m_stats.geometryBatches = m_batches.size();
+        m_stats.workerUtilization.clear();
+        for (unsigned int k = 0; k < m_jobs->getWorkerCount(); ++k) {
+            m_stats.workerUtilization.push_back(m_jobs->getUtilization(k));
+            m_stats.batchesStolen += m_jobs->getStats(k).steals;
+        }
+        return deferred;
+    }
+
+    //geometry of following scene draws goes through jobs (one worker per thread it runs), nullptr processes it
+    //entity by entity on the calling thread
+    void setJobSystem(JobSystem* jobs) {
+        m_jobs = jobs;
+        m_workerArenas.resize(jobs != nullptr ? jobs->getWorkerCount() : 0);
+        m_commandBuffers.resize(m_workerArenas.size());
+    }
+
+    //workers for shadow maps and lighting, the caller alone without a job system
+    JobSystem& getJobs() {
+        return m_jobs != nullptr ? *m_jobs : m_callerJobs;
+    }
+
+    //storage for the drawable of batch k, left by the drawable that last had it (empty the first time)
+    Vertex takeVertexBuffer(unsigned int k) {
+        return k < m_vertexBuffers.size() ? std::move(m_vertexBuffers[k]) : Vertex();
+    }
+
+    //following draws go into list instead of the screen (forward), nullptr draws to the screen again
+    void setDrawList(DrawList* list) {
+        m_CT.setDrawList(list);
+    }
+
+    //how following scene draws are shaded, entities drawn on their own are always forward
+    void setRenderPath(RenderPath path) {
+        m_renderPath = path;
+    }
+
+    RenderPath getRenderPath() const {
+        return m_renderPath;
+    }
+
+    //deferred or visibility lighting pass over the opaque pixels drawn so far, once per pixel with the lights of
+    //its screen tile, following draws are forward
+    void resolveLighting() {
+        m_frameLights.clear();
+        for (unsigned int k = 0; k < m_viewLights.size(); ++k)
+            m_frameLights.add(m_viewLights[k], m_viewShadows[k], m_viewToShadowMap[k]);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        Screen& screen = m_CT.getScreen();
+        GBuffer::LightingStats lighting;
+        if (m_renderPath == RenderPath::Visibility) {
+            lighting = m_visibility.resolve(screen.getRenderTarget(), m_frameLights, Mat4::perspective(),
+                                            m_CT.getViewportScale(), m_CT.getViewportOffset(), getJobs());
+            m_stats.visibilityBytes = m_visibility.getBytes();
+            m_stats.visibilityTriangles = m_visibility.getTriangleCount();
+        } else {
+            lighting = m_gBuffer.resolve(screen.getRenderTarget(), m_frameLights, Mat4::perspective(),
+                                         m_CT.getViewportScale(), m_CT.getViewportOffset(), getJobs());
+            m_stats.gBufferBytes = m_gBuffer.getBytes();
+        }
+        m_stats.lightTiles = lighting.tiles;
+        m_stats.tileLights = lighting.tileLights;
+        m_stats.lightingMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        m_CT.setGBuffer(nullptr);
+        m_CT.setVisibilityBuffer(nullptr);
+    }
+
+    //only switches rasterizer state when it changes
+    void setMaterial(const Material& material) {
+        if (material == m_material)
+            return;
+        m_material = material;
+        m_CT.setMaterial(material);
+        ++m_stats.stateChanges;
+    }
+
+    //projected diameter of the entity bounding sphere in pixels
+    float getScreenSize(const Entity& entity) const {
+        BoundingSphere sphere = transformBoundingSphere(entity.getBoundingSphere(), getViewMatrix() * entity.getModelMatrix());
+        if (sphere.center.z <= sphere.radius)
+            return std::numeric_limits<float>::max(); //camera inside the sphere
+        float focal = Mat4::perspective().firstCol.x * m_CT.getViewportScale().x;
+        return 2.0f * sphere.radius * focal / sphere.center.z;
+    }
+
+    //sphere test first (cheap), then the tighter box
+    bool isVisible(const Entity& entity) const {
+        Mat4 modelView = getViewMatrix() * entity.getModelMatrix();
+        if (!m_frustum.intersects(transformBoundingSphere(entity.getBoundingSphere(), modelView)))
+            return false;
+        return m_frustum.intersects(transformAABB(entity.getAABB(), modelView));
+    }
+
+    //resets per frame statistics and releases last frame's temporaries
+    void beginFrame() {
+        m_stats.reset();
+        m_arena.reset();
+        for (FrameArena& arena : m_workerArenas)
+            arena.reset();
+        if (m_jobs != nullptr)
+            m_jobs->resetStats();
+    }
+
+    const FrameArena& getArena() const {
+        return m_arena;
+    }
+
+    const FrameStats& getStats() const {
+        return m_stats;
     }
 
     void scaleTo(float zoom) {
@@ -0,0 +1,285 @@
+#ifndef COOKEDMESH_H
+#define COOKEDMESH_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <fstream>
+#include <type_traits>
+#include "Math.hpp"
+#include "Bounds.hpp"
+#include "Vertex.hpp"
+#include "Meshlet.hpp"
+#include "FacePlanes.hpp"
+#include "MappedFile.hpp"
+
+namespace paint {
+
+//sections are stored in the in-memory layout of the math types, so they can be used straight from the mapping
+static_assert(sizeof(Vec4) == 16 && std::is_trivially_copyable<Vec4>::value, "cooked positions are Vec4");
+static_assert(sizeof(Vec3) == 12 && std::is_trivially_copyable<Vec3>::value, "cooked normals are Vec3");
+static_assert(sizeof(Vec2) == 8 && std::is_trivially_copyable<Vec2>::value, "cooked uvs are Vec2");
+static_assert(sizeof(Index) == 12 && std::is_trivially_copyable<Index>::value, "cooked indices are Index");
+static_assert(std::is_trivially_copyable<Meshlet>::value, "cooked clusters are Meshlet");
+
+//binary mesh file (little endian):
+//  header      magic, version, counts, bounds and a table of section offsets/sizes
+//  positions   vertexCount Vec4
+//  indices     triangleCount Index, ordered by cluster
+//  normals     vertexCount Vec3
+//  uvs         vertexCount Vec2 or empty
+//  meshlets    clusters covering the indices in order, empty for meshes without clusters
+//  faceplanes  FacePlanes layout: x, y, z and d of FacePlanes::getPadded(triangleCount) planes each
+//everything an Entity builds at load time is cooked, so a cooked mesh is drawn straight from the mapping
+//every section starts at a multiple of SECTION_ALIGNMENT from the start of the file
+//a mapping starts on a page boundary, so section pointers are aligned in memory too
+class CookedMesh {
+public:
+    static constexpr uint32_t MAGIC = 0x48534d50; //"PMSH"
+    static constexpr uint32_t VERSION = 2;
+    static constexpr uint64_t SECTION_ALIGNMENT = 64;
+
+    enum Section : uint32_t {
+        Positions = 0,
+        Indices,
+        Normals,
+        Uvs,
+        Meshlets,
+        Planes,
+        SECTION_COUNT
+    };
+
+    struct SectionEntry
+    {
+        uint64_t offset;
+        uint64_t size; //bytes
+    };
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vertexCount;
+        uint32_t triangleCount;
+        float aabbMin[3];
+        float aabbMax[3];
+        float sphereCenter[3];
+        float sphereRadius;
+        SectionEntry sections[SECTION_COUNT];
+    };
+private:
+    MappedFile m_file;
+    const Header* m_header;
+public:
+    CookedMesh() : m_header(nullptr) {};
+
+    //writes vertex to filename with its normals, clusters and face planes, returns false if the file can not be written
+    static bool cook(const Vertex& vertex, const std::string& filename) {
+        Vertex mesh;
+        mesh.positions = vertex.positions;
+        mesh.indices = vertex.indices;
+        mesh.normals = vertex.normals;
+        if (mesh.normals.size() != mesh.positions.size())
+            mesh.normals = computeVertexNormals(mesh.positions, mesh.indices);
+        //clustering reorders the indices, planes follow the new order
+        std::vector<Meshlet> meshlets = buildMeshlets(mesh);
+        FacePlanes planes = computeFacePlanes(mesh.positions, mesh.indices);
+
+        Header header;
+        memset(&header, 0, sizeof(header));
+        header.magic = MAGIC;
+        header.version = VERSION;
+        header.vertexCount = mesh.positions.size();
+        header.triangleCount = mesh.indices.size();
+
+        AABB aabb = computeAABB(mesh.positions);
+        BoundingSphere sphere = computeBoundingSphere(mesh.positions);
+        copyVec3(aabb.min, header.aabbMin);
+        copyVec3(aabb.max, header.aabbMax);
+        copyVec3(sphere.center, header.sphereCenter);
+        header.sphereRadius = sphere.radius;
+
+        const void* data[SECTION_COUNT] = {mesh.positions.data(), mesh.indices.data(), mesh.normals.data(), nullptr,
+                                           meshlets.data(), planes.values.data()};
+        uint64_t sizes[SECTION_COUNT] = {mesh.positions.size() * sizeof(Vec4), mesh.indices.size() * sizeof(Index),
+                                         mesh.normals.size() * sizeof(Vec3), 0, meshlets.size() * sizeof(Meshlet),
+                                         planes.values.size() * sizeof(float)};
+        uint64_t offset = align(sizeof(Header));
+        for (unsigned int i = 0; i < SECTION_COUNT; ++i) {
+            header.sections[i] = {offset, sizes[i]};
+            offset = align(offset + sizes[i]);
+        }
+
+        std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        uint64_t written = sizeof(header);
+        for (unsigned int i = 0; i < SECTION_COUNT; ++i) {
+            pad(file, header.sections[i].offset - written);
+            if (sizes[i] > 0)
+                file.write(static_cast<const char*>(data[i]), sizes[i]);
+            written = header.sections[i].offset + sizes[i];
+        }
+        return bool(file);
+    }
+
+    //maps the file and validates the header, the section table, every index and the cluster ranges
+    bool open(const std::string& filename) {
+        m_header = nullptr;
+        if (!m_file.open(filename) || m_file.getSize() < sizeof(Header))
+            return false;
+
+        const Header* header = reinterpret_cast<const Header*>(m_file.getData());
+        if (header->magic != MAGIC || header->version != VERSION)
+            return false;
+
+        uint64_t expected[SECTION_COUNT] = {uint64_t(header->vertexCount) * sizeof(Vec4),
+                                            uint64_t(header->triangleCount) * sizeof(Index),
+                                            uint64_t(header->vertexCount) * sizeof(Vec3),
+                                            uint64_t(header->vertexCount) * sizeof(Vec2),
+                                            header->sections[Meshlets].size / sizeof(Meshlet) * sizeof(Meshlet), //whole clusters
+                                            (uint64_t(header->triangleCount) + FacePlanes::LANES - 1) * 4 * sizeof(float)};
+        for (unsigned int i = 0; i < SECTION_COUNT; ++i) {
+            const SectionEntry& section = header->sections[i];
+            bool optional = i == Uvs || i == Meshlets;
+            if (section.size != expected[i] && !(optional && section.size == 0))
+                return false;
+            if (section.offset % SECTION_ALIGNMENT != 0 || section.offset > m_file.getSize() ||
+                section.size > m_file.getSize() - section.offset)
+                return false;
+        }
+        m_header = header;
+        if (!hasValidIndices() || !hasValidMeshlets()) {
+            m_header = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        m_file.close();
+        m_header = nullptr;
+    }
+
+    bool isOpen() const {
+        return m_header != nullptr;
+    }
+
+    unsigned int getVertexCount() const {
+        return m_header->vertexCount;
+    }
+
+    unsigned int getTriangleCount() const {
+        return m_header->triangleCount;
+    }
+
+    //pointers into the mapping, valid while the CookedMesh is open
+    const Vec4* getPositions() const {
+        return getSection<Vec4>(Positions);
+    }
+
+    const Index* getIndices() const {
+        return getSection<Index>(Indices);
+    }
+
+    const Vec3* getNormals() const {
+        return getSection<Vec3>(Normals);
+    }
+
+    //nullptr if the mesh was cooked without texture coordinates
+    const Vec2* getUvs() const {
+        return getSection<Vec2>(Uvs);
+    }
+
+    //nullptr if the mesh has no clusters
+    const Meshlet* getMeshlets() const {
+        return getSection<Meshlet>(Meshlets);
+    }
+
+    unsigned int getMeshletCount() const {
+        return m_header->sections[Meshlets].size / sizeof(Meshlet);
+    }
+
+    //planes of the indices as ordered in the file, referencing the mapping
+    FacePlanes getFacePlanes() const {
+        FacePlanes planes;
+        planes.mapped = getSection<float>(Planes);
+        planes.count = getTriangleCount();
+        return planes;
+    }
+
+    MeshData getMesh() const {
+        MeshData mesh;
+        mesh.positions = getPositions();
+        mesh.indices = getIndices();
+        mesh.normals = getNormals();
+        mesh.vertexCount = getVertexCount();
+        mesh.triangleCount = getTriangleCount();
+        return mesh;
+    }
+
+    AABB getAABB() const {
+        AABB aabb;
+        aabb.min = {m_header->aabbMin[0], m_header->aabbMin[1], m_header->aabbMin[2]};
+        aabb.max = {m_header->aabbMax[0], m_header->aabbMax[1], m_header->aabbMax[2]};
+        return aabb;
+    }
+
+    BoundingSphere getBoundingSphere() const {
+        BoundingSphere sphere;
+        sphere.center = {m_header->sphereCenter[0], m_header->sphereCenter[1], m_header->sphereCenter[2]};
+        sphere.radius = m_header->sphereRadius;
+        return sphere;
+    }
+
+private:
+    //the pipeline indexes positions and face planes without checks
+    bool hasValidIndices() const {
+        const Index* indices = getIndices();
+        unsigned int vertexCount = getVertexCount();
+        for (unsigned int k = 0; k < getTriangleCount(); ++k) {
+            if (indices[k].x >= vertexCount || indices[k].y >= vertexCount || indices[k].z >= vertexCount)
+                return false;
+        }
+        return true;
+    }
+
+    //clusters follow each other without gaps and end with the last triangle
+    bool hasValidMeshlets() const {
+        const Meshlet* meshlets = getMeshlets();
+        unsigned int end = 0;
+        for (unsigned int k = 0; k < getMeshletCount(); ++k) {
+            if (meshlets[k].firstTriangle != end || meshlets[k].triangleCount == 0 ||
+                meshlets[k].triangleCount > getTriangleCount() - end)
+                return false;
+            end += meshlets[k].triangleCount;
+        }
+        return getMeshletCount() == 0 || end == getTriangleCount();
+    }
+
+    template<typename T>
+    const T* getSection(Section section) const {
+        const SectionEntry& entry = m_header->sections[section];
+        return entry.size == 0 ? nullptr : reinterpret_cast<const T*>(m_file.getData() + entry.offset);
+    }
+
+    static uint64_t align(uint64_t offset) {
+        return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+    }
+
+    static void pad(std::ofstream& file, uint64_t count) {
+        static const char zeros[SECTION_ALIGNMENT] = {};
+        file.write(zeros, count);
+    }
+
+    static void copyVec3(const Vec3& v, float* out) {
+        out[0] = v.x;
+        out[1] = v.y;
+        out[2] = v.z;
+    }
+};
+
+}
+
+#endif //COOKEDMESH_H
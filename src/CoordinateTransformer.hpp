@@ -5,6 +5,13 @@
 #include "Drawable.hpp"
 #include "Screen.hpp"
 #include "Entity.hpp"
+#include "Material.hpp"
+#include "FrameArena.hpp"
+#include "Bounds.hpp"
+#include "Light.hpp"
+#include "GBuffer.hpp"
+#include "VisibilityBuffer.hpp"
+#include "DrawList.hpp"
 
 namespace paint {
 //for normalizing coordinate system
@@ -13,20 +20,115 @@ namespace paint {
 //y axis: down is negative and up is positive
 class CoordinateTransformer {
 private: 
-    inline static Vec3 m_scale {400.0f, -300.0f, 1.0f};
-    inline static Vec3 m_offset {400.0f, 300.0f, 0.0f};
-    Entity* m_light;
+    Vec3 m_scale;
+    Vec3 m_offset;
+    const LightSet* m_lights; //view space, set per draw by the camera
     Screen* m_screen;
+    ShadingMode m_shading;
+    bool m_translucent;
+    Frustum m_frustum; //view space, for cluster culling
+    GBuffer* m_gBuffer; //opaque draws fill it instead of shading when set
+    VisibilityBuffer* m_visibility; //opaque draws store their triangle ids in it instead of shading when set
+    DrawList* m_drawList; //draws are recorded into it instead of rasterized when set, forward only
+    float m_opacity; //of the current material
 public:
-    CoordinateTransformer(Screen& screen, Entity* light) : m_screen(&screen), m_light(light) {};
+    CoordinateTransformer(Screen& screen) : 
+                m_scale(screen.getWidth() / 2.0f, -screen.getHeight() / 2.0f, 1.0f),
+                m_offset(screen.getWidth() / 2.0f, screen.getHeight() / 2.0f, 0.0f),
+                m_lights(nullptr),
+                m_screen(&screen),
+                m_shading(ShadingMode::Flat),
+                m_translucent(false),
+                m_frustum(Frustum::fromMatrix(Mat4::perspective())),
+                m_gBuffer(nullptr),
+                m_visibility(nullptr),
+                m_drawList(nullptr),
+                m_opacity(1.0f)
+    {};
+
+    //pixels per NDC unit along x and y
+    Vec3 getViewportScale() const {
+        return m_scale;
+    }
+
+    //pixel of the NDC origin
+    Vec3 getViewportOffset() const {
+        return m_offset;
+    }
+
+    Screen& getScreen() const {
+        return *m_screen;
+    }
+
+    //deferred shading of the following opaque draws into gBuffer (sized to the screen), nullptr for forward
+    //translucent draws are always shaded forward, they blend over the lit result
+    void setGBuffer(GBuffer* gBuffer) {
+        m_gBuffer = gBuffer;
+    }
+
+    //visibility buffer shading of the following opaque draws, nullptr for forward, translucent draws as above
+    void setVisibilityBuffer(VisibilityBuffer* visibility) {
+        m_visibility = visibility;
+    }
+
+    //following draws are recorded into list for rasterization on another thread, nullptr draws to the screen again
+    //the screen is not touched while recording
+    void setDrawList(DrawList* list) {
+        m_drawList = list;
+    }
+
+    bool isRecording() const {
+        return m_drawList != nullptr;
+    }
+
+    //state used by following draws
+    void setMaterial(const Material& material) {
+        m_shading = material.shading;
+        m_translucent = material.isTranslucent();
+        m_opacity = material.opacity;
+    }
+
+    //lights of the following draws in view space, must outlive them
+    void setLights(const LightSet* lights) {
+        m_lights = lights;
+    }
+
+    //pixels that passed the depth test since the screen was cleared
+    unsigned int getPixelsWritten() const {
+        return m_screen->getPixelsWritten();
+    }
+
+    //arena holds the temporaries of this draw until the end of the frame
+    void draw(Drawable& drawable, FrameArena& arena) {
+        static const LightSet noLights;
+        process(drawable, m_shading, isDeferred(), m_lights ? *m_lights : noLights, arena);
+        submit(drawable);
+    }
 
-    void draw(Drawable& drawable) {
+    //opaque draws go to the G-buffer or the visibility buffer instead of being shaded
+    bool isDeferred() const {
+        return (m_gBuffer != nullptr || m_visibility != nullptr) && !m_translucent;
+    }
+
+    //geometry stage of draw() for a drawable in view space, up to the viewport mapping: culling, lighting (normals
+    //for deferred), projection and clipping, with shading and lights given instead of the current state
+    //only reads the transformer, so drawables can go through it on several threads with an arena each
+    void process(Drawable& drawable, ShadingMode shading, bool deferred, const LightSet& lights, FrameArena& arena) const {
         drawable.clearCullFlags();
 
-        //backface culling before perspective transform
-        drawable.cullBackfaces();
+        //backface culling in object space, only vertices of front faces are transformed to view space
+        drawable.cullBackfaces(arena, m_frustum);
 
-        drawable.computeFlatShading(m_light->getPosition());
+        if (deferred && shading == ShadingMode::Flat)
+            drawable.computeFlatNormals();
+        else if (deferred && shading == ShadingMode::Gouraud)
+            drawable.computeGouraudNormals();
+        else if (shading == ShadingMode::Flat)
+            drawable.computeFlatShading(lights, arena);
+        else if (shading == ShadingMode::Gouraud)
+            drawable.computeGouraudShading(lights, arena);
+        else
+            drawable.computeUnlitShading();
 
         //perspective transformation
         drawable.applyTransformation(Mat4::perspective());
@@ -34,12 +136,26 @@ public:
 
 
 
-        drawable.clipTriangles(); //currently only clips if all triangle vertices are out of screeen!!!!! NEED TO FIX!!!
+        drawable.clipTriangles(arena); //frustum rejection + near/far/guard band clipping
 
         //viewport mapping
         drawable.applyTransformation(Mat4::translate(m_offset) * Mat4::scale(m_scale));
+    }
 
-        drawable.draw(*m_screen);
+    //raster stage of draw() for a processed drawable with the current material: drawn, or recorded while recording
+    void submit(Drawable& drawable) {
+        bool deferred = isDeferred();
+        if (m_drawList != nullptr) {
+            drawable.record(*m_drawList, m_opacity);
+            return;
+        }
+        m_screen->setOpacity(m_opacity);
+        if (deferred && m_visibility != nullptr)
+            drawable.drawVisibility(*m_screen, *m_visibility, m_shading);
+        else if (deferred)
+            drawable.drawDeferred(*m_screen, *m_gBuffer, m_shading);
+        else
+            drawable.draw(*m_screen);
     }
 
 
@@ -0,0 +1,54 @@
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+#include <vector>
+#include "Vertex.hpp"
+#include "Screen.hpp"
+
+namespace paint {
+
+//screen space triangles of one frame, recorded by the geometry stage and rasterized later, possibly on another
+//thread, every item is drawn with the stock shaders like Drawable::draw
+//items are reused from frame to frame
+class DrawList {
+private:
+    struct Item
+    {
+        Vertex buffer; //after the viewport mapping, before the perspective divide
+        float opacity;
+    };
+
+    std::vector<Item> m_items;
+    unsigned int m_count;
+public:
+    DrawList() : m_count(0) {};
+
+    void clear() {
+        m_count = 0;
+    }
+
+    //buffer of the next item, filled by the caller: positions, indices, cull flags and the shading levels
+    Vertex& add(float opacity) {
+        if (m_count == m_items.size())
+            m_items.emplace_back();
+        Item& item = m_items[m_count++];
+        item.opacity = opacity;
+        return item.buffer;
+    }
+
+    unsigned int size() const {
+        return m_count;
+    }
+
+    //rasterizes the items in recording order, leaves the screen at the opacity of the last one
+    void execute(Screen& screen) {
+        for (unsigned int k = 0; k < m_count; ++k) {
+            screen.setOpacity(m_items[k].opacity);
+            screen.drawPolygon(m_items[k].buffer);
+        }
+    }
+};
+
+}
+
+#endif //DRAWLIST_H
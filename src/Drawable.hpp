@@ -2,10 +2,21 @@
 #define DRAWABLE_H
 
 #include <math.h>
+#include <assert.h>
+#include <algorithm>
 #include <vector>
 #include "Math.hpp"
 #include "Screen.hpp"
 #include "Vertex.hpp"
+#include "FrameArena.hpp"
+#include "FacePlanes.hpp"
+#include "Meshlet.hpp"
+#include "Bounds.hpp"
+#include "Light.hpp"
+#include "GBuffer.hpp"
+#include "VisibilityBuffer.hpp"
+#include "Material.hpp"
+#include "DrawList.hpp"
 
 
 namespace paint {
@@ -13,13 +24,106 @@ namespace paint {
 //stack all translations and scaling 
 class Drawable {
 private:
+    //planes in homogeneous clip space, NDC x:[-1, 1], y:[-1, 1], z:[0,1]
+    //triangles inside the guard band (GUARD_BAND times the viewport) skip x/y clipping
+    static constexpr float GUARD_BAND = 4.0f;
+    enum ClipPlane : unsigned int {
+        NearPlane = 0,
+        FarPlane,
+        GuardLeft,
+        GuardRight,
+        GuardBottom,
+        GuardTop,
+        CLIP_PLANE_COUNT, //planes above are clipped against, planes below are only used for rejection
+        LeftPlane = CLIP_PLANE_COUNT,
+        RightPlane,
+        BottomPlane,
+        TopPlane,
+        PLANE_COUNT
+    };
+    static constexpr unsigned int CLIP_MASK = (1u << CLIP_PLANE_COUNT) - 1;
+    static constexpr unsigned int FRUSTUM_MASK = (1u << NearPlane) | (1u << FarPlane) | (1u << LeftPlane) |
+                                                 (1u << RightPlane) | (1u << BottomPlane) | (1u << TopPlane);
+    static constexpr unsigned int MAX_CLIPPED_VERTICES = 3 + CLIP_PLANE_COUNT;
+    static constexpr unsigned int REJECTED = ~0u; //straddled planes of a triangle that is not drawn
+    inline static const Vec4 m_clipPlanes[PLANE_COUNT] = {
+        {0.0f, 0.0f, 1.0f, 0.0f},           //near: z >= 0
+        {0.0f, 0.0f, -1.0f, 1.0f},          //far: z <= w
+        {1.0f, 0.0f, 0.0f, GUARD_BAND},     //guard band: x >= -g * w
+        {-1.0f, 0.0f, 0.0f, GUARD_BAND},    //guard band: x <= g * w
+        {0.0f, 1.0f, 0.0f, GUARD_BAND},     //guard band: y >= -g * w
+        {0.0f, -1.0f, 0.0f, GUARD_BAND},    //guard band: y <= g * w
+        {1.0f, 0.0f, 0.0f, 1.0f},           //left: x >= -w
+        {-1.0f, 0.0f, 0.0f, 1.0f},          //right: x <= w
+        {0.0f, 1.0f, 0.0f, 1.0f},           //bottom: y >= -w
+        {0.0f, -1.0f, 0.0f, 1.0f}           //top: y <= w
+    };
+
+    //surface points for LightSet::evaluate, arrays padded to LightSet::LANES with zeros
+    struct LightingInput {
+        float* px;
+        float* py;
+        float* pz;
+        float* nx;
+        float* ny;
+        float* nz;
+        float* level;
+    };
+
     Vertex m_vertexBuffer;
     Mat4 m_transformation;
+    Mat3 m_normalMatrix; //object to view space for normals, set by cullBackfaces
+    const FacePlanes* m_facePlanes; //owned by the mesh, computed on the fly when missing
+    const Meshlet* m_meshlets; //owned by the mesh, nullptr for meshes without clusters
+    unsigned int m_meshletCount;
+    unsigned int m_firstTriangle; //of the mesh the face planes and clusters belong to, for a batch of its triangles
+    unsigned int m_clustersCulled; //by the last cullBackfaces
+    unsigned int m_clusterTrianglesCulled;
+    const bool* m_vertexUsed; //set by cullBackfaces, vertices only referenced by culled triangles are not transformed
+    unsigned int m_vertexUsedCount; //vertices added by clipping come after these and are always used
 public:
     Drawable(Vertex vertexBuffer):  
-                m_vertexBuffer(vertexBuffer)
+                m_vertexBuffer(std::move(vertexBuffer)),
+                m_facePlanes(nullptr),
+                m_meshlets(nullptr),
+                m_meshletCount(0),
+                m_firstTriangle(0),
+                m_clustersCulled(0),
+                m_clusterTrianglesCulled(0),
+                m_vertexUsed(nullptr),
+                m_vertexUsedCount(0)
     {};
 
+    //object space triangle planes of the vertex buffer, must outlive the draw
+    void setFacePlanes(const FacePlanes* facePlanes) {
+        m_facePlanes = facePlanes;
+    }
+
+    //clusters of the vertex buffer (indices ordered by cluster), must outlive the draw
+    void setMeshlets(const Meshlet* meshlets, unsigned int count) {
+        m_meshlets = meshlets;
+        m_meshletCount = count;
+    }
+
+    //the vertex buffer holds triangles [first, first + size) of the mesh the face planes and clusters were made for
+    void setFirstTriangle(unsigned int first) {
+        m_firstTriangle = first;
+    }
+
+    //storage of the vertex buffer for the next drawable, the drawable is done after this
+    Vertex releaseVertexBuffer() {
+        return std::move(m_vertexBuffer);
+    }
+
+    unsigned int getClustersCulled() const {
+        return m_clustersCulled;
+    }
+
+    //triangles rejected with their cluster, without a test of their own
+    unsigned int getClusterTrianglesCulled() const {
+        return m_clusterTrianglesCulled;
+    }
+
     void scale(Vec3 scale) {
         m_transformation = Mat4::scale(scale) * m_transformation;
     }
@@ -42,148 +146,365 @@ public:
         screen.drawPolygon(m_vertexBuffer);
     }
 
+    //writes normals and surface type into gBuffer instead of shading, lit later by the lighting pass
+    //the normals come from computeFlatNormals or computeGouraudNormals, unlit needs none
+    void drawDeferred(Screen &screen, GBuffer& gBuffer, ShadingMode shading)
+    {
+        applyVertexShader();
+        if (shading == ShadingMode::Gouraud)
+            screen.drawPolygon(m_vertexBuffer, VertexNormalShader(), GBufferShader{&gBuffer, GBuffer::Lit});
+        else if (shading == ShadingMode::Flat)
+            screen.drawPolygon(m_vertexBuffer, FaceNormalShader(), GBufferShader{&gBuffer, GBuffer::Lit});
+        else
+            screen.drawPolygon(m_vertexBuffer, PositionShader(), GBufferShader{&gBuffer, GBuffer::Unlit});
+    }
 
-    //set cull flags
-    void cullBackfaces() {
+    //hands the triangles to list instead of drawing them, the vertex buffer is moved out
+    //the drawable is done after this
+    void record(DrawList& list, float opacity)
+    {
         applyVertexShader();
-        for(const Index& i : m_vertexBuffer.indices) {
-            //get vector from origin to first point on 
-            Vec4 vertexPosX = m_vertexBuffer.positions.at(i.x);
-            Vec4 origin = {0.0f, 0.0f, 0.0f, 0.0f};
-            Vec4 triDir = vertexPosX - origin;
-            
-
-            //clip Vec4 to Vec3
-            Vec3 triDirc {triDir.x, triDir.y, triDir.z};
-
-            Vec3 normal = getNormal(i);
-            
-            if(triDirc * normal > 0.0f) {
-                m_vertexBuffer.cullFlags.push_back(true);
-            }else{
-                m_vertexBuffer.cullFlags.push_back(false);
+        Vertex& buffer = list.add(opacity);
+        std::swap(buffer.positions, m_vertexBuffer.positions);
+        std::swap(buffer.indices, m_vertexBuffer.indices);
+        std::swap(buffer.cullFlags, m_vertexBuffer.cullFlags);
+        std::swap(buffer.shadingLevel, m_vertexBuffer.shadingLevel);
+        std::swap(buffer.vertexLight, m_vertexBuffer.vertexLight);
+    }
+
+    //writes triangle ids into visibility and keeps the triangles there, shaded later by its lighting pass
+    //normals as for drawDeferred
+    void drawVisibility(Screen &screen, VisibilityBuffer& visibility, ShadingMode shading)
+    {
+        applyVertexShader();
+        screen.drawPass(m_vertexBuffer, [&](const Vertex& buffer, RenderTarget& target) {
+            visibility.draw(buffer, shading, target);
+        });
+    }
+
+    //set cull flags, then transform the vertices of the remaining triangles into view space
+    //the test runs in object space: the camera (view space origin) is moved into object space once
+    //and compared against the precomputed face planes, culled triangles are never transformed
+    //clusters facing away or outside frustum (view space) are rejected before their triangles are tested
+    void cullBackfaces(FrameArena& arena, const Frustum& frustum) {
+        unsigned int triangleCount = m_vertexBuffer.indices.size();
+        unsigned int vertexCount = m_vertexBuffer.positions.size();
+        FacePlanes computed;
+        const FacePlanes* planes = m_facePlanes;
+        unsigned int firstPlane = m_firstTriangle;
+        if (planes == nullptr || planes->count < m_firstTriangle + triangleCount) {
+            computed = computeFacePlanes(m_vertexBuffer.positions, m_vertexBuffer.indices);
+            planes = &computed;
+            firstPlane = 0;
+        }
+
+        Vec4 eye4 = m_transformation.inverseAffine() * Vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        m_normalMatrix = m_transformation.normalMatrix();
+        Vec3 eye = {eye4.x, eye4.y, eye4.z};
+        bool mirrored = m_transformation.determinant3() < 0.0f;
+        bool* culled = arena.allocate<bool>(triangleCount);
+        m_clustersCulled = 0;
+        m_clusterTrianglesCulled = 0;
+        const Meshlet* last = m_meshlets + (m_meshletCount > 0 ? m_meshletCount - 1 : 0);
+        if (m_meshletCount > 0 && m_meshlets->firstTriangle == m_firstTriangle &&
+            last->firstTriangle + last->triangleCount == m_firstTriangle + triangleCount) {
+            for (unsigned int c = 0; c < m_meshletCount; ++c) {
+                const Meshlet& meshlet = m_meshlets[c];
+                unsigned int first = meshlet.firstTriangle - m_firstTriangle;
+                if (meshlet.isBackfacing(eye, mirrored) ||
+                    !frustum.intersects(transformBoundingSphere(meshlet.bounds, m_transformation))) {
+                    std::fill(culled + first, culled + first + meshlet.triangleCount, true);
+                    ++m_clustersCulled;
+                    m_clusterTrianglesCulled += meshlet.triangleCount;
+                    continue;
+                }
+                planes->cull(eye, mirrored, firstPlane + first, meshlet.triangleCount, culled + first);
             }
+        } else {
+            planes->cull(eye, mirrored, firstPlane, triangleCount, culled);
+        }
+        m_vertexBuffer.cullFlags.assign(culled, culled + triangleCount);
 
+        bool* used = arena.allocate<bool>(vertexCount);
+        std::fill(used, used + vertexCount, false);
+        for (unsigned int k = 0; k < triangleCount; ++k) {
+            if (culled[k])
+                continue;
+            const Index& i = m_vertexBuffer.indices[k];
+            used[i.x] = true;
+            used[i.y] = true;
+            used[i.z] = true;
         }
+        m_vertexUsed = used;
+        m_vertexUsedCount = vertexCount;
+
+        applyVertexShader();
     }
 
-    void computeFlatShading(const Vec3& light) {
-        m_vertexBuffer.shadingLevel.clear();
-        Vec3 lightNormal = light * (1.0f / light.magnitude());
-        for(const Index& i: m_vertexBuffer.indices) {
-            //set flat shading level based on normal
-            Vec3 normal = getNormal(i);
-            float c = lightNormal * normal;
-            if (c >= 0)
-                m_vertexBuffer.shadingLevel.push_back(c);
-            else
-                m_vertexBuffer.shadingLevel.push_back(0.0f);
+    //culled triangles get no light
+    //one light level per front face, lit at its center with its face normal
+    void computeFlatShading(const LightSet& lights, FrameArena& arena) {
+        unsigned int triangleCount = m_vertexBuffer.indices.size();
+        m_vertexBuffer.shadingLevel.assign(triangleCount, 0.0f);
+        m_vertexBuffer.vertexLight.clear();
+        bool hasCullFlags = m_vertexBuffer.cullFlags.size() >= triangleCount;
+
+        unsigned int* faces = arena.allocate<unsigned int>(triangleCount);
+        unsigned int count = 0;
+        for (unsigned int k = 0; k < triangleCount; ++k) {
+            if (!hasCullFlags || !m_vertexBuffer.cullFlags[k])
+                faces[count++] = k;
+        }
+
+        LightingInput input = allocateLightingInput(arena, count);
+        for (unsigned int k = 0; k < count; ++k) {
+            const Index& i = m_vertexBuffer.indices[faces[k]];
+            const Vec4& v0 = m_vertexBuffer.positions[i.x];
+            const Vec4& v1 = m_vertexBuffer.positions[i.y];
+            const Vec4& v2 = m_vertexBuffer.positions[i.z];
+            Vec3 a = {v1.x - v0.x, v1.y - v0.y, v1.z - v0.z};
+            Vec3 b = {v2.x - v0.x, v2.y - v0.y, v2.z - v0.z};
+            Vec3 normal = a.crossProduct(b); //normalized by the lighting
+            input.px[k] = (v0.x + v1.x + v2.x) * (1.0f / 3.0f);
+            input.py[k] = (v0.y + v1.y + v2.y) * (1.0f / 3.0f);
+            input.pz[k] = (v0.z + v1.z + v2.z) * (1.0f / 3.0f);
+            input.nx[k] = normal.x;
+            input.ny[k] = normal.y;
+            input.nz[k] = normal.z;
         }
+        lights.evaluate(input.px, input.py, input.pz, input.nx, input.ny, input.nz, count, input.level);
+        for (unsigned int k = 0; k < count; ++k)
+            m_vertexBuffer.shadingLevel[faces[k]] = input.level[k];
+    }
+
+    //light level of every vertex of a front face from its normal in view space, interpolated by the rasterizer
+    //vertex normals are precomputed, only the used ones are transformed
+    void computeGouraudShading(const LightSet& lights, FrameArena& arena) {
+        const std::vector<Vec3>& normals = m_vertexBuffer.normals;
+        unsigned int vertexCount = m_vertexBuffer.positions.size();
+        assert(normals.size() == vertexCount);
+        m_vertexBuffer.vertexLight.assign(vertexCount, 0.0f);
+
+        unsigned int* vertices = arena.allocate<unsigned int>(vertexCount);
+        unsigned int count = 0;
+        for (unsigned int i = 0; i < vertexCount; ++i) {
+            if (isVertexUsed(i))
+                vertices[count++] = i;
+        }
+
+        LightingInput input = allocateLightingInput(arena, count);
+        for (unsigned int k = 0; k < count; ++k) {
+            const Vec4& position = m_vertexBuffer.positions[vertices[k]];
+            Vec3 normal = m_normalMatrix * normals[vertices[k]]; //normalized by the lighting
+            input.px[k] = position.x;
+            input.py[k] = position.y;
+            input.pz[k] = position.z;
+            input.nx[k] = normal.x;
+            input.ny[k] = normal.y;
+            input.nz[k] = normal.z;
+        }
+        lights.evaluate(input.px, input.py, input.pz, input.nx, input.ny, input.nz, count, input.level);
+        for (unsigned int k = 0; k < count; ++k)
+            m_vertexBuffer.vertexLight[vertices[k]] = input.level[k];
+
+        //per triangle level is not used
+        m_vertexBuffer.shadingLevel.assign(m_vertexBuffer.indices.size(), 1.0f);
     }
 
-    //try only clipping to near plane
-    void clipTriangles()
+    //deferred flat shading: the view space normal of every front face for the G-buffer
+    void computeFlatNormals() {
+        unsigned int triangleCount = m_vertexBuffer.indices.size();
+        bool hasCullFlags = m_vertexBuffer.cullFlags.size() >= triangleCount;
+        m_vertexBuffer.faceNormals.assign(triangleCount, Vec3(0.0f, 0.0f, 0.0f));
+        for (unsigned int k = 0; k < triangleCount; ++k) {
+            if (hasCullFlags && m_vertexBuffer.cullFlags[k])
+                continue;
+            const Index& i = m_vertexBuffer.indices[k];
+            const Vec4& v0 = m_vertexBuffer.positions[i.x];
+            const Vec4& v1 = m_vertexBuffer.positions[i.y];
+            const Vec4& v2 = m_vertexBuffer.positions[i.z];
+            Vec3 a = {v1.x - v0.x, v1.y - v0.y, v1.z - v0.z};
+            Vec3 b = {v2.x - v0.x, v2.y - v0.y, v2.z - v0.z};
+            m_vertexBuffer.faceNormals[k] = a.crossProduct(b); //normalized by the lighting pass
+        }
+        computeUnlitShading();
+    }
+
+    //deferred Gouraud shading: precomputed vertex normals of the used vertices in view space for the G-buffer
+    void computeGouraudNormals() {
+        const std::vector<Vec3>& normals = m_vertexBuffer.normals;
+        unsigned int vertexCount = m_vertexBuffer.positions.size();
+        assert(normals.size() == vertexCount);
+        m_vertexBuffer.viewNormals.assign(vertexCount, Vec3(0.0f, 0.0f, 0.0f));
+        for (unsigned int i = 0; i < vertexCount; ++i) {
+            if (isVertexUsed(i))
+                m_vertexBuffer.viewNormals[i] = m_normalMatrix * normals[i];
+        }
+        computeUnlitShading();
+    }
+
+    //every triangle at full brightness
+    void computeUnlitShading() {
+        m_vertexBuffer.shadingLevel.assign(m_vertexBuffer.indices.size(), 1.0f);
+        m_vertexBuffer.vertexLight.clear();
+    }
+
+    //clip triangles against the view frustum in homogeneous clip space
+    //triangles fully outside a frustum plane are rejected, triangles inside the guard band are kept as is
+    //and the rest are clipped against the near/far planes and the guard band (screen scissor handles the remainder)
+    //temporaries come from the frame arena
+    void clipTriangles(FrameArena& arena)
     {
         applyVertexShader();
-        //copy vertex positions and indices into new data structures
-        std::vector<Index> newIndices = m_vertexBuffer.indices;
-        std::vector<bool> newCullFlags = m_vertexBuffer.cullFlags;
-        std::vector<float> newShadingLevel = m_vertexBuffer.shadingLevel;
-
-        //clear vertex indices and cull flags
+        //copy indices, cull flags and shading levels into scratch memory
+        unsigned int triangleCount = m_vertexBuffer.indices.size();
+        assert(m_vertexBuffer.cullFlags.size() >= triangleCount && m_vertexBuffer.shadingLevel.size() >= triangleCount);
+        Index* newIndices = arena.copy(m_vertexBuffer.indices.data(), triangleCount);
+        float* newShadingLevel = arena.copy(m_vertexBuffer.shadingLevel.data(), triangleCount);
+        bool hasFaceNormals = m_vertexBuffer.faceNormals.size() >= triangleCount;
+        Vec3* newFaceNormals = hasFaceNormals ? arena.copy(m_vertexBuffer.faceNormals.data(), triangleCount) : nullptr;
+        bool* newCullFlags = arena.allocate<bool>(triangleCount);
+        std::copy(m_vertexBuffer.cullFlags.begin(), m_vertexBuffer.cullFlags.begin() + triangleCount, newCullFlags);
+
+        //clear vertex indices and cull flags (capacity is kept for the output)
         m_vertexBuffer.indices.clear();
         m_vertexBuffer.cullFlags.clear();
         m_vertexBuffer.shadingLevel.clear();
-
-        std::vector<unsigned int> polygon;
-
-        //near plane
-        //Plane plane = {{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
-        Plane plane = {{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
-
-        //for each index i
-        for (unsigned int i = 0; i < newIndices.size(); ++i)
+        m_vertexBuffer.faceNormals.clear();
+
+        //outcodes of the unclipped vertices
+        unsigned int vertexCount = m_vertexBuffer.positions.size();
+        unsigned int* outcodes = arena.allocate<unsigned int>(vertexCount);
+        for (unsigned int i = 0; i < vertexCount; ++i)
+            outcodes[i] = isVertexUsed(i) ? getOutcode(m_vertexBuffer.positions[i]) : 0;
+
+        //triangles that need clipping, each adds at most two vertices per plane
+        unsigned int* straddledPlanes = arena.allocate<unsigned int>(triangleCount);
+        unsigned int clippedCount = 0;
+        for (unsigned int i = 0; i < triangleCount; ++i)
         {
-            polygon.clear();
-
-            //skip if polygon is culled
-            if (newCullFlags.at(i))
+            const Index& index = newIndices[i];
+            unsigned int c0 = outcodes[index.x];
+            unsigned int c1 = outcodes[index.y];
+            unsigned int c2 = outcodes[index.z];
+            bool rejected = newCullFlags[i] || (c0 & c1 & c2 & FRUSTUM_MASK); //all three outside the same plane
+            straddledPlanes[i] = rejected ? REJECTED : (c0 | c1 | c2) & CLIP_MASK;
+            if (!rejected && straddledPlanes[i] != 0)
+                ++clippedCount;
+        }
+        //one reservation instead of growing while appending intersection vertices
+        m_vertexBuffer.positions.reserve(vertexCount + clippedCount * 2 * CLIP_PLANE_COUNT);
+        if (!m_vertexBuffer.vertexLight.empty())
+            m_vertexBuffer.vertexLight.reserve(vertexCount + clippedCount * 2 * CLIP_PLANE_COUNT);
+        if (!m_vertexBuffer.viewNormals.empty())
+            m_vertexBuffer.viewNormals.reserve(vertexCount + clippedCount * 2 * CLIP_PLANE_COUNT);
+
+        for (unsigned int i = 0; i < triangleCount; ++i)
+        {
+            unsigned int straddled = straddledPlanes[i];
+            if (straddled == REJECTED)
                 continue;
 
-            Index index = newIndices.at(i); //three Vec4 vertices
-
-            clipVertices(index.x, index.z, polygon, plane);
-            clipVertices(index.y, index.x, polygon, plane);
-            clipVertices(index.z, index.y, polygon, plane);
+            //inside near/far and the guard band, rasterizer scissor takes care of the rest
+            const Index& index = newIndices[i];
+            if (straddled == 0)
+            {
+                m_vertexBuffer.indices.push_back(index);
+                m_vertexBuffer.cullFlags.push_back(false);
+                m_vertexBuffer.shadingLevel.push_back(newShadingLevel[i]);
+                if (hasFaceNormals)
+                    m_vertexBuffer.faceNormals.push_back(newFaceNormals[i]);
+                continue;
+            }
 
-            //convert polygon to triangles and add to m_vertexBuffer.indices
-            if (polygon.size() == 3)
+            //Sutherland-Hodgman against every plane the triangle straddles
+            unsigned int polygon[MAX_CLIPPED_VERTICES] = {index.x, index.y, index.z};
+            unsigned int clipped[MAX_CLIPPED_VERTICES];
+            unsigned int size = 3;
+            for (unsigned int plane = 0; plane < CLIP_PLANE_COUNT && size >= 3; ++plane)
             {
-                m_vertexBuffer.indices.emplace_back(polygon.at(0), polygon.at(1), polygon.at(2));
-                m_vertexBuffer.cullFlags.push_back(newCullFlags.at(i));
-                m_vertexBuffer.shadingLevel.push_back(newShadingLevel.at(i));
+                if (!(straddled & (1u << plane)))
+                    continue;
+                size = clipPolygon(polygon, size, m_clipPlanes[plane], clipped);
+                std::copy(clipped, clipped + size, polygon);
             }
 
-            if (polygon.size() == 4)
+            //convert polygon to a triangle fan and add to m_vertexBuffer.indices
+            for (unsigned int k = 2; k < size; ++k)
             {
-                m_vertexBuffer.indices.emplace_back(polygon.at(0), polygon.at(1), polygon.at(2));
-                m_vertexBuffer.indices.emplace_back(polygon.at(0), polygon.at(2), polygon.at(3));
-                m_vertexBuffer.cullFlags.push_back(newCullFlags.at(i));
+                m_vertexBuffer.indices.emplace_back(polygon[0], polygon[k - 1], polygon[k]);
                 m_vertexBuffer.cullFlags.push_back(false);
-                m_vertexBuffer.shadingLevel.push_back(newShadingLevel.at(i));
-                m_vertexBuffer.shadingLevel.push_back(newShadingLevel.at(i));
+                m_vertexBuffer.shadingLevel.push_back(newShadingLevel[i]);
+                if (hasFaceNormals)
+                    m_vertexBuffer.faceNormals.push_back(newFaceNormals[i]);
             }
         }
     }
 
-    //clip vertices against near plane
-    void clipVertices(unsigned int currentVertexIndex, unsigned int previousVertexIndex, std::vector<unsigned int> &polygon, Plane plane)
+    //clip polygon against a single plane (vertex v is inside if plane * v >= 0)
+    //intersection vertices are appended to the vertex buffer, returns number of vertices in output
+    unsigned int clipPolygon(const unsigned int* polygon, unsigned int size, const Vec4& plane, unsigned int* output)
     {
+        unsigned int outputSize = 0;
+        unsigned int previousIndex = polygon[size - 1];
+        Vec4 previousVertex = m_vertexBuffer.positions.at(previousIndex);
+        float previousDistance = plane * previousVertex;
 
-        Vec4 currentVertex = m_vertexBuffer.positions.at(currentVertexIndex);
-        Vec4 previousVertex = m_vertexBuffer.positions.at(previousVertexIndex);
+        for (unsigned int i = 0; i < size; ++i)
+        {
+            unsigned int currentIndex = polygon[i];
+            Vec4 currentVertex = m_vertexBuffer.positions.at(currentIndex);
+            float currentDistance = plane * currentVertex;
 
-        Vec4 dir4 = currentVertex - previousVertex;
+            //edge crosses the plane
+            if ((currentDistance >= 0.0f) != (previousDistance >= 0.0f))
+            {
+                float t = previousDistance / (previousDistance - currentDistance);
+                output[outputSize++] = m_vertexBuffer.positions.size();
+                m_vertexBuffer.positions.push_back(previousVertex + (currentVertex - previousVertex) * t);
+                std::vector<float>& light = m_vertexBuffer.vertexLight;
+                if (!light.empty())
+                    light.push_back(light[previousIndex] + (light[currentIndex] - light[previousIndex]) * t);
+                std::vector<Vec3>& normals = m_vertexBuffer.viewNormals;
+                if (!normals.empty())
+                    normals.push_back(normals[previousIndex] + (normals[currentIndex] - normals[previousIndex]) * t);
+            }
 
-        Line line = {{currentVertex.x, currentVertex.y, currentVertex.z}, {dir4.x, dir4.y, dir4.z}};
-        Vec3 intersection;
-        bool hasIntersection = hasPlaneLineIntersection(plane.normal, line.direction);
+            if (currentDistance >= 0.0f)
+                output[outputSize++] = currentIndex;
 
-        if (hasIntersection)
-        {
-            intersection = getPlaneLineIntersection(plane, line);
+            previousIndex = currentIndex;
+            previousVertex = currentVertex;
+            previousDistance = currentDistance;
         }
 
-        unsigned int intersectionIndex = m_vertexBuffer.positions.size();
+        return outputSize;
+    }
 
-        //polygon clipping algorithm for near plane
-        if (currentVertex.z > plane.point.z)
-        {
-            if (previousVertex.z <= plane.point.z && hasIntersection)
-            {
-                polygon.push_back(intersectionIndex);
-                m_vertexBuffer.positions.emplace_back(intersection.x, intersection.y, intersection.z, 200.0f); //????
-            }
-            polygon.push_back(currentVertexIndex);
-        }
-        else if (previousVertex.z > plane.point.z && hasIntersection)
+    //bit i is set if position is outside of clip plane i
+    static unsigned int getOutcode(const Vec4& position)
+    {
+        unsigned int code = 0;
+        for (unsigned int plane = 0; plane < PLANE_COUNT; ++plane)
         {
-            polygon.push_back(intersectionIndex);
-            m_vertexBuffer.positions.emplace_back(intersection.x, intersection.y, intersection.z, 200.0f); //????
+            if (m_clipPlanes[plane] * position < 0.0f)
+                code |= 1u << plane;
         }
+        return code;
     }
 
     //transforms vertex positions into clip space
+    //vertices of culled triangles only are skipped
     //resets transformation matrix to identity matrix
     void applyVertexShader()
     {
 
         unsigned int size = m_vertexBuffer.positions.size();
 
-        //transform all vertices
         for (unsigned int i = 0; i < size; ++i)
         {
-            m_vertexBuffer.positions.at(i) = m_transformation * m_vertexBuffer.positions.at(i);
+            if (isVertexUsed(i))
+                m_vertexBuffer.positions[i] = m_transformation * m_vertexBuffer.positions[i];
         }
 
         //resets m_transform to identity matrix
@@ -194,6 +515,22 @@ public:
     void clearCullFlags()
     {
         m_vertexBuffer.cullFlags.clear();
+        m_vertexUsed = nullptr;
+        m_vertexUsedCount = 0;
+    }
+
+    bool isVertexUsed(unsigned int vertex) const
+    {
+        return vertex >= m_vertexUsedCount || m_vertexUsed[vertex];
+    }
+
+    static LightingInput allocateLightingInput(FrameArena& arena, unsigned int count)
+    {
+        unsigned int padded = (count + LightSet::LANES - 1) / LightSet::LANES * LightSet::LANES;
+        float* data = arena.allocate<float>(padded * 7);
+        std::fill(data, data + padded * 7, 0.0f);
+        return {data, data + padded, data + padded * 2, data + padded * 3, data + padded * 4, data + padded * 5,
+                data + padded * 6};
     }
 
     unsigned int getVertexPositionSize() const
@@ -2,38 +2,208 @@
 #define ENTITY_H
 
 #include <vector>
+#include <memory>
 #include "Drawable.hpp"
 #include "Math.hpp"
 #include "Vertex.hpp"
+#include "Simplifier.hpp"
+#include "Material.hpp"
+#include "FacePlanes.hpp"
+#include "Meshlet.hpp"
+#include "CookedMesh.hpp"
 
 namespace paint {
 
+//triangles [firstTriangle, firstTriangle + triangleCount) of a mesh, made of whole clusters when it has them
+//processed as a drawable of its own so a large mesh can be spread over several threads
+//a batch of a split mesh keeps only the vertices it references, so it does not carry the whole mesh along
+struct MeshBatch
+{
+    //most triangles per batch, larger meshes are split between clusters
+    static constexpr unsigned int MAX_TRIANGLES = 4096;
+
+    unsigned int firstTriangle;
+    unsigned int triangleCount;
+    unsigned int firstMeshlet;
+    unsigned int meshletCount;
+    std::vector<unsigned int> vertices; //mesh vertices of the batch in first use order, empty if it is the whole mesh
+    std::vector<Index> indices; //triangles of the batch, into vertices
+};
+
 class Entity {
 private:
-    Vertex m_vertexBuffer;
+    //target projected area per triangle in pixels, finer levels are only used while they stay above it
+    static constexpr float LOD_PIXELS_PER_TRIANGLE = 16.0f;
+    //fraction the triangle budget must be crossed by before the level changes (avoids popping on a boundary)
+    static constexpr float LOD_HYSTERESIS = 0.2f;
+
+    Vertex m_vertexBuffer; //only the bounds are set for a cooked mesh
+    std::shared_ptr<const CookedMesh> m_cooked; //full detail mesh with its clusters and face planes, kept mapped
     Vec3 m_scale;
     float m_angle;
     Vec3 m_rotationAxis;
     Vec3 m_translation;
+    std::vector<Vertex> m_lods; //simplified meshes, m_lods[i] is level i + 1
+    FacePlanes m_facePlanes; //backface culling planes of the full detail mesh
+    std::vector<FacePlanes> m_lodFacePlanes; //and of every level in m_lods
+    std::vector<Meshlet> m_meshlets; //triangle clusters of m_vertexBuffer, empty for small and cooked meshes
+    std::vector<std::vector<Meshlet>> m_lodMeshlets;
+    std::vector<MeshBatch> m_batches; //of the full detail mesh
+    std::vector<std::vector<MeshBatch>> m_lodBatches;
+    unsigned int m_lodLevel;
+    bool m_isOccluder;
+    Material m_material;
 public:
     Entity(Vertex vertex) :
-            m_vertexBuffer (vertex),
+            m_vertexBuffer (std::move(vertex)),
+            m_scale({1.0f, 1.0f, 1.0f}),
+            m_angle (0.0f),
+            m_rotationAxis ({0.0f, 1.0f, 1.0f}),
+            m_translation({0.0f, 0.0f, 0.0f}),
+            m_lodLevel(0),
+            m_isOccluder(false)
+            {
+                //cooked meshes come with their bounds
+                if (m_vertexBuffer.aabb.isEmpty())
+                    m_vertexBuffer.aabb = computeAABB(m_vertexBuffer.positions);
+                if (m_vertexBuffer.boundingSphere.isEmpty())
+                    m_vertexBuffer.boundingSphere = computeBoundingSphere(m_vertexBuffer.positions);
+                if (m_vertexBuffer.normals.size() != m_vertexBuffer.positions.size())
+                    m_vertexBuffer.normals = computeVertexNormals(m_vertexBuffer.positions, m_vertexBuffer.indices);
+                //clustering reorders the indices, planes follow the new order
+                m_meshlets = buildMeshlets(m_vertexBuffer);
+                m_facePlanes = computeFacePlanes(m_vertexBuffer.positions, m_vertexBuffer.indices);
+                m_batches = buildBatches(getLevel(0), m_meshlets.data(), m_meshlets.size());
+            };
+
+    //draws straight from the mapping of an open cooked mesh, only the batches are built here
+    Entity(std::shared_ptr<const CookedMesh> cooked) :
+            m_cooked(cooked),
             m_scale({1.0f, 1.0f, 1.0f}),
             m_angle (0.0f),
             m_rotationAxis ({0.0f, 1.0f, 1.0f}),
-            m_translation({0.0f, 0.0f, 0.0f})
-            {};
+            m_translation({0.0f, 0.0f, 0.0f}),
+            m_facePlanes(cooked->getFacePlanes()),
+            m_lodLevel(0),
+            m_isOccluder(false)
+            {
+                m_vertexBuffer.aabb = cooked->getAABB();
+                m_vertexBuffer.boundingSphere = cooked->getBoundingSphere();
+                m_batches = buildBatches(getLevel(0), cooked->getMeshlets(), cooked->getMeshletCount());
+            };
 
     
 
 
     //these are all the model transforms
-    Drawable getDrawable() {
-        Drawable d(m_vertexBuffer);
-        d.applyTransformation(Mat4::translate(m_translation) * Mat4::rotate(m_angle, m_rotationAxis) * Mat4::scale(m_scale));
+    //buffer is storage for the vertices, handed back by an earlier drawable to save allocating it again
+    Drawable getDrawable(Vertex buffer = Vertex()) const {
+        copyMesh(getLevel(m_lodLevel), buffer);
+        Drawable d(std::move(buffer));
+        d.setFacePlanes(m_lodLevel == 0 ? &m_facePlanes : &m_lodFacePlanes.at(m_lodLevel - 1));
+        d.setMeshlets(getMeshlets(), getMeshletCount());
+        d.applyTransformation(getModelMatrix());
+        return d;
+    }
+
+    //drawable of one batch of the current level, made of the vertices the batch references
+    Drawable getDrawable(const MeshBatch& batch, Vertex buffer = Vertex()) const {
+        if (batch.vertices.empty())
+            return getDrawable(std::move(buffer));
+        MeshData mesh = getLevel(m_lodLevel);
+        buffer.positions.resize(batch.vertices.size());
+        buffer.normals.resize(batch.vertices.size());
+        for (unsigned int i = 0; i < batch.vertices.size(); ++i) {
+            buffer.positions[i] = mesh.positions[batch.vertices[i]];
+            buffer.normals[i] = mesh.normals[batch.vertices[i]];
+        }
+        buffer.indices.assign(batch.indices.begin(), batch.indices.end());
+        clearDrawState(buffer);
+        Drawable d(std::move(buffer));
+        d.setFacePlanes(m_lodLevel == 0 ? &m_facePlanes : &m_lodFacePlanes.at(m_lodLevel - 1));
+        d.setMeshlets(getMeshlets() + batch.firstMeshlet, batch.meshletCount);
+        d.setFirstTriangle(batch.firstTriangle);
+        d.applyTransformation(getModelMatrix());
         return d;
     }
 
+    //batches of the current level, small meshes are a single batch
+    const std::vector<MeshBatch>& getBatches() const {
+        return m_lodLevel == 0 ? m_batches : m_lodBatches.at(m_lodLevel - 1);
+    }
+
+    Mat4 getModelMatrix() const {
+        return Mat4::translate(m_translation) * Mat4::rotate(m_angle, m_rotationAxis) * Mat4::scale(m_scale);
+    }
+
+    //full detail mesh in object space
+    MeshData getMesh() const {
+        return getLevel(0);
+    }
+
+    //occluders are rasterized into the occlusion buffer before other entities are tested against it
+    void setOccluder(bool isOccluder) {
+        m_isOccluder = isOccluder;
+    }
+
+    bool isOccluder() const {
+        return m_isOccluder;
+    }
+
+    void setMaterial(const Material& material) {
+        m_material = material;
+    }
+
+    const Material& getMaterial() const {
+        return m_material;
+    }
+
+    //object space bounds
+    const AABB& getAABB() const {
+        return m_vertexBuffer.aabb;
+    }
+
+    const BoundingSphere& getBoundingSphere() const {
+        return m_vertexBuffer.boundingSphere;
+    }
+
+    //builds simplified meshes at load time, each level has half the triangles of the previous one
+    void buildLods(unsigned int levels) {
+        std::vector<Vertex> lods = m_cooked ? Simplifier::buildLods(copyMesh(getLevel(0)), levels + 1)
+                                            : Simplifier::buildLods(m_vertexBuffer, levels + 1);
+        m_lods.assign(lods.begin() + 1, lods.end());
+        m_lodFacePlanes.clear();
+        m_lodMeshlets.clear();
+        m_lodBatches.clear();
+        for (Vertex& lod : m_lods) {
+            if (lod.normals.size() != lod.positions.size())
+                lod.normals = computeVertexNormals(lod.positions, lod.indices);
+            m_lodMeshlets.push_back(buildMeshlets(lod));
+            m_lodFacePlanes.push_back(computeFacePlanes(lod.positions, lod.indices));
+            m_lodBatches.push_back(buildBatches(getMeshData(lod), m_lodMeshlets.back().data(), m_lodMeshlets.back().size()));
+        }
+        m_lodLevel = 0;
+    }
+
+    //selects the coarsest level that still has enough triangles for the projected diameter in pixels
+    unsigned int selectLod(float screenSize) {
+        float budget = screenSize * screenSize / LOD_PIXELS_PER_TRIANGLE;
+        unsigned int maxLevel = m_lods.size();
+        while (m_lodLevel < maxLevel && getTriangleCount(m_lodLevel + 1) > budget * (1.0f + LOD_HYSTERESIS))
+            ++m_lodLevel;
+        while (m_lodLevel > 0 && getTriangleCount(m_lodLevel) < budget * (1.0f - LOD_HYSTERESIS))
+            --m_lodLevel;
+        return m_lodLevel;
+    }
+
+    unsigned int getLodLevel() const {
+        return m_lodLevel;
+    }
+
+    unsigned int getLodCount() const {
+        return m_lods.size() + 1;
+    }
+
     void setScale(Vec3 scale) {
         m_scale.x = scale.x;
         m_scale.y = scale.y;
@@ -79,8 +249,74 @@ public:
         return m_scale;
     }
 
+private:
+    MeshData getLevel(unsigned int level) const {
+        if (level > 0)
+            return getMeshData(m_lods.at(level - 1));
+        return m_cooked ? m_cooked->getMesh() : getMeshData(m_vertexBuffer);
+    }
 
+    //clusters of the current level
+    const Meshlet* getMeshlets() const {
+        if (m_lodLevel > 0)
+            return m_lodMeshlets.at(m_lodLevel - 1).data();
+        return m_cooked ? m_cooked->getMeshlets() : m_meshlets.data();
+    }
 
+    unsigned int getMeshletCount() const {
+        if (m_lodLevel > 0)
+            return m_lodMeshlets.at(m_lodLevel - 1).size();
+        return m_cooked ? m_cooked->getMeshletCount() : m_meshlets.size();
+    }
+
+    //splits mesh into batches of at most MeshBatch::MAX_TRIANGLES triangles (or one cluster if that is larger),
+    //cut between clusters, and gives every batch of a split mesh its own vertex list
+    static std::vector<MeshBatch> buildBatches(const MeshData& mesh, const Meshlet* meshlets, unsigned int meshletCount) {
+        std::vector<MeshBatch> batches;
+        unsigned int triangleCount = mesh.triangleCount;
+        const Meshlet* last = meshlets + (meshletCount > 0 ? meshletCount - 1 : 0);
+        if (meshletCount == 0 || last->firstTriangle + last->triangleCount != triangleCount) {
+            for (unsigned int first = 0; first < triangleCount || first == 0; first += MeshBatch::MAX_TRIANGLES)
+                batches.push_back({first, std::min(MeshBatch::MAX_TRIANGLES, triangleCount - first), 0, 0, {}, {}});
+        } else {
+            MeshBatch batch = {0, 0, 0, 0, {}, {}};
+            for (unsigned int k = 0; k < meshletCount; ++k) {
+                if (batch.meshletCount > 0 && batch.triangleCount + meshlets[k].triangleCount > MeshBatch::MAX_TRIANGLES) {
+                    batches.push_back(batch);
+                    batch = {meshlets[k].firstTriangle, 0, k, 0, {}, {}};
+                }
+                batch.triangleCount += meshlets[k].triangleCount;
+                ++batch.meshletCount;
+            }
+            batches.push_back(batch);
+        }
+        if (batches.size() == 1)
+            return batches;
+
+        //mesh vertex to batch vertex, reset after every batch
+        std::vector<unsigned int> remap(mesh.vertexCount, ~0u);
+        for (MeshBatch& batch : batches) {
+            for (unsigned int k = batch.firstTriangle; k < batch.firstTriangle + batch.triangleCount; ++k) {
+                const Index& i = mesh.indices[k];
+                unsigned int corners[3] = {i.x, i.y, i.z};
+                for (unsigned int& v : corners) {
+                    if (remap[v] == ~0u) {
+                        remap[v] = batch.vertices.size();
+                        batch.vertices.push_back(v);
+                    }
+                    v = remap[v];
+                }
+                batch.indices.emplace_back(corners[0], corners[1], corners[2]);
+            }
+            for (unsigned int v : batch.vertices)
+                remap[v] = ~0u;
+        }
+        return batches;
+    }
+
+    float getTriangleCount(unsigned int level) const {
+        return float(getLevel(level).triangleCount);
+    }
 };
 
 
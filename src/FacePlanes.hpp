@@ -0,0 +1,95 @@
+#ifndef FACEPLANES_H
+#define FACEPLANES_H
+
+#include <math.h>
+#include <vector>
+#include "Math.hpp"
+#include "Simd.hpp"
+
+namespace paint {
+
+//object space plane of every triangle, n * p + d = 0 with n the unit front face normal
+//stored as separate arrays so eight planes are tested with one load per component
+//arrays are padded with zero planes, which never cull, so a range starting anywhere is read eight at a time
+//all x come first, then all y, z and d, in values or in a mapped cooked mesh
+struct FacePlanes
+{
+    static constexpr unsigned int LANES = 8;
+
+    std::vector<float> values;
+    const float* mapped = nullptr; //used instead of values when set, owned by the mapping
+    unsigned int count = 0; //triangles, without padding
+
+    bool isEmpty() const {
+        return count == 0;
+    }
+
+    //length of each array
+    static unsigned int getPadded(unsigned int count) {
+        return count + LANES - 1;
+    }
+
+    const float* getData() const {
+        return mapped != nullptr ? mapped : values.data();
+    }
+
+    //flag set for every triangle in [first, first + size) facing away from eye (object space), eight at a time
+    //mirrored flips the test for transformations with a negative determinant
+    //culled[k] is the flag of triangle first + k
+    void cull(const Vec3& eye, bool mirrored, unsigned int first, unsigned int size, bool* culled) const {
+        Float8 ex = Float8::set(eye.x);
+        Float8 ey = Float8::set(eye.y);
+        Float8 ez = Float8::set(eye.z);
+        Float8 zero = Float8::set(0.0f);
+        const float* x = getData();
+        const float* y = x + getPadded(count);
+        const float* z = y + getPadded(count);
+        const float* d = z + getPadded(count);
+        unsigned int end = first + size;
+        for (unsigned int i = first; i < end; i += LANES) {
+            //signed distance of the eye to each plane
+            Float8 distance = Float8::load(&x[i]) * ex + Float8::load(&y[i]) * ey + Float8::load(&z[i]) * ez +
+                              Float8::load(&d[i]);
+            int bits = (mirrored ? zero < distance : distance < zero).getBits();
+            unsigned int n = std::min(LANES, end - i);
+            for (unsigned int k = 0; k < n; ++k)
+                culled[i - first + k] = (bits >> k) & 1;
+        }
+    }
+};
+
+//planes of the triangles in object space, computed once per mesh
+//degenerate triangles keep a zero plane and are never culled, like the NaN normal they had before
+inline FacePlanes computeFacePlanes(const std::vector<Vec4>& positions, const std::vector<Index>& indices) {
+    FacePlanes planes;
+    planes.count = indices.size();
+    unsigned int padded = FacePlanes::getPadded(planes.count);
+    planes.values.assign(padded * 4, 0.0f);
+    float* x = planes.values.data();
+    float* y = x + padded;
+    float* z = y + padded;
+    float* d = z + padded;
+
+    for (unsigned int k = 0; k < planes.count; ++k) {
+        const Index& i = indices.at(k);
+        const Vec4& v0 = positions.at(i.x);
+        const Vec4& v1 = positions.at(i.y);
+        const Vec4& v2 = positions.at(i.z);
+        Vec3 a = {v1.x - v0.x, v1.y - v0.y, v1.z - v0.z};
+        Vec3 b = {v2.x - v0.x, v2.y - v0.y, v2.z - v0.z};
+        Vec3 normal = a.crossProduct(b);
+        float length = normal.magnitude();
+        if (!(length > 0.0f))
+            continue;
+        normal = normal * (1.0f / length);
+        x[k] = normal.x;
+        y[k] = normal.y;
+        z[k] = normal.z;
+        d[k] = -(normal.x * v0.x + normal.y * v0.y + normal.z * v0.z);
+    }
+    return planes;
+}
+
+}
+
+#endif //FACEPLANES_H
@@ -0,0 +1,152 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+
+//freed arena memory is filled with POISON_BYTE, on by default in debug builds
+#ifndef PAINT_ARENA_POISON
+#ifdef NDEBUG
+#define PAINT_ARENA_POISON 0
+#else
+#define PAINT_ARENA_POISON 1
+#endif
+#endif
+
+namespace paint {
+
+//linear allocator for pipeline temporaries that live until the end of the frame
+//allocation bumps an offset, nothing is freed individually, reset() releases everything at once
+//when a frame needs more than one block, the blocks are merged on reset so the next frame fits in one
+class FrameArena {
+public:
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+    static constexpr unsigned char POISON_BYTE = 0xcd;
+
+    struct Stats
+    {
+        size_t allocations = 0; //since reset()
+        size_t bytesUsed = 0; //since reset(), including alignment padding
+        size_t peakBytesUsed = 0; //largest bytesUsed of any frame
+        size_t capacity = 0; //bytes owned by the arena
+        size_t blockAllocations = 0; //calls to the global allocator over the arena lifetime
+    };
+private:
+    struct Block {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> m_blocks;
+    size_t m_block; //block allocations currently come from
+    size_t m_offset; //into the current block
+    Stats m_stats;
+    bool m_poison;
+public:
+    FrameArena(size_t blockSize = DEFAULT_BLOCK_SIZE) : m_block(0), m_offset(0), m_poison(PAINT_ARENA_POISON) {
+        addBlock(blockSize);
+    };
+
+    FrameArena(const FrameArena& other) = delete;
+    FrameArena& operator=(const FrameArena& other) = delete;
+    FrameArena(FrameArena&& other) = default;
+    FrameArena& operator=(FrameArena&& other) = default;
+
+    //uninitialized memory for count objects of T, valid until reset()
+    //only for types that need no destructor, the arena never runs one
+    template<typename T>
+    T* allocate(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena memory is released without destructors");
+        return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void* allocate(size_t bytes, size_t alignment) {
+        assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+        size_t start = getAlignedOffset(alignment);
+        while (start + bytes > m_blocks.at(m_block).size) {
+            //padding left at the end of a block still counts as used
+            m_stats.bytesUsed += m_blocks.at(m_block).size - m_offset;
+            if (m_block + 1 == m_blocks.size())
+                addBlock(std::max(bytes + alignment, DEFAULT_BLOCK_SIZE));
+            ++m_block;
+            m_offset = 0;
+            start = getAlignedOffset(alignment);
+        }
+
+        void* p = m_blocks.at(m_block).data.get() + start;
+        m_stats.bytesUsed += start + bytes - m_offset;
+        m_stats.peakBytesUsed = std::max(m_stats.peakBytesUsed, m_stats.bytesUsed);
+        ++m_stats.allocations;
+        m_offset = start + bytes;
+        return p;
+    }
+
+    //copy of count objects of T
+    template<typename T>
+    T* copy(const T* source, size_t count) {
+        T* p = allocate<T>(count);
+        std::uninitialized_copy(source, source + count, p);
+        return p;
+    }
+
+    //releases every allocation, called once per frame
+    void reset() {
+        if (m_poison) {
+            for (size_t i = 0; i < m_block; ++i)
+                memset(m_blocks.at(i).data.get(), POISON_BYTE, m_blocks.at(i).size);
+            memset(m_blocks.at(m_block).data.get(), POISON_BYTE, m_offset);
+        }
+
+        if (m_blocks.size() > 1) {
+            size_t total = m_stats.capacity;
+            m_blocks.clear();
+            m_stats.capacity = 0;
+            addBlock(total);
+        }
+
+        m_block = 0;
+        m_offset = 0;
+        m_stats.allocations = 0;
+        m_stats.bytesUsed = 0;
+    }
+
+    //fill released memory with POISON_BYTE so stale pointers read garbage instead of last frame's data
+    void setPoison(bool poison) {
+        m_poison = poison;
+    }
+
+    bool isPoisoning() const {
+        return m_poison;
+    }
+
+    const Stats& getStats() const {
+        return m_stats;
+    }
+
+private:
+    //offset of the next address in the current block with the given alignment
+    size_t getAlignedOffset(size_t alignment) const {
+        uintptr_t base = reinterpret_cast<uintptr_t>(m_blocks.at(m_block).data.get());
+        uintptr_t address = (base + m_offset + alignment - 1) & ~uintptr_t(alignment - 1);
+        return address - base;
+    }
+
+    void addBlock(size_t size) {
+        Block block = {std::unique_ptr<unsigned char[]>(new unsigned char[size]), size};
+        if (m_poison)
+            memset(block.data.get(), POISON_BYTE, size);
+        m_blocks.push_back(std::move(block));
+        m_stats.capacity += size;
+        ++m_stats.blockAllocations;
+    }
+};
+
+}
+
+#endif //FRAMEARENA_H
@@ -0,0 +1,174 @@
+#ifndef FRAMEPIPELINE_H
+#define FRAMEPIPELINE_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Screen.hpp"
+#include "DrawList.hpp"
+#include "Stats.hpp"
+
+namespace paint {
+
+//frame loop over two threads: the caller records frame N + 1 (input, simulation, culling, lighting and clipping)
+//into a draw list while a raster thread draws frame N into one of the screen's framebuffers, finished frames are
+//handed to the screen on the caller's thread, which queues them for its present thread if it has one
+//latency is how many recorded frames may still wait for presentation when the next one starts, 0 runs the
+//stages one after another, every frame is presented latency frames after the one it was recorded in
+//draw lists are double buffered (latency + 1 of them), the caller blocks instead of running further ahead
+class FramePipeline {
+public:
+    static constexpr unsigned int MAX_LATENCY = 3;
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Frame
+    {
+        DrawList list;
+        FrameStats stats; //recording stats, raster stats are added by the raster thread
+    };
+
+    Screen& m_screen;
+    unsigned int m_latency;
+    uint32_t m_clearColor;
+    std::vector<Frame> m_frames; //frame n is recorded into n % size
+    FrameStats m_presentedStats; //of the last presented frame
+    Clock::time_point m_recordStart;
+    Clock::time_point m_lastPresent;
+    //counts of frames, frames are handed on in order
+    uint64_t m_recorded;
+    uint64_t m_rasterized;
+    uint64_t m_presented;
+    bool m_stop;
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::thread m_raster;
+public:
+    //screen is drawn to by the raster thread only until finish()
+    FramePipeline(Screen& screen, unsigned int latency, uint32_t clearColor) :
+        m_screen(screen), m_latency(std::min(latency, MAX_LATENCY)), m_clearColor(clearColor),
+        m_frames(m_latency + 1), m_recorded(0), m_rasterized(0), m_presented(0), m_stop(false) {
+        m_lastPresent = Clock::now();
+        m_raster = std::thread([this]() { rasterLoop(); });
+    };
+
+    FramePipeline(const FramePipeline& other) = delete;
+    FramePipeline& operator=(const FramePipeline& other) = delete;
+
+    ~FramePipeline() {
+        finish();
+    }
+
+    unsigned int getLatency() const {
+        return m_latency;
+    }
+
+    //empty list for the next frame, the frame that used it before has been presented
+    DrawList& beginFrame() {
+        m_recordStart = Clock::now();
+        Frame& frame = m_frames[m_recorded % m_frames.size()];
+        frame.list.clear();
+        return frame.list;
+    }
+
+    //hands the frame recorded since beginFrame() to the raster thread, then presents the frames older than latency
+    void submit(const FrameStats& stats) {
+        Frame& frame = m_frames[m_recorded % m_frames.size()];
+        frame.stats = stats;
+        frame.stats.recordMilliseconds = getMilliseconds(m_recordStart);
+        frame.stats.latency = m_latency;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_recorded;
+        }
+        m_changed.notify_all();
+        presentUntil(m_latency);
+    }
+
+    //stats of the last presented frame, recording and raster together
+    const FrameStats& getPresentedStats() const {
+        return m_presentedStats;
+    }
+
+    //presents every recorded frame and stops the raster thread, the screen is the caller's again
+    void finish() {
+        if (!m_raster.joinable())
+            return;
+        presentUntil(0);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_changed.notify_all();
+        m_raster.join();
+    }
+
+private:
+    static float getMilliseconds(Clock::time_point start) {
+        return std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+    }
+
+    //presents in order until at most pending recorded frames are left
+    void presentUntil(unsigned int pending) {
+        while (true) {
+            uint64_t frame;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (m_presented + pending >= m_recorded)
+                    return;
+                frame = m_presented;
+                m_changed.wait(lock, [&]() { return m_rasterized > frame; });
+            }
+            m_screen.present(unsigned(frame));
+            m_presentedStats = m_frames[frame % m_frames.size()].stats;
+            m_presentedStats.frameMilliseconds = getMilliseconds(m_lastPresent);
+            m_presentedStats.pacing = m_screen.getPresentPacing();
+            m_lastPresent = Clock::now();
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                ++m_presented;
+            }
+            m_changed.notify_all();
+        }
+    }
+
+    //frame n goes to framebuffer n % 3 once frame n - 3 has been handed to the screen, selectFramebuffer() waits
+    //for a present thread to be done with it
+    void rasterLoop() {
+        const uint64_t reuse = Screen::FRAMEBUFFER_COUNT - 1;
+        for (uint64_t frame = 0;; ++frame) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_changed.wait(lock, [&]() { return (m_recorded > frame && m_presented + reuse >= frame) || m_stop; });
+                if (m_recorded <= frame)
+                    return;
+            }
+            Frame& current = m_frames[frame % m_frames.size()];
+            m_screen.selectFramebuffer(unsigned(frame));
+            Clock::time_point start = Clock::now(); //not counting the wait for a framebuffer still being presented
+            m_screen.setColor(m_clearColor);
+            m_screen.clear();
+            current.list.execute(m_screen);
+            m_screen.resolve();
+            current.stats.pixelsWritten = m_screen.getPixelsWritten();
+            if (m_screen.getHiddenSurface() == HiddenSurface::SpanBuffer) {
+                current.stats.spans = m_screen.getSpanCount();
+                current.stats.spanBytes = m_screen.getHiddenSurfaceBytes();
+            }
+            current.stats.rasterMilliseconds = getMilliseconds(start);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                ++m_rasterized;
+            }
+            m_changed.notify_all();
+        }
+    }
+};
+
+}
+
+#endif //FRAMEPIPELINE_H
@@ -0,0 +1,289 @@
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <algorithm>
+#include <vector>
+#include <limits>
+#include "Math.hpp"
+#include "Vertex.hpp"
+#include "Pipeline.hpp"
+#include "Light.hpp"
+#include "JobSystem.hpp"
+
+namespace paint {
+
+enum class RenderPath : unsigned int {
+    Forward = 0, //lighting per face or vertex before rasterization
+    Deferred, //rasterization fills a G-buffer, then every visible pixel is lit once
+    Visibility //rasterization stores a triangle id per pixel, then every visible pixel is rebuilt and lit once
+};
+
+//surface attributes of the visible pixels for deferred shading
+//albedo and depth are the render target's color and depth planes, the normal and surface planes live here,
+//all of them indexed like the target (row * width + x)
+class GBuffer {
+public:
+    static constexpr int TILE_SIZE = 16; //pixels along each side of a lighting tile
+    static constexpr unsigned int TILE_BATCH = 8; //tiles per lighting job
+
+    struct LightingStats
+    {
+        unsigned int tiles = 0; //tiles with lit pixels
+        unsigned int tileLights = 0; //point lights evaluated, summed over those tiles
+    };
+
+    enum Surface : uint8_t {
+        Empty = 0, //nothing drawn, keeps the clear color
+        Lit,
+        Unlit //albedo as is
+    };
+private:
+    int m_width;
+    int m_height;
+    //view space, not normalized
+    std::vector<float> m_normalX;
+    std::vector<float> m_normalY;
+    std::vector<float> m_normalZ;
+    std::vector<uint8_t> m_surface;
+public:
+    GBuffer() : m_width(0), m_height(0) {};
+
+    //planes for a width * height target, contents are undefined until clear()
+    void resize(int width, int height) {
+        if (width == m_width && height == m_height)
+            return;
+        m_width = width;
+        m_height = height;
+        size_t size = size_t(width) * height;
+        m_normalX.resize(size);
+        m_normalY.resize(size);
+        m_normalZ.resize(size);
+        m_surface.resize(size);
+    }
+
+    //marks every pixel empty, normals are only read where a surface was written
+    void clear() {
+        std::fill(m_surface.begin(), m_surface.end(), uint8_t(Empty));
+    }
+
+    void write(unsigned int pixel, float nx, float ny, float nz, Surface surface) {
+        m_normalX[pixel] = nx;
+        m_normalY[pixel] = ny;
+        m_normalZ[pixel] = nz;
+        m_surface[pixel] = surface;
+    }
+
+    //memory of the planes held here, albedo and depth add 8 bytes per pixel in the target
+    size_t getBytes() const {
+        return (m_normalX.size() + m_normalY.size() + m_normalZ.size()) * sizeof(float) + m_surface.size();
+    }
+
+    int getWidth() const {
+        return m_width;
+    }
+
+    int getHeight() const {
+        return m_height;
+    }
+
+    //what covers pixel (x, y) and its view space normal, the albedo is already in the target
+    Surface fetch(int, int, unsigned int pixel, uint32_t&, Vec3& normal) const {
+        normal = {m_normalX[pixel], m_normalY[pixel], m_normalZ[pixel]};
+        return Surface(m_surface[pixel]);
+    }
+
+    //lighting pass: every lit pixel of target gets its albedo scaled by the light level at the view space point
+    //rebuilt from its depth, projection and the viewport scale and offset are the ones the geometry went through
+    //the screen is lit in TILE_SIZE tiles spread over the workers of jobs (the calling thread is one of them),
+    //each tile only evaluates the point lights reaching the depth range of its pixels unless cullLights is false
+    LightingStats resolve(const RenderTarget& target, const LightSet& lights, const Mat4& projection,
+                          const Vec3& viewportScale, const Vec3& viewportOffset, JobSystem& jobs,
+                          bool cullLights = true) const {
+        return resolveTiles(*this, target, lights, projection, viewportScale, viewportOffset, jobs, cullLights);
+    }
+
+    //the lighting pass over any per pixel surface source of the target's size with
+    //  int getWidth() const, int getHeight() const
+    //  Surface fetch(int x, int y, unsigned int pixel, uint32_t& color, Vec3& normal) const
+    //fetch is called once for every pixel from the job system's workers, it may write the pixel's albedo into color
+    template<typename Surfaces>
+    static LightingStats resolveTiles(const Surfaces& surfaces, const RenderTarget& target, const LightSet& lights,
+                                      const Mat4& projection, const Vec3& viewportScale, const Vec3& viewportOffset,
+                                      JobSystem& jobs, bool cullLights) {
+        TileGrid grid;
+        grid.width = surfaces.getWidth();
+        grid.height = surfaces.getHeight();
+        grid.columns = (grid.width + TILE_SIZE - 1) / TILE_SIZE;
+        grid.rows = (grid.height + TILE_SIZE - 1) / TILE_SIZE;
+        std::vector<TileScratch> scratch(jobs.getWorkerCount(), TileScratch(lights.getPointCount()));
+        std::vector<LightingStats> local(jobs.getWorkerCount());
+        jobs.parallelFor(grid.columns * grid.rows, TILE_BATCH, [&](unsigned int begin, unsigned int end, unsigned int worker) {
+            for (unsigned int tile = begin; tile < end; ++tile)
+                resolveTile(surfaces, target, lights, projection, viewportScale, viewportOffset, cullLights, grid,
+                            tile % grid.columns, tile / grid.columns, scratch[worker], local[worker]);
+        });
+        LightingStats stats;
+        for (const LightingStats& worker : local) {
+            stats.tiles += worker.tiles;
+            stats.tileLights += worker.tileLights;
+        }
+        return stats;
+    }
+
+private:
+    struct TileGrid
+    {
+        int width;
+        int height;
+        unsigned int columns;
+        unsigned int rows;
+    };
+
+    //per thread, reused from tile to tile
+    struct TileScratch
+    {
+        static constexpr unsigned int PIXELS = TILE_SIZE * TILE_SIZE;
+        std::vector<float> data; //positions, normals and light level of the lit pixels, one plane each
+        std::vector<unsigned int> pixels;
+        std::vector<unsigned int> points; //point lights of the tile
+        LightSet lights;
+
+        TileScratch(unsigned int pointCount) : data(PIXELS * 7, 0.0f), pixels(PIXELS), points(pointCount) {};
+    };
+
+    //lit pixels of a tile are packed into lanes, so empty and unlit pixels cost no lighting
+    template<typename Surfaces>
+    static void resolveTile(const Surfaces& surfaces, const RenderTarget& target, const LightSet& lights,
+                            const Mat4& projection, const Vec3& viewportScale, const Vec3& viewportOffset,
+                            bool cullLights, const TileGrid& grid, unsigned int column, unsigned int row,
+                            TileScratch& scratch, LightingStats& stats) {
+        const unsigned int planeSize = TileScratch::PIXELS;
+        float* px = scratch.data.data();
+        float* py = px + planeSize;
+        float* pz = py + planeSize;
+        float* nx = pz + planeSize;
+        float* ny = nx + planeSize;
+        float* nz = ny + planeSize;
+        float* level = nz + planeSize;
+        int x0 = column * TILE_SIZE;
+        int y0 = row * TILE_SIZE;
+        int x1 = std::min(x0 + TILE_SIZE, grid.width);
+        int y1 = std::min(y0 + TILE_SIZE, grid.height);
+
+        //screen z = thirdCol.z + fourthCol.z / w and view z = w, screen x, y are the viewport mapped ndc
+        float depthOffset = projection.thirdCol.z;
+        float depthScale = projection.fourthCol.z;
+        unsigned int count = 0;
+        float zMin = std::numeric_limits<float>::max();
+        float zMax = -std::numeric_limits<float>::max();
+        for (int y = y0; y < y1; ++y) {
+            float ndcY = (float(y) + 0.5f - viewportOffset.y) / viewportScale.y;
+            for (int x = x0; x < x1; ++x) {
+                unsigned int pixel = y * target.width + x;
+                Vec3 normal;
+                if (surfaces.fetch(x, y, pixel, target.color[pixel], normal) != Lit)
+                    continue;
+                float viewZ = depthScale / (target.depth[pixel] - depthOffset);
+                float ndcX = (float(x) + 0.5f - viewportOffset.x) / viewportScale.x;
+                px[count] = (ndcX - projection.thirdCol.x) * viewZ / projection.firstCol.x;
+                py[count] = (ndcY - projection.thirdCol.y) * viewZ / projection.secondCol.y;
+                pz[count] = viewZ;
+                nx[count] = normal.x;
+                ny[count] = normal.y;
+                nz[count] = normal.z;
+                scratch.pixels[count++] = pixel;
+                zMin = std::min(zMin, viewZ);
+                zMax = std::max(zMax, viewZ);
+            }
+        }
+        if (count == 0)
+            return;
+
+        const LightSet* tileLights = &lights;
+        unsigned int pointCount = lights.getPointCount();
+        if (cullLights) {
+            //slopes x / z and y / z of the tile edges
+            float left = ((float(x0) - viewportOffset.x) / viewportScale.x - projection.thirdCol.x) / projection.firstCol.x;
+            float right = ((float(x1) - viewportOffset.x) / viewportScale.x - projection.thirdCol.x) / projection.firstCol.x;
+            float top = ((float(y0) - viewportOffset.y) / viewportScale.y - projection.thirdCol.y) / projection.secondCol.y;
+            float bottom = ((float(y1) - viewportOffset.y) / viewportScale.y - projection.thirdCol.y) / projection.secondCol.y;
+            pointCount = lights.cullPoints(std::min(left, right), std::max(left, right), std::min(bottom, top),
+                                           std::max(bottom, top), zMin, zMax, scratch.points.data());
+            scratch.lights.assignSubset(lights, scratch.points.data(), pointCount);
+            tileLights = &scratch.lights;
+        }
+        ++stats.tiles;
+        stats.tileLights += pointCount;
+
+        //lanes past count keep stale values, their results are not used
+        tileLights->evaluate(px, py, pz, nx, ny, nz, count, level);
+        for (unsigned int k = 0; k < count; ++k) {
+            uint32_t gray = uint32_t(std::min(std::max(230.0f * level[k] + 25.0f, 0.0f), 255.0f));
+            uint32_t& color = target.color[scratch.pixels[k]];
+            color = modulate(color, gray);
+        }
+    }
+
+    //RGB of color scaled by gray / 255, alpha kept
+    static uint32_t modulate(uint32_t color, uint32_t gray) {
+        uint32_t r = (color >> 24) * gray / 255;
+        uint32_t g = (color >> 16 & 0xff) * gray / 255;
+        uint32_t b = (color >> 8 & 0xff) * gray / 255;
+        return r << 24 | g << 16 | b << 8 | (color & 0xff);
+    }
+};
+
+//G-buffer pass shaders, the pixel shader writes the normal and surface planes and returns the albedo
+
+//view space normal of the triangle, same for every corner
+struct FaceNormalShader
+{
+    typedef Varyings<3> Output;
+
+    Vec3 operator()(const Vertex& buffer, unsigned int triangle, unsigned int vertex, Output& out) const {
+        const Vec3& n = buffer.faceNormals[triangle];
+        out.v[0] = n.x;
+        out.v[1] = n.y;
+        out.v[2] = n.z;
+        const Vec4& p = buffer.positions[vertex];
+        return {p.x, p.y, p.z};
+    }
+};
+
+//view space normal per corner, interpolated
+struct VertexNormalShader
+{
+    typedef Varyings<3> Output;
+
+    Vec3 operator()(const Vertex& buffer, unsigned int, unsigned int vertex, Output& out) const {
+        const Vec3& n = buffer.viewNormals[vertex];
+        out.v[0] = n.x;
+        out.v[1] = n.y;
+        out.v[2] = n.z;
+        const Vec4& p = buffer.positions[vertex];
+        return {p.x, p.y, p.z};
+    }
+};
+
+//materials carry no color yet, every surface is white
+struct GBufferShader
+{
+    GBuffer* gBuffer;
+    GBuffer::Surface surface;
+
+    uint32_t operator()(const Varyings<3>& in, unsigned int pixel) const {
+        gBuffer->write(pixel, in.v[0], in.v[1], in.v[2], surface);
+        return 0xffffffff;
+    }
+
+    uint32_t operator()(const Varyings<0>&, unsigned int pixel) const {
+        gBuffer->write(pixel, 0.0f, 0.0f, 0.0f, surface);
+        return 0xffffffff;
+    }
+};
+
+}
+
+#endif //GBUFFER_H
@@ -0,0 +1,208 @@
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace paint {
+
+//work stealing scheduler for data parallel loops
+//parallelFor() cuts [0, count) into fixed size batches and deals them out to the workers in contiguous runs, every
+//worker takes batches from the back of its own deque and, once that is empty, steals from the front of the others
+//worker 0 is the calling thread, the others sleep between loops
+//which worker runs a batch is not deterministic, callers write results by index and merge them in order
+class JobSystem {
+public:
+    //per worker counters since resetStats()
+    struct WorkerStats
+    {
+        double busyMilliseconds = 0.0; //running batches or looking for them
+        unsigned int batches = 0;
+        unsigned int steals = 0; //batches taken from another worker's deque
+    };
+private:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<void(unsigned int, unsigned int, unsigned int)> Job;
+
+    struct Batch
+    {
+        unsigned int begin;
+        unsigned int end;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex; //guards batches
+        std::deque<Batch> batches;
+        WorkerStats stats; //only written by the worker itself
+    };
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads; //workers 1 and up
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    const Job* m_job; //of the running loop, nullptr when no more workers may join it
+    uint64_t m_generation; //loops started
+    unsigned int m_active; //workers 1 and up inside the running loop
+    bool m_stop;
+    double m_wallMilliseconds; //spent in parallelFor() since resetStats()
+public:
+    //workers threads including the caller, at least one
+    JobSystem(unsigned int workers) : m_job(nullptr), m_generation(0), m_active(0), m_stop(false), m_wallMilliseconds(0.0) {
+        workers = std::max(workers, 1u);
+        for (unsigned int k = 0; k < workers; ++k)
+            m_workers.push_back(std::make_unique<Worker>());
+        for (unsigned int k = 1; k < workers; ++k)
+            m_threads.emplace_back([this, k]() { threadLoop(k); });
+    };
+
+    JobSystem(const JobSystem& other) = delete;
+    JobSystem& operator=(const JobSystem& other) = delete;
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (std::thread& thread : m_threads)
+            thread.join();
+    }
+
+    unsigned int getWorkerCount() const {
+        return m_workers.size();
+    }
+
+    //job(begin, end, worker) for every batch of at most batchSize indices of [0, count), returns when all are done
+    //worker is below getWorkerCount() and never runs two batches at once, so it can pick per worker scratch memory
+    template<typename Function>
+    void parallelFor(unsigned int count, unsigned int batchSize, Function&& function) {
+        if (count == 0)
+            return;
+        Clock::time_point start = Clock::now();
+        batchSize = std::max(batchSize, 1u);
+        unsigned int batchCount = (count + batchSize - 1) / batchSize;
+        unsigned int workerCount = m_workers.size();
+        for (unsigned int w = 0; w < workerCount; ++w) {
+            Worker& worker = *m_workers[w];
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            //pushed last to first: the owner pops its run in order from the back, thieves take the end of it
+            for (unsigned int b = uint64_t(w + 1) * batchCount / workerCount; b-- > uint64_t(w) * batchCount / workerCount;)
+                worker.batches.push_back({b * batchSize, std::min((b + 1) * batchSize, count)});
+        }
+
+        Job job = std::forward<Function>(function);
+        if (workerCount > 1) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_job = &job;
+                ++m_generation;
+            }
+            m_wake.notify_all();
+        }
+        run(0, job);
+        if (workerCount > 1) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_job = nullptr;
+            m_done.wait(lock, [this]() { return m_active == 0; });
+        }
+        m_wallMilliseconds += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    const WorkerStats& getStats(unsigned int worker) const {
+        return m_workers.at(worker)->stats;
+    }
+
+    //busy time of worker over the time spent in parallelFor(), 0 - 1
+    float getUtilization(unsigned int worker) const {
+        return m_wallMilliseconds > 0.0 ? float(std::min(getStats(worker).busyMilliseconds / m_wallMilliseconds, 1.0)) : 0.0f;
+    }
+
+    //not while a loop runs
+    void resetStats() {
+        for (std::unique_ptr<Worker>& worker : m_workers)
+            worker->stats = WorkerStats();
+        m_wallMilliseconds = 0.0;
+    }
+
+private:
+    void threadLoop(unsigned int index) {
+        uint64_t seen = 0;
+        while (true) {
+            const Job* job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [&]() { return m_stop || (m_job != nullptr && m_generation != seen); });
+                if (m_stop)
+                    return;
+                seen = m_generation;
+                job = m_job;
+                ++m_active;
+            }
+            run(index, *job);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                --m_active;
+            }
+            m_done.notify_all();
+        }
+    }
+
+    //batches of worker index, then stolen ones, until every deque is empty
+    void run(unsigned int index, const Job& job) {
+        Clock::time_point start = Clock::now();
+        Worker& self = *m_workers[index];
+        Batch batch;
+        while (true) {
+            bool stolen = false;
+            if (!pop(index, batch)) {
+                if (!steal(index, batch))
+                    break;
+                stolen = true;
+            }
+            job(batch.begin, batch.end, index);
+            ++self.stats.batches;
+            if (stolen)
+                ++self.stats.steals;
+        }
+        self.stats.busyMilliseconds += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    bool pop(unsigned int index, Batch& batch) {
+        Worker& worker = *m_workers[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.batches.empty())
+            return false;
+        batch = worker.batches.back();
+        worker.batches.pop_back();
+        return true;
+    }
+
+    //oldest batch of the next worker with any, those are farthest from what the victim works on
+    bool steal(unsigned int index, Batch& batch) {
+        unsigned int workerCount = m_workers.size();
+        for (unsigned int k = 1; k < workerCount; ++k) {
+            Worker& victim = *m_workers[(index + k) % workerCount];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.batches.empty())
+                continue;
+            batch = victim.batches.front();
+            victim.batches.pop_front();
+            return true;
+        }
+        return false;
+    }
+};
+
+}
+
+#endif //JOBSYSTEM_H
@@ -0,0 +1,262 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "Math.hpp"
+#include "Bounds.hpp"
+#include "Simd.hpp"
+#include "ShadowMap.hpp"
+
+namespace paint {
+
+typedef unsigned int LightId;
+
+enum class LightType : unsigned int {
+    Directional = 0, //parallel rays from far away, lights everything
+    Point //radiates from position, fades out to nothing at range
+};
+
+struct Light
+{
+    LightType type = LightType::Directional;
+    Vec3 position; //point lights
+    Vec3 direction = {0.0f, 0.0f, 1.0f}; //directional lights, the way the light travels (need not be unit length)
+    float intensity = 1.0f;
+    float range = 1000.0f; //point lights, distance where attenuation reaches zero
+    bool castsShadows = false; //directional lights only, point lights would need a cube map
+    unsigned int shadowMapSize = 1024; //texels along each side
+    unsigned int shadowFilterRadius = 1; //percentage closer filtering over (2r + 1)^2 texels, 0 for hard edges
+
+    static Light directional(Vec3 direction, float intensity = 1.0f) {
+        Light light;
+        light.type = LightType::Directional;
+        light.direction = direction;
+        light.intensity = intensity;
+        return light;
+    }
+
+    static Light point(Vec3 position, float range, float intensity = 1.0f) {
+        Light light;
+        light.type = LightType::Point;
+        light.position = position;
+        light.range = range;
+        light.intensity = intensity;
+        return light;
+    }
+
+    //same light in another space (positions and directions transformed by an affine matrix)
+    Light transformed(const Mat4& m) const {
+        Light light = *this;
+        Vec4 p = m * Vec4(position.x, position.y, position.z, 1.0f);
+        Vec4 d = m * Vec4(direction.x, direction.y, direction.z, 0.0f);
+        light.position = {p.x, p.y, p.z};
+        light.direction = {d.x, d.y, d.z};
+        return light;
+    }
+
+    //false if no point of sphere (same space as the light) can receive light
+    bool affects(const BoundingSphere& sphere) const {
+        if (type == LightType::Directional)
+            return true;
+        Vec3 d = sphere.center - position;
+        float reach = range + sphere.radius;
+        return d * d < reach * reach;
+    }
+};
+
+//lights of one draw, stored as separate arrays per component
+//evaluate() lights eight surface points at a time, one light after another
+class LightSet {
+public:
+    static constexpr unsigned int LANES = 8;
+private:
+    //directional: unit vector towards the light
+    std::vector<float> m_directionalX;
+    std::vector<float> m_directionalY;
+    std::vector<float> m_directionalZ;
+    std::vector<float> m_directionalIntensity;
+    std::vector<const ShadowMap*> m_directionalShadow; //nullptr if unshadowed
+    std::vector<Mat4> m_directionalToShadowMap; //surface point space to map space
+    //point: position
+    std::vector<float> m_pointX;
+    std::vector<float> m_pointY;
+    std::vector<float> m_pointZ;
+    std::vector<float> m_pointIntensity;
+    std::vector<float> m_pointRange;
+    std::vector<float> m_pointInverseRangeSquared;
+public:
+    void clear() {
+        m_directionalX.clear();
+        m_directionalY.clear();
+        m_directionalZ.clear();
+        m_directionalIntensity.clear();
+        m_directionalShadow.clear();
+        m_directionalToShadowMap.clear();
+        m_pointX.clear();
+        m_pointY.clear();
+        m_pointZ.clear();
+        m_pointIntensity.clear();
+        m_pointRange.clear();
+        m_pointInverseRangeSquared.clear();
+    }
+
+    //light must be in the space of the surface points passed to evaluate()
+    //a directional light can be shadowed by a rendered map, toShadowMap takes surface points into map space
+    void add(const Light& light, const ShadowMap* shadow = nullptr, const Mat4& toShadowMap = Mat4()) {
+        if (light.type == LightType::Directional) {
+            Vec3 d = light.direction * (1.0f / light.direction.magnitude());
+            m_directionalX.push_back(-d.x);
+            m_directionalY.push_back(-d.y);
+            m_directionalZ.push_back(-d.z);
+            m_directionalIntensity.push_back(light.intensity);
+            m_directionalShadow.push_back(shadow);
+            m_directionalToShadowMap.push_back(toShadowMap);
+        } else {
+            m_pointX.push_back(light.position.x);
+            m_pointY.push_back(light.position.y);
+            m_pointZ.push_back(light.position.z);
+            m_pointIntensity.push_back(light.intensity);
+            m_pointRange.push_back(light.range);
+            m_pointInverseRangeSquared.push_back(1.0f / (light.range * light.range));
+        }
+    }
+
+    unsigned int size() const {
+        return m_directionalX.size() + m_pointX.size();
+    }
+
+    unsigned int getPointCount() const {
+        return m_pointX.size();
+    }
+
+    //every directional light of source and the point lights of source listed in points
+    void assignSubset(const LightSet& source, const unsigned int* points, unsigned int count) {
+        m_directionalX = source.m_directionalX;
+        m_directionalY = source.m_directionalY;
+        m_directionalZ = source.m_directionalZ;
+        m_directionalIntensity = source.m_directionalIntensity;
+        m_directionalShadow = source.m_directionalShadow;
+        m_directionalToShadowMap = source.m_directionalToShadowMap;
+        m_pointX.resize(count);
+        m_pointY.resize(count);
+        m_pointZ.resize(count);
+        m_pointIntensity.resize(count);
+        m_pointRange.resize(count);
+        m_pointInverseRangeSquared.resize(count);
+        for (unsigned int k = 0; k < count; ++k) {
+            unsigned int i = points[k];
+            m_pointX[k] = source.m_pointX[i];
+            m_pointY[k] = source.m_pointY[i];
+            m_pointZ[k] = source.m_pointZ[i];
+            m_pointIntensity[k] = source.m_pointIntensity[i];
+            m_pointRange[k] = source.m_pointRange[i];
+            m_pointInverseRangeSquared[k] = source.m_pointInverseRangeSquared[i];
+        }
+    }
+
+    //point lights whose range reaches into the view space wedge (camera at the origin looking down +z)
+    //left * z <= x <= right * z, bottom * z <= y <= top * z, zMin <= z <= zMax, a screen tile with its depth range
+    //indices are written to out (room for getPointCount()), returns how many, tested eight lights at a time
+    unsigned int cullPoints(float left, float right, float bottom, float top, float zMin, float zMax,
+                            unsigned int* out) const {
+        //distances to the four side planes, normals pointing inwards
+        float leftScale = 1.0f / sqrt(1.0f + left * left);
+        float rightScale = 1.0f / sqrt(1.0f + right * right);
+        float bottomScale = 1.0f / sqrt(1.0f + bottom * bottom);
+        float topScale = 1.0f / sqrt(1.0f + top * top);
+        unsigned int count = 0;
+        unsigned int size = m_pointX.size();
+        unsigned int k = 0;
+        const Float8 zero = Float8::set(0.0f);
+        for (; k + LANES <= size; k += LANES) {
+            Float8 x = Float8::load(&m_pointX[k]);
+            Float8 y = Float8::load(&m_pointY[k]);
+            Float8 z = Float8::load(&m_pointZ[k]);
+            Float8 r = Float8::load(&m_pointRange[k]);
+            Mask8 inside = (x - Float8::set(left) * z) * Float8::set(leftScale) + r >= zero;
+            inside = inside & ((Float8::set(right) * z - x) * Float8::set(rightScale) + r >= zero);
+            inside = inside & ((y - Float8::set(bottom) * z) * Float8::set(bottomScale) + r >= zero);
+            inside = inside & ((Float8::set(top) * z - y) * Float8::set(topScale) + r >= zero);
+            inside = inside & (z + r >= Float8::set(zMin));
+            inside = inside & (Float8::set(zMax) + r >= z);
+            int bits = inside.getBits();
+            for (unsigned int j = 0; bits != 0; ++j, bits >>= 1) {
+                if (bits & 1)
+                    out[count++] = k + j;
+            }
+        }
+        for (; k < size; ++k) {
+            float x = m_pointX[k];
+            float y = m_pointY[k];
+            float z = m_pointZ[k];
+            float r = m_pointRange[k];
+            if ((x - left * z) * leftScale + r >= 0.0f && (right * z - x) * rightScale + r >= 0.0f &&
+                (y - bottom * z) * bottomScale + r >= 0.0f && (top * z - y) * topScale + r >= 0.0f &&
+                z + r >= zMin && zMax + r >= z)
+                out[count++] = k;
+        }
+        return count;
+    }
+
+    //light level in [0, 1] of count surface points, summed over all lights
+    //positions p and normals n (any length, zero gets no light) as separate arrays
+    //every array, out included, holds count rounded up to a multiple of LANES
+    //point lights fall off with the cosine over distance and a window (1 - d^2 / range^2)^2 that ends at range
+    //shadowed directional lights are scaled by the map visibility, only looked up for points facing the light
+    void evaluate(const float* px, const float* py, const float* pz, const float* nx, const float* ny, const float* nz,
+                  unsigned int count, float* out) const {
+        const Float8 zero = Float8::set(0.0f);
+        const Float8 one = Float8::set(1.0f);
+        const Float8 tiny = Float8::set(1e-20f);
+        for (unsigned int i = 0; i < count; i += LANES) {
+            Float8 x = Float8::load(px + i);
+            Float8 y = Float8::load(py + i);
+            Float8 z = Float8::load(pz + i);
+            Float8 normalX = Float8::load(nx + i);
+            Float8 normalY = Float8::load(ny + i);
+            Float8 normalZ = Float8::load(nz + i);
+            Float8 inverseLength = one / Float8::sqrt(Float8::max(normalX * normalX + normalY * normalY + normalZ * normalZ, tiny));
+            normalX = normalX * inverseLength;
+            normalY = normalY * inverseLength;
+            normalZ = normalZ * inverseLength;
+
+            Float8 level = zero;
+            for (unsigned int k = 0; k < m_directionalX.size(); ++k) {
+                Float8 cosine = normalX * Float8::set(m_directionalX[k]) + normalY * Float8::set(m_directionalY[k]) +
+                                normalZ * Float8::set(m_directionalZ[k]);
+                Float8 contribution = Float8::max(cosine, zero) * Float8::set(m_directionalIntensity[k]);
+                const ShadowMap* shadow = m_directionalShadow[k];
+                if (shadow != nullptr && (zero < cosine).any()) {
+                    const Mat4& m = m_directionalToShadowMap[k];
+                    Float8 offset = Float8::set(shadow->getNormalOffset());
+                    float sx[LANES], sy[LANES], sz[LANES], visibility[LANES];
+                    (x + normalX * offset).store(sx);
+                    (y + normalY * offset).store(sy);
+                    (z + normalZ * offset).store(sz);
+                    for (unsigned int j = 0; j < LANES; ++j) {
+                        Vec4 p = m * Vec4(sx[j], sy[j], sz[j], 1.0f);
+                        visibility[j] = shadow->getVisibility({p.x, p.y, p.z});
+                    }
+                    contribution = contribution * Float8::load(visibility);
+                }
+                level = level + contribution;
+            }
+            for (unsigned int k = 0; k < m_pointX.size(); ++k) {
+                Float8 lx = Float8::set(m_pointX[k]) - x;
+                Float8 ly = Float8::set(m_pointY[k]) - y;
+                Float8 lz = Float8::set(m_pointZ[k]) - z;
+                Float8 distanceSquared = Float8::max(lx * lx + ly * ly + lz * lz, tiny);
+                Float8 cosine = (normalX * lx + normalY * ly + normalZ * lz) / Float8::sqrt(distanceSquared);
+                Float8 window = Float8::max(one - distanceSquared * Float8::set(m_pointInverseRangeSquared[k]), zero);
+                level = level + Float8::max(cosine, zero) * window * window * Float8::set(m_pointIntensity[k]);
+            }
+            Float8::min(level, one).store(out + i);
+        }
+    }
+};
+
+}
+
+#endif //LIGHT_H
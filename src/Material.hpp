@@ -0,0 +1,43 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+namespace paint {
+
+enum class ShadingMode : unsigned int {
+    Flat = 0, //one light level per triangle
+    Unlit, //full brightness, no lighting
+    Gouraud, //light level per vertex from the vertex normals, interpolated across the triangle
+    SHADING_MODE_COUNT
+};
+
+//render state of an entity, draws with equal state keys are batched by the render queue
+struct Material
+{
+    ShadingMode shading = ShadingMode::Flat;
+    float opacity = 1.0f; //below 1 the entity is blended over what is behind it and drawn after opaque entities
+
+    bool isTranslucent() const {
+        return opacity < 1.0f;
+    }
+
+    //identifies the state the rasterizer has to switch to for this material, for sorting
+    //alpha 255 is kept for opaque materials, translucent ones round to at most 254
+    unsigned int getStateKey() const {
+        unsigned int alpha = (unsigned int)(opacity * 255.0f + 0.5f);
+        alpha = isTranslucent() ? (alpha > 254 ? 254 : alpha) : 255;
+        return unsigned(shading) << 8 | alpha;
+    }
+
+    //exact, the state key rounds opacity
+    bool operator==(const Material& other) const {
+        return shading == other.shading && opacity == other.opacity;
+    }
+
+    bool operator!=(const Material& other) const {
+        return !(*this == other);
+    }
+};
+
+}
+
+#endif //MATERIAL_H
@@ -313,6 +313,53 @@ std::ostream& operator<<(std::ostream& os, const Mat2& mat) {
             return {*this * other.firstCol, *this * other.secondCol, *this * other.thirdCol, *this * other.fourthCol};
         }
 
+        //determinant of the upper 3x3 part, negative if the matrix mirrors (turns front faces into back faces)
+        float determinant3() const
+        {
+            const Vec4& a = firstCol;
+            const Vec4& b = secondCol;
+            const Vec4& c = thirdCol;
+            return a.x * (b.y * c.z - b.z * c.y) + a.y * (b.z * c.x - b.x * c.z) + a.z * (b.x * c.y - b.y * c.x);
+        }
+
+        //inverse of a matrix whose last row is (0, 0, 0, 1): inverse 3x3 part, translation moved back through it
+        //a singular 3x3 part (zero scale) gives the identity
+        Mat4 inverseAffine() const
+        {
+            const Vec4& a = firstCol;
+            const Vec4& b = secondCol;
+            const Vec4& c = thirdCol;
+            //rows of the inverse are cross products of the columns divided by the determinant
+            Vec3 r0 = {b.y * c.z - b.z * c.y, b.z * c.x - b.x * c.z, b.x * c.y - b.y * c.x};
+            Vec3 r1 = {c.y * a.z - c.z * a.y, c.z * a.x - c.x * a.z, c.x * a.y - c.y * a.x};
+            Vec3 r2 = {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+            float det = a.x * r0.x + a.y * r0.y + a.z * r0.z;
+            if (det == 0.0f)
+                return Mat4();
+            float invDet = 1.0f / det;
+            r0 = r0 * invDet;
+            r1 = r1 * invDet;
+            r2 = r2 * invDet;
+
+            Vec3 t = {fourthCol.x, fourthCol.y, fourthCol.z};
+            Mat4 m;
+            m.firstCol = {r0.x, r1.x, r2.x, 0.0f};
+            m.secondCol = {r0.y, r1.y, r2.y, 0.0f};
+            m.thirdCol = {r0.z, r1.z, r2.z, 0.0f};
+            m.fourthCol = {-(r0 * t), -(r1 * t), -(r2 * t), 1.0f};
+            return m;
+        }
+
+        //transforms normals the way this (affine) matrix transforms positions: inverse transpose of the 3x3 part
+        //lengths change under scaling, normalize after transforming
+        Mat3 normalMatrix() const
+        {
+            Mat4 inverse = inverseAffine();
+            return {{inverse.firstCol.x, inverse.secondCol.x, inverse.thirdCol.x},
+                    {inverse.firstCol.y, inverse.secondCol.y, inverse.thirdCol.y},
+                    {inverse.firstCol.z, inverse.secondCol.z, inverse.thirdCol.z}};
+        }
+
         //Matrix transforms
         //translate Mat3
         static Mat4 translate(Vec3 translation) {
@@ -408,33 +455,6 @@ std::ostream& operator<<(std::ostream& os, const Mat2& mat) {
 
     };
 
-    static bool hasPlaneLineIntersection(Vec3 planeNormal, Vec3 lineDirection){
-        if(planeNormal * lineDirection != 0)
-            return true;
-        else
-            return false;
-    }
-
-
-    struct Plane {
-        Vec3 point;
-        Vec3 normal;
-    };
-
-    struct Line {
-        Vec3 point;
-        Vec3 direction;
-    };
-
-
-    static Vec3 getPlaneLineIntersection(Plane plane, Line line) {
-        assert(hasPlaneLineIntersection(plane.normal, line.direction));
-        float num = (plane.point - line.point) * plane.normal;
-        float den = line.direction * plane.normal;
-        float scalar = num / den;
-        return line.point + line.direction * scalar;
-    }
-
     static Vec3 getIntersection(Vec4 v1, Vec4 v2) {
         float a = (v1.z * (-1.0f)) / (v2.z - v1.z);
         Vec4 ret = v1 * (1.0f - a) + v2 * a;
@@ -0,0 +1,217 @@
+#ifndef MESHGENERATOR_H
+#define MESHGENERATOR_H
+
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <random>
+#include <unordered_map>
+#include "Math.hpp"
+#include "Bounds.hpp"
+#include "Vertex.hpp"
+#include "Entity.hpp"
+#include "Scene.hpp"
+
+namespace paint {
+
+//how triangle sizes are drawn between a minimum and maximum circumradius
+enum class SizeDistribution {
+    Uniform, //every size equally likely
+    LogUniform //every order of magnitude equally likely, mostly small triangles with a few large ones
+};
+
+//procedural test content, everything is deterministic for a given seed
+//front faces follow the renderer convention: (v1 - v0) x (v2 - v0) points out of the surface
+class MeshGenerator {
+public:
+    //regular icosahedron (20 sided die) with vertices on a sphere of the given radius
+    static Vertex makeIcosahedron(float radius) {
+        const float phi = (1.0f + sqrt(5.0f)) / 2.0f;
+        float se = radius / sqrt(1.0f + phi * phi); //half edge length
+        float l = se * phi;
+
+        Vertex v;
+        //12 vertices on three orthogonal golden rectangles
+        v.positions.emplace_back(-se, -l, 0.0f, 1.0f);
+        v.positions.emplace_back(se, -l, 0.0f, 1.0f);
+        v.positions.emplace_back(se, l, 0.0f, 1.0f);
+        v.positions.emplace_back(-se, l, 0.0f, 1.0f);
+        v.positions.emplace_back(0.0f, -se, -l, 1.0f);
+        v.positions.emplace_back(0.0f, se, -l, 1.0f);
+        v.positions.emplace_back(0.0f, se, l, 1.0f);
+        v.positions.emplace_back(0.0f, -se, l, 1.0f);
+        v.positions.emplace_back(-l, 0.0f, -se, 1.0f);
+        v.positions.emplace_back(l, 0.0f, -se, 1.0f);
+        v.positions.emplace_back(l, 0.0f, se, 1.0f);
+        v.positions.emplace_back(-l, 0.0f, se, 1.0f);
+
+        //20 faces
+        const unsigned int faces[20][3] = {
+            {0, 7, 11}, {11, 7, 6}, {0, 1, 7}, {7, 10, 6}, {7, 1, 10},
+            {0, 4, 1}, {4, 9, 1}, {1, 9, 10}, {10, 9, 2}, {6, 10, 2},
+            {11, 6, 3}, {3, 6, 2}, {0, 8, 4}, {8, 5, 4}, {4, 5, 9},
+            {0, 11, 8}, {5, 2, 9}, {11, 3, 8}, {8, 3, 5}, {3, 2, 5}
+        };
+        for (const unsigned int* f : faces)
+            v.indices.emplace_back(f[0], f[1], f[2]);
+        return v;
+    }
+
+    //icosahedron with every triangle split into four subdivisions times, new vertices pushed out to the sphere
+    //20 * 4^subdivisions triangles, vertices on shared edges are shared
+    static Vertex makeIcosphere(float radius, unsigned int subdivisions) {
+        Vertex mesh = makeIcosahedron(radius);
+        for (unsigned int level = 0; level < subdivisions; ++level) {
+            std::unordered_map<uint64_t, unsigned int> midpoints; //edge (smaller index first) to vertex
+            midpoints.reserve(mesh.indices.size() * 3 / 2);
+            std::vector<Index> indices;
+            indices.reserve(mesh.indices.size() * 4);
+
+            for (const Index& i : mesh.indices) {
+                unsigned int ab = getMidpoint(mesh, midpoints, i.x, i.y, radius);
+                unsigned int bc = getMidpoint(mesh, midpoints, i.y, i.z, radius);
+                unsigned int ca = getMidpoint(mesh, midpoints, i.z, i.x, radius);
+                indices.emplace_back(i.x, ab, ca);
+                indices.emplace_back(i.y, bc, ab);
+                indices.emplace_back(i.z, ca, bc);
+                indices.emplace_back(ab, bc, ca);
+            }
+            mesh.indices.swap(indices);
+        }
+        return mesh;
+    }
+
+    //flat grid in the xz plane facing up (+y), centered on the origin
+    //columns * rows quads, two triangles each
+    static Vertex makeGrid(float width, float depth, unsigned int columns, unsigned int rows) {
+        Vertex mesh;
+        mesh.positions.reserve((columns + 1) * (rows + 1));
+        mesh.indices.reserve(columns * rows * 2);
+        for (unsigned int row = 0; row <= rows; ++row) {
+            for (unsigned int column = 0; column <= columns; ++column) {
+                float x = width * (float(column) / float(columns) - 0.5f);
+                float z = depth * (float(row) / float(rows) - 0.5f);
+                mesh.positions.emplace_back(x, 0.0f, z, 1.0f);
+            }
+        }
+        unsigned int stride = columns + 1;
+        for (unsigned int row = 0; row < rows; ++row) {
+            for (unsigned int column = 0; column < columns; ++column) {
+                unsigned int a = row * stride + column;
+                mesh.indices.emplace_back(a, a + stride, a + 1);
+                mesh.indices.emplace_back(a + 1, a + stride, a + stride + 1);
+            }
+        }
+        return mesh;
+    }
+
+    //axis aligned box with the given half size, 12 triangles
+    static Vertex makeBox(float halfSize) {
+        Vertex mesh;
+        const float s = halfSize;
+        mesh.positions.emplace_back(-s, -s, -s, 1.0f);
+        mesh.positions.emplace_back(s, -s, -s, 1.0f);
+        mesh.positions.emplace_back(s, s, -s, 1.0f);
+        mesh.positions.emplace_back(-s, s, -s, 1.0f);
+        mesh.positions.emplace_back(-s, -s, s, 1.0f);
+        mesh.positions.emplace_back(s, -s, s, 1.0f);
+        mesh.positions.emplace_back(s, s, s, 1.0f);
+        mesh.positions.emplace_back(-s, s, s, 1.0f);
+
+        const unsigned int faces[12][3] = {
+            {0, 2, 1}, {0, 3, 2}, //front (-z)
+            {5, 6, 4}, {4, 6, 7}, //back (+z)
+            {0, 7, 3}, {0, 4, 7}, //left
+            {1, 2, 6}, {1, 6, 5}, //right
+            {3, 7, 6}, {3, 6, 2}, //top
+            {0, 1, 5}, {0, 5, 4} //bottom
+        };
+        for (const unsigned int* f : faces)
+            mesh.indices.emplace_back(f[0], f[1], f[2]);
+        return mesh;
+    }
+
+    //count unconnected equilateral triangles with random centers inside region and random orientation
+    //sizes are circumradii between minSize and maxSize, about half of the triangles face away from any viewer
+    static Vertex makeTriangleSoup(unsigned int count, const AABB& region, float minSize, float maxSize,
+                                   SizeDistribution distribution, unsigned int seed) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::uniform_real_distribution<float> signedUnit(-1.0f, 1.0f);
+
+        Vertex mesh;
+        mesh.positions.reserve(count * 3);
+        mesh.indices.reserve(count);
+        for (unsigned int k = 0; k < count; ++k) {
+            Vec3 center(region.min.x + (region.max.x - region.min.x) * unit(rng),
+                        region.min.y + (region.max.y - region.min.y) * unit(rng),
+                        region.min.z + (region.max.z - region.min.z) * unit(rng));
+
+            float t = unit(rng);
+            float size = distribution == SizeDistribution::Uniform ?
+                         minSize + (maxSize - minSize) * t :
+                         minSize * pow(maxSize / minSize, t);
+
+            //random plane: uniform normal on the sphere, then an orthonormal basis in the plane
+            float nz = signedUnit(rng);
+            float angle = 6.2831853f * unit(rng);
+            float r = sqrt(std::max(1.0f - nz * nz, 0.0f));
+            Vec3 normal(r * cos(angle), r * sin(angle), nz);
+            Vec3 helper = fabs(normal.x) < 0.9f ? Vec3(1.0f, 0.0f, 0.0f) : Vec3(0.0f, 1.0f, 0.0f);
+            Vec3 u = helper.crossProduct(normal);
+            u = u * (1.0f / u.magnitude());
+            Vec3 w = normal.crossProduct(u);
+
+            float spin = 6.2831853f * unit(rng);
+            unsigned int first = mesh.positions.size();
+            for (unsigned int corner = 0; corner < 3; ++corner) {
+                float a = spin + 2.0943951f * corner; //120 degrees apart
+                Vec3 p = center + (u * cos(a) + w * sin(a)) * size;
+                mesh.positions.emplace_back(p.x, p.y, p.z, 1.0f);
+            }
+            mesh.indices.emplace_back(first, first + 1, first + 2);
+        }
+        return mesh;
+    }
+
+    //adds count copies of mesh at random positions inside region with random rotations
+    //returns the id of the first entity added, the rest follow in order
+    static EntityId populateScene(Scene& scene, const Vertex& mesh, unsigned int count, const AABB& region,
+                                  unsigned int seed) {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        Entity entity(mesh); //bounds are computed once and copied
+        EntityId first = scene.size();
+        for (unsigned int k = 0; k < count; ++k) {
+            entity.moveTo({region.min.x + (region.max.x - region.min.x) * unit(rng),
+                           region.min.y + (region.max.y - region.min.y) * unit(rng),
+                           region.min.z + (region.max.z - region.min.z) * unit(rng)});
+            entity.rotateTo(6.2831853f * unit(rng));
+            scene.add(entity);
+        }
+        return first;
+    }
+
+private:
+    static unsigned int getMidpoint(Vertex& mesh, std::unordered_map<uint64_t, unsigned int>& midpoints,
+                                    unsigned int a, unsigned int b, float radius) {
+        uint64_t key = uint64_t(std::min(a, b)) << 32 | std::max(a, b);
+        auto found = midpoints.find(key);
+        if (found != midpoints.end())
+            return found->second;
+
+        const Vec4& pa = mesh.positions.at(a);
+        const Vec4& pb = mesh.positions.at(b);
+        Vec3 m((pa.x + pb.x) * 0.5f, (pa.y + pb.y) * 0.5f, (pa.z + pb.z) * 0.5f);
+        m = m * (radius / m.magnitude());
+        unsigned int index = mesh.positions.size();
+        mesh.positions.emplace_back(m.x, m.y, m.z, 1.0f);
+        midpoints.emplace(key, index);
+        return index;
+    }
+};
+
+}
+
+#endif //MESHGENERATOR_H
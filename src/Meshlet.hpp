@@ -0,0 +1,157 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "Math.hpp"
+#include "Bounds.hpp"
+#include "Vertex.hpp"
+
+namespace paint {
+
+//cluster of neighbouring triangles with similar normals, indices [firstTriangle, firstTriangle + triangleCount)
+//rejected as a whole when the camera sees only the back of every triangle or the bounds are outside the frustum
+struct Meshlet
+{
+    static constexpr unsigned int MAX_TRIANGLES = 128;
+    static constexpr unsigned int MIN_AVERAGE_TRIANGLES = 32; //below this a cluster test costs more than it saves
+    static constexpr float NO_CONE = 2.0f; //cutoff of a cluster that is never back-facing as a whole
+
+    unsigned int firstTriangle = 0;
+    unsigned int triangleCount = 0;
+    BoundingSphere bounds; //object space
+    Vec3 coneAxis; //average front face normal
+    float coneCutoff = NO_CONE; //sine of the largest angle between coneAxis and a triangle normal
+
+    //every triangle faces away from eye (object space), mirrored flips the faces
+    //a view direction inside the normal cone, widened by the bounding sphere, can only see back faces
+    bool isBackfacing(const Vec3& eye, bool mirrored) const {
+        Vec3 direction = bounds.center - eye;
+        float d = direction * coneAxis;
+        if (mirrored)
+            d = -d;
+        return d >= coneCutoff * direction.magnitude() + bounds.radius;
+    }
+};
+
+//splits a mesh into clusters at load time, indices are reordered so every cluster is a contiguous range
+//clusters grow breadth first over shared vertices from a seed triangle, taking neighbours whose normal
+//is within MAX_CONE_ANGLE of the seed, until MAX_TRIANGLES are reached or no neighbour fits
+//meshes of a single cluster or less are left as they are and get no clusters, so are poorly connected meshes
+//(triangle soups) whose clusters stay small
+inline std::vector<Meshlet> buildMeshlets(Vertex& mesh) {
+    const float minSeedDot = 0.5f; //60 degrees to the seed normal
+    std::vector<Meshlet> meshlets;
+    unsigned int triangleCount = mesh.indices.size();
+    unsigned int vertexCount = mesh.positions.size();
+    if (triangleCount <= Meshlet::MAX_TRIANGLES)
+        return meshlets;
+
+    //unit normals, zero for degenerate triangles
+    std::vector<Vec3> normals(triangleCount);
+    for (unsigned int k = 0; k < triangleCount; ++k) {
+        const Index& i = mesh.indices[k];
+        const Vec4& v0 = mesh.positions.at(i.x);
+        const Vec4& v1 = mesh.positions.at(i.y);
+        const Vec4& v2 = mesh.positions.at(i.z);
+        Vec3 a = {v1.x - v0.x, v1.y - v0.y, v1.z - v0.z};
+        Vec3 b = {v2.x - v0.x, v2.y - v0.y, v2.z - v0.z};
+        Vec3 normal = a.crossProduct(b);
+        float length = normal.magnitude();
+        normals[k] = length > 0.0f ? normal * (1.0f / length) : Vec3(0.0f, 0.0f, 0.0f);
+    }
+
+    //triangles around every vertex (compressed rows)
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (const Index& i : mesh.indices) {
+        ++offsets[i.x + 1];
+        ++offsets[i.y + 1];
+        ++offsets[i.z + 1];
+    }
+    for (unsigned int v = 0; v < vertexCount; ++v)
+        offsets[v + 1] += offsets[v];
+    std::vector<unsigned int> adjacency(offsets[vertexCount]);
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (unsigned int k = 0; k < triangleCount; ++k) {
+        const Index& i = mesh.indices[k];
+        adjacency[fill[i.x]++] = k;
+        adjacency[fill[i.y]++] = k;
+        adjacency[fill[i.z]++] = k;
+    }
+
+    std::vector<bool> assigned(triangleCount, false);
+    std::vector<unsigned int> queue;
+    std::vector<Index> indices;
+    indices.reserve(triangleCount);
+    std::vector<Vec4> corners;
+    for (unsigned int seed = 0; seed < triangleCount; ++seed) {
+        if (assigned[seed])
+            continue;
+
+        Meshlet meshlet;
+        meshlet.firstTriangle = indices.size();
+        const Vec3 seedNormal = normals[seed];
+        queue.assign(1, seed);
+        assigned[seed] = true;
+        unsigned int head = 0;
+        while (head < queue.size() && meshlet.triangleCount < Meshlet::MAX_TRIANGLES) {
+            unsigned int t = queue[head++];
+            indices.push_back(mesh.indices[t]);
+            ++meshlet.triangleCount;
+
+            const unsigned int corners3[3] = {mesh.indices[t].x, mesh.indices[t].y, mesh.indices[t].z};
+            for (unsigned int v : corners3) {
+                for (unsigned int a = offsets[v]; a < offsets[v + 1]; ++a) {
+                    unsigned int u = adjacency[a];
+                    if (assigned[u])
+                        continue;
+                    //degenerate triangles fit anywhere, they cover no pixels
+                    if (normals[u] * seedNormal < minSeedDot && normals[u] * normals[u] > 0.0f)
+                        continue;
+                    assigned[u] = true;
+                    queue.push_back(u);
+                }
+            }
+        }
+        //queued but not taken, free for the following clusters
+        for (unsigned int k = head; k < queue.size(); ++k)
+            assigned[queue[k]] = false;
+
+        //bounds and normal cone of the cluster
+        corners.clear();
+        Vec3 axis = {0.0f, 0.0f, 0.0f};
+        for (unsigned int k = 0; k < head; ++k) {
+            const Index& i = mesh.indices[queue[k]];
+            corners.push_back(mesh.positions.at(i.x));
+            corners.push_back(mesh.positions.at(i.y));
+            corners.push_back(mesh.positions.at(i.z));
+            axis = axis + normals[queue[k]];
+        }
+        meshlet.bounds = computeBoundingSphere(corners);
+        float length = axis.magnitude();
+        if (length > 0.0f) {
+            axis = axis * (1.0f / length);
+            float minDot = 1.0f;
+            for (unsigned int k = 0; k < head; ++k) {
+                const Vec3& n = normals[queue[k]];
+                if (n * n > 0.0f)
+                    minDot = std::min(minDot, n * axis);
+            }
+            //cones wider than about 84 degrees can not reject anything useful
+            if (minDot > 0.1f)
+                meshlet.coneCutoff = sqrt(1.0f - minDot * minDot);
+        }
+        meshlet.coneAxis = axis;
+        meshlets.push_back(meshlet);
+    }
+
+    if (triangleCount < meshlets.size() * Meshlet::MIN_AVERAGE_TRIANGLES)
+        return std::vector<Meshlet>();
+    mesh.indices.swap(indices);
+    return meshlets;
+}
+
+}
+
+#endif //MESHLET_H
@@ -0,0 +1,402 @@
+#ifndef OBJLOADER_H
+#define OBJLOADER_H
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include "Math.hpp"
+#include "Vertex.hpp"
+#include "MappedFile.hpp"
+
+namespace paint {
+
+struct ObjStats
+{
+    size_t bytes = 0;
+    unsigned int threads = 0;
+    unsigned int positions = 0; //v lines
+    unsigned int normals = 0; //vn lines
+    unsigned int vertices = 0; //unique position/normal pairs emitted
+    unsigned int triangles = 0;
+    unsigned int skippedFaces = 0; //faces with indices out of range
+    double parseSeconds = 0.0; //counting and parsing, in parallel
+    double buildSeconds = 0.0; //vertex deduplication and output
+
+    double getMegabytesPerSecond() const {
+        double seconds = parseSeconds + buildSeconds;
+        return seconds > 0.0 ? double(bytes) / (1024.0 * 1024.0) / seconds : 0.0;
+    }
+
+    std::string toString() const {
+        return std::to_string(bytes / (1024 * 1024)) + " MB, " + std::to_string(triangles) + " triangles, " +
+               std::to_string(vertices) + " vertices, " + std::to_string(threads) + " threads, parse " +
+               std::to_string(int(parseSeconds * 1000.0)) + " ms, build " + std::to_string(int(buildSeconds * 1000.0)) +
+               " ms, " + std::to_string(int(getMegabytesPerSecond())) + " MB/s";
+    }
+};
+
+//Wavefront OBJ loader (v, vn and f lines, everything else is skipped)
+//the file is memory mapped and split into one chunk per thread at line boundaries:
+//  1. every chunk counts its v/vn lines, a prefix sum gives each chunk its first index
+//  2. every chunk parses in place, positions and normals go straight to their final slots
+//  3. position/normal index pairs are deduplicated into the single index Vertex layout
+//OBJ is right handed with counter clockwise front faces, z and the winding are flipped for the renderer
+class ObjLoader {
+private:
+    static constexpr int MISSING = -1;
+    static constexpr int INVALID = -2; //relative index before the first vertex
+
+    struct Corner {
+        int position;
+        int normal; //MISSING if the face has no normals
+    };
+
+    struct Chunk {
+        const char* begin;
+        const char* end;
+        unsigned int firstPosition = 0;
+        unsigned int firstNormal = 0;
+        unsigned int positionCount = 0;
+        unsigned int normalCount = 0;
+        unsigned int skippedFaces = 0;
+        bool hasNormals = false; //some corner has a normal
+        bool hasSeparateNormals = false; //some corner has a normal index different from its position index
+        std::vector<Corner> corners; //three per triangle
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+public:
+    //threadCount 0 uses every hardware thread, returns false if the file can not be mapped
+    static bool load(const std::string& filename, Vertex& vertex, ObjStats* stats = nullptr, unsigned int threadCount = 0) {
+        MappedFile file;
+        if (!file.open(filename))
+            return false;
+        parse(file.getData(), file.getData() + file.getSize(), vertex, stats, threadCount);
+        return true;
+    }
+
+    //parses OBJ text from memory
+    static void parse(const char* begin, const char* end, Vertex& vertex, ObjStats* stats = nullptr, unsigned int threadCount = 0) {
+        Clock::time_point start = Clock::now();
+        if (threadCount == 0)
+            threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        //small files are not worth the threads
+        threadCount = std::max(std::min(threadCount, unsigned((end - begin) / (64 * 1024))), 1u);
+
+        std::vector<Chunk> chunks = split(begin, end, threadCount);
+        forEachChunk(chunks, countLines);
+
+        unsigned int positionCount = 0;
+        unsigned int normalCount = 0;
+        for (Chunk& chunk : chunks) {
+            chunk.firstPosition = positionCount;
+            chunk.firstNormal = normalCount;
+            positionCount += chunk.positionCount;
+            normalCount += chunk.normalCount;
+        }
+
+        std::vector<Vec3> positions(positionCount);
+        std::vector<Vec3> normals(normalCount);
+        forEachChunk(chunks, [&](Chunk& chunk) { parseChunk(chunk, positions, normals); });
+        double parseSeconds = getSeconds(start);
+
+        start = Clock::now();
+        build(chunks, positions, normals, vertex);
+
+        if (stats != nullptr) {
+            *stats = ObjStats();
+            stats->bytes = end - begin;
+            stats->threads = threadCount;
+            stats->positions = positionCount;
+            stats->normals = normalCount;
+            stats->vertices = vertex.positions.size();
+            stats->triangles = vertex.indices.size();
+            for (const Chunk& chunk : chunks)
+                stats->skippedFaces += chunk.skippedFaces;
+            stats->parseSeconds = parseSeconds;
+            stats->buildSeconds = getSeconds(start);
+        }
+    }
+
+    //decimal float with optional sign, fraction and exponent, p is left after the number
+    static float parseFloat(const char*& p, const char* end) {
+        //exact powers of ten representable in a double
+        static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+
+        uint64_t mantissa = 0;
+        int digits = 0; //significant digits kept in the mantissa
+        int exponent = 0;
+        for (; p < end && isDigit(*p); ++p) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+            } else {
+                ++exponent;
+            }
+        }
+        if (p < end && *p == '.') {
+            for (++p; p < end && isDigit(*p); ++p) {
+                if (digits < 19) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    digits += mantissa != 0;
+                    --exponent;
+                }
+            }
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            ++p;
+            bool negativeExponent = false;
+            if (p < end && (*p == '-' || *p == '+'))
+                negativeExponent = *p++ == '-';
+            int e = 0;
+            for (; p < end && isDigit(*p); ++p)
+                e = std::min(e * 10 + (*p - '0'), 1000);
+            exponent += negativeExponent ? -e : e;
+        }
+
+        double value = double(mantissa);
+        if (exponent < 0)
+            value = exponent >= -22 ? value / powers[-exponent] : value * pow(10.0, exponent);
+        else if (exponent > 0)
+            value = exponent <= 22 ? value * powers[exponent] : value * pow(10.0, exponent);
+        return float(negative ? -value : value);
+    }
+
+private:
+    static double getSeconds(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    static bool isDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    static const char* skipSpaces(const char* p, const char* end) {
+        while (p < end && isSpace(*p))
+            ++p;
+        return p;
+    }
+
+    static const char* nextLine(const char* p, const char* end) {
+        const char* newline = static_cast<const char*>(memchr(p, '\n', end - p));
+        return newline != nullptr ? newline + 1 : end;
+    }
+
+    static int parseInt(const char*& p, const char* end) {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+        int value = 0;
+        for (; p < end && isDigit(*p); ++p)
+            value = value * 10 + (*p - '0');
+        return negative ? -value : value;
+    }
+
+    //equal sized chunks, each boundary moved forward to the next line start
+    static std::vector<Chunk> split(const char* begin, const char* end, unsigned int count) {
+        std::vector<Chunk> chunks(count);
+        size_t size = (end - begin) / count;
+        const char* p = begin;
+        for (unsigned int i = 0; i < count; ++i) {
+            chunks.at(i).begin = p;
+            p = i + 1 == count ? end : nextLine(std::max(p, begin + size * (i + 1)), end);
+            chunks.at(i).end = p;
+        }
+        return chunks;
+    }
+
+    template<typename Function>
+    static void forEachChunk(std::vector<Chunk>& chunks, Function function) {
+        std::vector<std::thread> threads;
+        for (unsigned int i = 1; i < chunks.size(); ++i)
+            threads.emplace_back(function, std::ref(chunks.at(i)));
+        function(chunks.at(0)); //calling thread takes the first chunk
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    static void countLines(Chunk& chunk) {
+        for (const char* p = chunk.begin; p < chunk.end; p = nextLine(p, chunk.end)) {
+            p = skipSpaces(p, chunk.end);
+            if (chunk.end - p < 2 || p[0] != 'v')
+                continue;
+            if (isSpace(p[1]))
+                ++chunk.positionCount;
+            else if (p[1] == 'n' && chunk.end - p > 2 && isSpace(p[2]))
+                ++chunk.normalCount;
+        }
+    }
+
+    //OBJ indices are 1 based, negative ones count back from the last vertex read so far
+    static int resolve(int index, unsigned int readSoFar) {
+        if (index < 0)
+            return int(readSoFar) + index >= 0 ? int(readSoFar) + index : INVALID;
+        return index > 0 ? index - 1 : MISSING;
+    }
+
+    static void parseChunk(Chunk& chunk, std::vector<Vec3>& positions, std::vector<Vec3>& normals) {
+        unsigned int position = chunk.firstPosition;
+        unsigned int normal = chunk.firstNormal;
+        Corner polygon[3];
+
+        for (const char* p = chunk.begin; p < chunk.end; p = nextLine(p, chunk.end)) {
+            p = skipSpaces(p, chunk.end);
+            if (chunk.end - p < 2)
+                continue;
+
+            if (p[0] == 'v' && (isSpace(p[1]) || (p[1] == 'n' && chunk.end - p > 2 && isSpace(p[2])))) {
+                bool isNormal = p[1] == 'n';
+                p += isNormal ? 2 : 1;
+                float xyz[3];
+                for (float& f : xyz) {
+                    p = skipSpaces(p, chunk.end);
+                    f = parseFloat(p, chunk.end);
+                }
+                if (isNormal)
+                    normals.at(normal++) = {xyz[0], xyz[1], xyz[2]};
+                else
+                    positions.at(position++) = {xyz[0], xyz[1], xyz[2]};
+            } else if (p[0] == 'f' && isSpace(p[1])) {
+                //triangle fan over the polygon
+                unsigned int count = 0;
+                bool valid = true;
+                p = skipSpaces(p + 1, chunk.end);
+                while (p < chunk.end && *p != '\n' && *p != '#') {
+                    Corner corner = {resolve(parseInt(p, chunk.end), position), MISSING};
+                    if (p < chunk.end && *p == '/') {
+                        ++p;
+                        parseInt(p, chunk.end); //texture coordinate, unused
+                        if (p < chunk.end && *p == '/') {
+                            ++p;
+                            corner.normal = resolve(parseInt(p, chunk.end), normal);
+                        }
+                    }
+                    valid = valid && corner.position >= 0 && corner.position < int(positions.size()) &&
+                            (corner.normal == MISSING || (corner.normal >= 0 && corner.normal < int(normals.size())));
+                    //skip whatever is left of a malformed token
+                    while (p < chunk.end && !isSpace(*p) && *p != '\n')
+                        ++p;
+                    p = skipSpaces(p, chunk.end);
+
+                    if (count < 2) {
+                        polygon[count++] = corner;
+                        continue;
+                    }
+                    polygon[2] = corner;
+                    if (valid) {
+                        chunk.corners.insert(chunk.corners.end(), polygon, polygon + 3);
+                        for (const Corner& c : polygon) {
+                            chunk.hasNormals = chunk.hasNormals || c.normal != MISSING;
+                            chunk.hasSeparateNormals = chunk.hasSeparateNormals || c.normal != c.position;
+                        }
+                    }
+                    polygon[1] = corner;
+                    ++count;
+                }
+                if (!valid)
+                    ++chunk.skippedFaces;
+            }
+        }
+    }
+
+    //one output vertex per distinct position/normal pair
+    //faces without normals, or with normal indices equal to position indices, use the OBJ vertices as they are
+    static void build(const std::vector<Chunk>& chunks, const std::vector<Vec3>& positions,
+                      const std::vector<Vec3>& normals, Vertex& vertex) {
+        size_t cornerCount = 0;
+        bool hasNormals = false;
+        bool hasSeparateNormals = false;
+        for (const Chunk& chunk : chunks) {
+            cornerCount += chunk.corners.size();
+            hasNormals = hasNormals || chunk.hasNormals;
+            hasSeparateNormals = hasSeparateNormals || chunk.hasSeparateNormals;
+        }
+        if (!hasNormals || !hasSeparateNormals)
+            buildShared(chunks, positions, hasNormals ? normals : std::vector<Vec3>(), vertex);
+        else
+            buildDeduplicated(chunks, positions, normals, cornerCount, vertex);
+    }
+
+    static void buildShared(const std::vector<Chunk>& chunks, const std::vector<Vec3>& positions,
+                            const std::vector<Vec3>& normals, Vertex& vertex) {
+        vertex = Vertex();
+        vertex.positions.reserve(positions.size());
+        for (const Vec3& p : positions)
+            vertex.positions.emplace_back(p.x, p.y, -p.z, 1.0f);
+        vertex.normals.reserve(normals.size());
+        for (const Vec3& n : normals)
+            vertex.normals.emplace_back(n.x, n.y, -n.z);
+        //normals only cover the vertices they were written for
+        if (!vertex.normals.empty())
+            vertex.normals.resize(vertex.positions.size(), Vec3(0.0f, 0.0f, 0.0f));
+
+        for (const Chunk& chunk : chunks) {
+            for (size_t k = 0; k < chunk.corners.size(); k += 3)
+                vertex.indices.emplace_back(chunk.corners[k].position, chunk.corners[k + 2].position,
+                                            chunk.corners[k + 1].position);
+        }
+    }
+
+    //open addressing hash table from position/normal pair to output vertex
+    static void buildDeduplicated(const std::vector<Chunk>& chunks, const std::vector<Vec3>& positions,
+                                  const std::vector<Vec3>& normals, size_t cornerCount, Vertex& vertex) {
+
+        size_t tableSize = 16;
+        unsigned int tableBits = 4;
+        while (tableSize < cornerCount * 2) {
+            tableSize *= 2;
+            ++tableBits;
+        }
+        const uint64_t EMPTY = ~uint64_t(0);
+        std::vector<uint64_t> keys(tableSize, EMPTY);
+        std::vector<unsigned int> values(tableSize);
+
+        vertex = Vertex();
+        vertex.positions.reserve(std::min(cornerCount, positions.size() * 2));
+        vertex.indices.reserve(cornerCount / 3);
+
+        unsigned int triangle[3];
+        unsigned int k = 0;
+        for (const Chunk& chunk : chunks) {
+            for (const Corner& corner : chunk.corners) {
+                uint64_t key = uint64_t(unsigned(corner.position)) << 32 | unsigned(corner.normal);
+                size_t slot = size_t((key * 0x9e3779b97f4a7c15ull) >> (64 - tableBits)); //Fibonacci hashing
+                while (keys[slot] != EMPTY && keys[slot] != key)
+                    slot = (slot + 1) & (tableSize - 1);
+
+                if (keys[slot] == EMPTY) {
+                    keys[slot] = key;
+                    values[slot] = vertex.positions.size();
+                    const Vec3& p = positions[corner.position];
+                    vertex.positions.emplace_back(p.x, p.y, -p.z, 1.0f);
+                    Vec3 n = corner.normal == MISSING ? Vec3(0.0f, 0.0f, 0.0f) : normals[corner.normal];
+                    vertex.normals.emplace_back(n.x, n.y, -n.z);
+                }
+
+                triangle[k++] = values[slot];
+                if (k == 3) {
+                    vertex.indices.emplace_back(triangle[0], triangle[2], triangle[1]);
+                    k = 0;
+                }
+            }
+        }
+    }
+};
+
+}
+
+#endif //OBJLOADER_H
@@ -0,0 +1,189 @@
+#ifndef OCCLUSIONBUFFER_H
+#define OCCLUSIONBUFFER_H
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "Math.hpp"
+#include "Bounds.hpp"
+#include "Vertex.hpp"
+#include "Simd.hpp"
+
+namespace paint {
+
+//coarse depth buffer for software occlusion culling
+//designated occluder meshes are rasterized into it, then entity bounding boxes are tested against it
+//the result is conservative: occluders write pixels whose center they cover with the depth of the pixel's
+//farthest corner, and boxes are tested with their nearest depth over their screen rectangle grown by a pixel,
+//which takes in the uncovered pixels next to any partially covered occluder edge
+class OcclusionBuffer {
+public:
+    static constexpr int WIDTH = 256; //multiple of 4, rows are processed 4 pixels at a time
+    static constexpr int HEIGHT = 128;
+private:
+    std::vector<float> m_depth; //nearest occluder depth, NDC z [0, 1]
+    std::vector<Vec4> m_clipPositions; //reused between occluders
+    unsigned int m_triangleCount;
+public:
+    OcclusionBuffer() : m_depth(WIDTH * HEIGHT, 1.0f), m_triangleCount(0) {};
+
+    void clear() {
+        std::fill(m_depth.begin(), m_depth.end(), 1.0f);
+        m_triangleCount = 0;
+    }
+
+    //occluder triangles rasterized since clear()
+    unsigned int getTriangleCount() const {
+        return m_triangleCount;
+    }
+
+    //mesh positions are in object space, modelViewProjection takes them to clip space
+    void addOccluder(const MeshData& mesh, const Mat4& modelViewProjection) {
+        m_clipPositions.clear();
+        for (unsigned int v = 0; v < mesh.vertexCount; ++v)
+            m_clipPositions.push_back(modelViewProjection * mesh.positions[v]);
+
+        for (unsigned int k = 0; k < mesh.triangleCount; ++k) {
+            const Index& i = mesh.indices[k];
+            Vec4 triangle[3] = {m_clipPositions.at(i.x), m_clipPositions.at(i.y), m_clipPositions.at(i.z)};
+            Vec4 polygon[4];
+            unsigned int size = clipNear(triangle, polygon);
+            for (unsigned int k = 2; k < size; ++k)
+                rasterizeTriangle(toScreen(polygon[0]), toScreen(polygon[k - 1]), toScreen(polygon[k]));
+        }
+    }
+
+    //false only if the box is completely hidden behind occluders (or off screen)
+    bool isVisible(const AABB& box, const Mat4& modelViewProjection) const {
+        if (box.isEmpty())
+            return false;
+
+        float xMin = float(WIDTH), yMin = float(HEIGHT), xMax = 0.0f, yMax = 0.0f;
+        float zNear = 1.0f;
+        for (unsigned int corner = 0; corner < 8; ++corner) {
+            Vec4 p = {corner & 1 ? box.max.x : box.min.x, corner & 2 ? box.max.y : box.min.y,
+                      corner & 4 ? box.max.z : box.min.z, 1.0f};
+            Vec4 c = modelViewProjection * p;
+            if (c.z < 0.0f || c.w <= 0.0f)
+                return true; //crosses the near plane
+            Vec3 s = toScreen(c);
+            xMin = std::min(xMin, s.x);
+            xMax = std::max(xMax, s.x);
+            yMin = std::min(yMin, s.y);
+            yMax = std::max(yMax, s.y);
+            zNear = std::min(zNear, s.z);
+        }
+
+        int x0 = std::max(int(floor(xMin)) - 1, 0);
+        int x1 = std::min(int(ceil(xMax)) + 1, WIDTH);
+        int y0 = std::max(int(floor(yMin)) - 1, 0);
+        int y1 = std::min(int(ceil(yMax)) + 1, HEIGHT);
+        if (x0 >= x1 || y0 >= y1)
+            return false;
+
+        Float4 z = Float4::set(zNear);
+        Float4 left = Float4::set(float(x0));
+        Float4 right = Float4::set(float(x1));
+        for (int y = y0; y < y1; ++y) {
+            const float* row = &m_depth[y * WIDTH];
+            for (int x = x0 & ~3; x < x1; x += 4) {
+                Float4 lanes = Float4::set(float(x), float(x + 1), float(x + 2), float(x + 3));
+                Mask4 inside = (lanes >= left) & (lanes < right);
+                //any pixel where the occluder is farther than the box
+                if ((inside & (Float4::load(row + x) >= z)).any())
+                    return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    //NDC to buffer pixels, y down like the screen
+    static Vec3 toScreen(const Vec4& v) {
+        float invW = 1.0f / v.w;
+        return {(v.x * invW * 0.5f + 0.5f) * WIDTH, (0.5f - v.y * invW * 0.5f) * HEIGHT, v.z * invW};
+    }
+
+    //clip triangle against the near plane (z >= 0), returns number of vertices in polygon
+    static unsigned int clipNear(const Vec4* triangle, Vec4* polygon) {
+        unsigned int size = 0;
+        for (unsigned int i = 0; i < 3; ++i) {
+            const Vec4& current = triangle[i];
+            const Vec4& previous = triangle[(i + 2) % 3];
+            if ((current.z >= 0.0f) != (previous.z >= 0.0f)) {
+                float t = previous.z / (previous.z - current.z);
+                polygon[size++] = previous + (current - previous) * t;
+            }
+            if (current.z >= 0.0f)
+                polygon[size++] = current;
+        }
+        return size;
+    }
+
+    //pixel center coverage with conservative depth, 4 pixels per step
+    void rasterizeTriangle(Vec3 a, Vec3 b, Vec3 c) {
+        float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+        if (fabs(area) < 0.0001f)
+            return;
+        if (area < 0.0f) {
+            //occluders are double sided, make edge functions positive inside
+            std::swap(b, c);
+            area = -area;
+        }
+        ++m_triangleCount;
+
+        //edge function e(p) = ex * p.x + ey * p.y + e0, positive inside
+        const Vec3* vertices[3] = {&a, &b, &c};
+        float ex[3], ey[3], e0[3];
+        for (unsigned int k = 0; k < 3; ++k) {
+            const Vec3& p0 = *vertices[k];
+            const Vec3& p1 = *vertices[(k + 1) % 3];
+            ex[k] = p0.y - p1.y;
+            ey[k] = p1.x - p0.x;
+            e0[k] = -(ex[k] * p0.x + ey[k] * p0.y);
+        }
+
+        //depth plane evaluated at the farthest corner of each pixel
+        float invArea = 1.0f / area;
+        float dzdx = ((b.z - a.z) * (c.y - a.y) - (c.z - a.z) * (b.y - a.y)) * invArea;
+        float dzdy = ((c.z - a.z) * (b.x - a.x) - (b.z - a.z) * (c.x - a.x)) * invArea;
+        float zBias = 0.5f * (fabs(dzdx) + fabs(dzdy));
+
+        int x0 = std::max(int(floor(std::min(a.x, std::min(b.x, c.x)))), 0) & ~3;
+        int x1 = std::min(int(ceil(std::max(a.x, std::max(b.x, c.x)))), WIDTH);
+        int y0 = std::max(int(floor(std::min(a.y, std::min(b.y, c.y)))), 0);
+        int y1 = std::min(int(ceil(std::max(a.y, std::max(b.y, c.y)))), HEIGHT);
+
+        Float4 stepX[3];
+        for (unsigned int k = 0; k < 3; ++k)
+            stepX[k] = Float4::set(ex[k]);
+        Float4 zero = Float4::set(0.0f);
+        Float4 dz = Float4::set(dzdx);
+
+        for (int y = y0; y < y1; ++y) {
+            float yc = float(y) + 0.5f;
+            float* row = &m_depth[y * WIDTH];
+            Float4 rowEdge[3];
+            for (unsigned int k = 0; k < 3; ++k)
+                rowEdge[k] = Float4::set(ey[k] * yc + e0[k]);
+            Float4 rowZ = Float4::set(a.z + dzdy * (yc - a.y) - dzdx * a.x + zBias);
+
+            for (int x = x0; x < x1; x += 4) {
+                float xc = float(x) + 0.5f;
+                Float4 lanes = Float4::set(xc, xc + 1.0f, xc + 2.0f, xc + 3.0f);
+                Mask4 covered = (stepX[0] * lanes + rowEdge[0] >= zero) &
+                                (stepX[1] * lanes + rowEdge[1] >= zero) &
+                                (stepX[2] * lanes + rowEdge[2] >= zero);
+                if (!covered.any())
+                    continue;
+                Float4 z = dz * lanes + rowZ;
+                Float4 depth = Float4::load(row + x);
+                Float4::select(covered, Float4::min(depth, z), depth).store(row + x);
+            }
+        }
+    }
+};
+
+}
+
+#endif //OCCLUSIONBUFFER_H
@@ -5,6 +5,14 @@
 #include <cmath>
 #include <math.h>
 #include <optional>
+#include <random>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
 #define SDL_MAIN_HANDLED //there is a main in SDL_main.h that causes Linker entry point error without this #define
 #include "SDL.h"
 #include "Screen.hpp" //this takes care of userinput
@@ -15,69 +23,130 @@
 #include "Camera.hpp"
 #include "CoordinateTransformer.hpp"
 #include "Texture.hpp"
+#include "Scene.hpp"
+#include "Benchmark.hpp"
+#include "ObjLoader.hpp"
+#include "CookedMesh.hpp"
+#include "MeshGenerator.hpp"
+#include "FramePipeline.hpp"
+#include "JobSystem.hpp"
 
 using namespace paint;
 
-
-int main()
+//printed when an option is missing its number or the number does not parse
+static void printUsage() {
+    std::cout << "usage: Paint [--deferred | --visibility] [--spans] [--latency <frames>] [--jobs <threads>] [--streaming]"
+                 " [--sync-present]\n"
+                 "             [--benchmark [present] | --cook <file.obj> <file.mesh> | --obj <file> | --mesh <file> |"
+                 " --stress <entities> <subdivisions> [lights]]" << std::endl;
+}
+
+//decimal digits only, false for anything else or values beyond unsigned int
+static bool parseUnsigned(const char* text, unsigned int& value) {
+    if (!isdigit((unsigned char)text[0]))
+        return false;
+    char* end = nullptr;
+    errno = 0;
+    unsigned long parsed = strtoul(text, &end, 10);
+    if (*end != '\0' || errno == ERANGE || parsed > UINT_MAX)
+        return false;
+    value = (unsigned int)parsed;
+    return true;
+}
+
+
+int main(int argc, char* argv[])
 {
+    //--deferred anywhere on the command line shades the scene through a G-buffer, --visibility through a visibility
+    //buffer, --spans hides surfaces with a span buffer instead of the z-buffer, --latency <frames> sets how far
+    //recording may run ahead of presentation (0 draws every frame on the main thread), --jobs <threads> sets the
+    //geometry workers (0 processes entities one by one), --streaming draws straight into locked streaming textures,
+    //--sync-present waits for the vertical blank on the main thread instead of a present thread,
+    //they are removed before the other options
+    RenderPath renderPath = RenderPath::Forward;
+    bool spans = false;
+    bool streaming = false;
+    bool syncPresent = false;
+    unsigned int latency = 1;
+    unsigned int hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    unsigned int jobs = hardwareThreads;
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--latency" || option == "--jobs") {
+            if (i + 1 >= argc || !parseUnsigned(argv[i + 1], option == "--latency" ? latency : jobs)) {
+                printUsage();
+                return 1;
+            }
+            std::copy(argv + i + 2, argv + argc, argv + i);
+            argc -= 2;
+            --i;
+        } else if (option == "--deferred" || option == "--visibility" || option == "--spans" || option == "--streaming" ||
+                   option == "--sync-present") {
+            if (option == "--spans")
+                spans = true;
+            else if (option == "--streaming")
+                streaming = true;
+            else if (option == "--sync-present")
+                syncPresent = true;
+            else
+                renderPath = option == "--deferred" ? RenderPath::Deferred : RenderPath::Visibility;
+            std::copy(argv + i + 1, argv + argc, argv + i);
+            --argc;
+            --i;
+        }
+    }
+
+    //more workers than hardware threads only take turns
+    if (jobs > hardwareThreads) {
+        std::cout << "--jobs " << jobs << " is more than the hardware threads, using " << hardwareThreads << std::endl;
+        jobs = hardwareThreads;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+        if (argc > 2 && std::string(argv[2]) == "present")
+            Benchmark::runPresent();
+        else
+            Benchmark::runAll();
+        return 0;
+    }
+
+    //Paint --cook <file.obj> <file.mesh> converts an OBJ file to the binary mesh format
+    if (argc > 3 && std::string(argv[1]) == "--cook") {
+        Vertex mesh;
+        if (!ObjLoader::load(argv[2], mesh)) {
+            std::cout << "could not open " << argv[2] << std::endl;
+            return 1;
+        }
+        if (!CookedMesh::cook(mesh, argv[3])) {
+            std::cout << "could not write " << argv[3] << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    //numbers of --stress are checked before the window opens, the scene is filled below
+    bool stress = argc > 3 && std::string(argv[1]) == "--stress";
+    unsigned int stressCount = 0;
+    unsigned int stressSubdivisions = 0;
+    unsigned int stressLights = 0;
+    if (stress && (!parseUnsigned(argv[2], stressCount) || !parseUnsigned(argv[3], stressSubdivisions) ||
+                   (argc > 4 && !parseUnsigned(argv[4], stressLights)))) {
+        printUsage();
+        return 1;
+    }
 
 //    Texture tex("../../src/texture.bmp");
 
 
     Screen screen(800, 600);
+    if (streaming && !screen.setPresentMode(PresentMode::Streaming))
+        std::cout << "no streaming textures, frames are copied with SDL_UpdateTexture" << std::endl;
+    if (!syncPresent && !screen.startPresentThread())
+        std::cout << "no renderer on the present thread, frames are presented on the main thread" << std::endl;
 
-    //regular icosahedron (20 sided die)
-    Vertex v;
-    float se = 200.0f;
-    float l = se * ((1.0f + sqrt(5.0f)) / 2.0f);
-
-    //12 vertices
-    //light green plane
-    v.positions.emplace_back(-se, -l, 0.0f, 1.0f); //l0
-    v.positions.emplace_back(se, -l, 0.0f, 1.0f); //l1
-    v.positions.emplace_back(se, l, 0.0f, 1.0f); //l2
-    v.positions.emplace_back(-se, l, 0.0f, 1.0f); //l3
-
-    //purple plane
-    v.positions.emplace_back(0.0f, -se, -l, 1.0f); //p0
-    v.positions.emplace_back(0.0f, se, -l, 1.0f); //p1
-    v.positions.emplace_back(0.0f, se, l, 1.0f); //p2
-    v.positions.emplace_back(0.0f, -se, l, 1.0f); //p3
-
-    //dark green plane
-    v.positions.emplace_back(-l, 0.0f, -se, 1.0f); //d0
-    v.positions.emplace_back(l, 0.0f, -se, 1.0f); //d1
-    v.positions.emplace_back(l, 0.0f, se, 1.0f); //d2
-    v.positions.emplace_back(-l, 0.0f, se, 1.0f); //d3
-
-    //20 faces
-    v.indices.emplace_back(0,11,7);
-    v.indices.emplace_back(11,6,7);
-    v.indices.emplace_back(0,7,1);
-    v.indices.emplace_back(7,6,10);
-    v.indices.emplace_back(7,10,1);
-    v.indices.emplace_back(0,1,4);
-    v.indices.emplace_back(4,1,9);
-    v.indices.emplace_back(1,10,9);
-    v.indices.emplace_back(10,2,9);
-    v.indices.emplace_back(6,2,10);
-
-    //top right cap (2)
-    v.indices.emplace_back(11,3,6);
-    v.indices.emplace_back(3,2,6);
-    //bottom left cap (3)
-    v.indices.emplace_back(0,4,8);
-    v.indices.emplace_back(8,4,5);
-    v.indices.emplace_back(4,9,5);
-
-    //reverse of center ring (5)
-    v.indices.emplace_back(0,8,11);
-    v.indices.emplace_back(5,9,2);
-
-    v.indices.emplace_back(11,8,3);
-    v.indices.emplace_back(8,5,3);
-    v.indices.emplace_back(3,5,2);
+    //regular icosahedron (20 sided die), half edge length 200
+    float phi = (1.0f + sqrt(5.0f)) / 2.0f;
+    Vertex v = MeshGenerator::makeIcosahedron(200.0f * sqrt(1.0f + phi * phi));
 
     //USING LEFT HAND COORDINATES (BUT I FUCKED UP AND WANTED TO USE RIGHT HAND)
     //create test entity
@@ -116,34 +185,114 @@ int main()
     vertex.indices.emplace_back(3,7,8);
 
 
-    //light source
-    Vertex lv;
-    Entity light(lv);
-
-
-    CoordinateTransformer ct(screen, &light);
+    CoordinateTransformer ct(screen);
     Camera camera(ct);
+    //the G-buffer and visibility passes read the depth plane
+    if (spans && renderPath != RenderPath::Forward) {
+        std::cout << "--spans draws forward, the deferred passes need the z-buffer" << std::endl;
+        renderPath = RenderPath::Forward;
+    }
+    if (spans)
+        screen.setHiddenSurface(HiddenSurface::SpanBuffer);
+    camera.setRenderPath(renderPath);
+    std::unique_ptr<JobSystem> jobSystem;
+    if (jobs > 0) {
+        jobSystem = std::make_unique<JobSystem>(jobs);
+        camera.setJobSystem(jobSystem.get());
+    }
+    //the deferred passes draw on the main thread
+    if (renderPath != RenderPath::Forward)
+        latency = 0;
+
+
+
+
+    Scene scene;
+    EntityId e = scene.add(Entity(vertex));
+    Entity icosahedron(v);
+    icosahedron.buildLods(2);
+    icosahedron.setOccluder(true);
+    EntityId e2 = scene.add(icosahedron);
+    EntityId e3 = scene.add(Entity(vertex));
+
+    scene.scaleBy(e, {0.0f, 1.0f, 0.0f});
+    scene.moveBy(e, {0.0f, s, 9000.0f});
+    scene.rotateBy(e, .8f);
+    scene.moveBy(e2, {-2000.5f, 0.0f, 8040.5f});
+    scene.rotateBy(e2, 3.14f/8.0f);
+    scene.moveBy(e3, {-2000.5f, 0.0f, 9900.5f});
+
+    //Paint --stress <entities> <subdivisions> [lights] fills the space in front of the camera with icospheres
+    //and optionally point lights between them
+    if (stress) {
+        AABB region;
+        region.min = {-6000.0f, -3000.0f, 2000.0f};
+        region.max = {6000.0f, 3000.0f, 20000.0f};
+        Vertex sphere = MeshGenerator::makeIcosphere(150.0f, stressSubdivisions);
+        EntityId first = MeshGenerator::populateScene(scene, sphere, stressCount, region, 1);
+        Material smooth;
+        smooth.shading = ShadingMode::Gouraud;
+        for (EntityId id = first; id < first + stressCount; ++id)
+            scene.setMaterial(id, smooth);
+
+        //finely tessellated floor below the spheres to catch their shadows (lighting is per vertex)
+        Entity floor(MeshGenerator::makeGrid(region.max.x - region.min.x, region.max.z - region.min.z, 120, 160));
+        floor.moveTo({0.0f, region.min.y - 400.0f, (region.min.z + region.max.z) * 0.5f});
+        floor.setMaterial(smooth);
+        scene.add(floor);
+
+        std::mt19937 rng(2);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (unsigned int k = 0; k < stressLights; ++k) {
+            Vec3 position = {region.min.x + (region.max.x - region.min.x) * unit(rng),
+                             region.min.y + (region.max.y - region.min.y) * unit(rng),
+                             region.min.z + (region.max.z - region.min.z) * unit(rng)};
+            scene.addLight(Light::point(position, 3000.0f, 0.8f));
+        }
+    }
 
+    //Paint --obj <file> or --mesh <file> adds a Wavefront OBJ or cooked mesh in front of the camera, scaled to a fixed size
+    if (argc > 2 && (std::string(argv[1]) == "--obj" || std::string(argv[1]) == "--mesh")) {
+        Vertex mesh;
+        ObjStats stats;
+        std::shared_ptr<CookedMesh> cooked = std::make_shared<CookedMesh>();
+        bool isCooked = std::string(argv[1]) == "--mesh";
+        if (isCooked ? cooked->open(argv[2]) : ObjLoader::load(argv[2], mesh, &stats)) {
+            if (!isCooked)
+                std::cout << argv[2] << ": " << stats.toString() << std::endl;
+            //a cooked mesh stays mapped and is drawn from there
+            Entity model = isCooked ? Entity(cooked) : Entity(std::move(mesh));
+            BoundingSphere sphere = model.getBoundingSphere();
+            float scale = sphere.radius > 0.0f ? 1000.0f / sphere.radius : 1.0f;
+            model.setScale({scale, scale, scale});
+            model.moveTo(Vec3(0.0f, 0.0f, 6000.0f) - sphere.center * scale);
+            Material smooth;
+            smooth.shading = ShadingMode::Gouraud;
+            model.setMaterial(smooth);
+            scene.add(model);
+        } else {
+            std::cout << "could not open " << argv[2] << std::endl;
+        }
+    }
+    //sun shining down and away from the camera
+    Light sunLight = Light::directional({-1000.0f, -1000.0f, 1000.0f});
+    sunLight.castsShadows = true;
+    LightId sun = scene.addLight(sunLight);
 
-
-
-    Entity e(vertex);
-    Entity e2(v);
-    Entity e3(vertex);
-
-    e.scaleBy({0.0f, 1.0f, 0.0f});
-    e.moveBy({0.0f, s, 9000.0f});
-    e.rotateBy(.8f);
-    e2.moveBy({-2000.5f, 0.0f, 8040.5f});
-    e2.rotateBy(3.14f/8.0f);
-    e3.moveBy({-2000.5f, 0.0f, 9900.5f});
-    light.moveBy({1000.0f, 1000.0f, -1000.0f});
+    //recording and raster overlap from here on, the screen belongs to the raster thread except for input and presentation
+    std::unique_ptr<FramePipeline> pipeline;
+    if (latency > 0)
+        pipeline = std::make_unique<FramePipeline>(screen, latency, 0x000000ff);
 
     bool play = true;
     while (play)
     {
-        screen.setColor(0, 0, 0);
-        screen.clear();
+        if (!pipeline)
+        {
+            screen.setColor(0, 0, 0);
+            screen.clear();
+        }
+        camera.beginFrame();
 
         screen.processEvents();
         while (screen.hasEvents())
@@ -191,28 +340,37 @@ int main()
                 camera.moveBy({0.01f, 0.0f, 0.0f});
                 break;
             case Input::CameraZoomIn: 
-                light.moveBy({-10.0f, 0.0f, 0.0f});
-                break;
             case Input::CameraZoomOut:
-                light.moveBy({10.0f, 0.0f, 0.0f});
+            {
+                Light light = scene.getLight(sun);
+                light.direction.x += input == Input::CameraZoomIn ? 10.0f : -10.0f;
+                scene.setLight(sun, light);
                 break;
+            }
             case Input::CameraRotateCW:
 //                light.moveBy({0.0f, 0.0f, 10.0f});
-                e2.rotateBy(.1f);
+                scene.rotateBy(e2, .1f);
                 break;
             case Input::CameraRotateCCW:
  //               light.moveBy({0.0f, 0.0f, -10.0f});
-                e2.rotateBy(-.1f);
+                scene.rotateBy(e2, -.1f);
                 break;
             }
         }
 
+        if (pipeline)
+        {
+            camera.setDrawList(&pipeline->beginFrame());
+            camera.draw(scene);
+            camera.setDrawList(nullptr);
+            pipeline->submit(camera.getStats());
+            screen.setTitle(pipeline->getPresentedStats().toString());
+            continue;
+        }
+
         screen.setColor(255, 255, 255);
 
-        camera.draw(e.getDrawable());
-        camera.draw(e2.getDrawable());
-        camera.draw(e3.getDrawable());
-        camera.draw(light.getDrawable());
+        camera.draw(scene);
 
 
 
@@ -220,9 +378,14 @@ int main()
 
 
 
+        FrameStats stats = camera.getStats();
+        stats.pacing = screen.getPresentPacing();
+        screen.setTitle(stats.toString());
         screen.render();
     }
 
+    if (pipeline)
+        pipeline->finish();
     screen.close();
     return 0;
 }
\ No newline at end of file
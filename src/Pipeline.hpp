@@ -0,0 +1,207 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <algorithm>
+#include "Math.hpp"
+#include "Vertex.hpp"
+#include "Rasterizer.hpp"
+
+namespace paint {
+
+//per vertex values handed from the vertex shader to the pixel shader, interpolated across the triangle
+template<unsigned int N>
+struct Varyings
+{
+    static constexpr unsigned int COUNT = N;
+    float v[N > 0 ? N : 1];
+};
+
+//color and depth planes a pipeline draws into, rows are width pixels apart
+struct RenderTarget
+{
+    uint32_t* color;
+    float* depth;
+    int width;
+    RasterRect rect; //triangles are clipped to it
+    unsigned int pixelsWritten; //pixels that passed the depth test
+};
+
+//depth modes, static so the test folds into the raster loop
+struct DepthTestWrite
+{
+    static constexpr bool WRITE = true;
+    static bool test(float z, float stored) { return z < stored; }
+};
+
+//tested against opaque geometry but leaves depth untouched (translucent surfaces)
+struct DepthTestOnly
+{
+    static constexpr bool WRITE = false;
+    static bool test(float z, float stored) { return z < stored; }
+};
+
+struct DepthAlways
+{
+    static constexpr bool WRITE = false;
+    static bool test(float, float) { return true; }
+};
+
+//blend modes, colors are RGBA8888
+struct BlendReplace
+{
+    uint32_t operator()(uint32_t source, uint32_t) const { return source; }
+};
+
+//source over destination with a constant alpha in [0, 256]
+struct BlendAlpha
+{
+    uint32_t alpha;
+
+    uint32_t operator()(uint32_t source, uint32_t destination) const {
+        //red/blue and green/alpha bytes are blended two at a time
+        const uint32_t mask = 0x00ff00ff;
+        uint32_t inverse = 256 - alpha;
+        uint32_t rb = (((source >> 8) & mask) * alpha + ((destination >> 8) & mask) * inverse) & ~mask;
+        uint32_t ga = ((source & mask) * alpha + (destination & mask) * inverse) >> 8 & mask;
+        return rb | ga;
+    }
+};
+
+//programmable raster stage, shaders are functors resolved at compile time and inlined into the span loop
+//  VertexShader: typedef Varyings<N> Output;
+//                Vec3 operator()(const Vertex& buffer, unsigned int triangle, unsigned int vertex, Output& out) const
+//                returns the screen position (x, y in pixels, z depth) of one corner and fills its varyings
+//  PixelShader:  uint32_t operator()(const Output& in, unsigned int pixel) const, color of one pixel from
+//                interpolated varyings, pixel indexes the target planes for shaders that write planes of their own
+//varyings are interpolated linearly in screen space like depth, stepped by their x gradient along a span
+template<typename VertexShader, typename PixelShader, typename DepthMode = DepthTestWrite, typename BlendMode = BlendReplace>
+class Pipeline {
+public:
+    typedef typename VertexShader::Output Output;
+    static constexpr unsigned int N = Output::COUNT;
+private:
+    VertexShader m_vertexShader;
+    PixelShader m_pixelShader;
+    BlendMode m_blend;
+public:
+    Pipeline(const VertexShader& vertexShader, const PixelShader& pixelShader, const BlendMode& blend = BlendMode()) :
+        m_vertexShader(vertexShader), m_pixelShader(pixelShader), m_blend(blend) {};
+
+    //every triangle of buffer without its cull flag, positions already in screen space
+    void draw(const Vertex& buffer, RenderTarget& target) const {
+        for (unsigned int k = 0; k < buffer.indices.size(); ++k) {
+            if (buffer.cullFlags[k])
+                continue;
+            const Index& i = buffer.indices[k];
+            Output corners[3];
+            Vec3 a = m_vertexShader(buffer, k, i.x, corners[0]);
+            Vec3 b = m_vertexShader(buffer, k, i.y, corners[1]);
+            Vec3 c = m_vertexShader(buffer, k, i.z, corners[2]);
+            rasterize(a, b, c, corners, target);
+        }
+    }
+
+    //one screen space triangle with already shaded corners
+    void rasterize(const Vec3& a, const Vec3& b, const Vec3& c, const Output* corners, RenderTarget& target) const {
+        TriangleSetup t;
+        if (!t.setup(a, b, c))
+            return;
+
+        Output top, ddx, ddy;
+        for (unsigned int n = 0; n < N; ++n) {
+            top.v[n] = corners[t.order[0]].v[n];
+            t.gradient(top.v[n], corners[t.order[1]].v[n], corners[t.order[2]].v[n], ddx.v[n], ddy.v[n]);
+        }
+
+        unsigned int written = 0;
+        scanTriangle(t, target.rect, [&](int y, int xStart, int xEnd) {
+            float yc = float(y) + 0.5f;
+            float z = t.valueAt(t.top->z, t.dzdx, t.dzdy, xStart, yc);
+            Output in;
+            for (unsigned int n = 0; n < N; ++n)
+                in.v[n] = t.valueAt(top.v[n], ddx.v[n], ddy.v[n], xStart, yc);
+            unsigned int row = y * target.width;
+            uint32_t* colorRow = target.color + row;
+            float* depthRow = target.depth + row;
+            for (int x = xStart; x < xEnd; ++x) {
+                if (DepthMode::test(z, depthRow[x])) {
+                    if (DepthMode::WRITE)
+                        depthRow[x] = z;
+                    colorRow[x] = m_blend(m_pixelShader(in, row + x), colorRow[x]);
+                    ++written;
+                }
+                z += t.dzdx;
+                for (unsigned int n = 0; n < N; ++n)
+                    in.v[n] += ddx.v[n];
+            }
+        });
+        target.pixelsWritten += written;
+    }
+};
+
+//the depth mode can not be deduced from the arguments
+template<typename DepthMode = DepthTestWrite, typename VertexShader, typename PixelShader, typename BlendMode = BlendReplace>
+Pipeline<VertexShader, PixelShader, DepthMode, BlendMode> makePipeline(const VertexShader& vertexShader, const PixelShader& pixelShader,
+                                                                       const BlendMode& blend = BlendMode())
+{
+    return Pipeline<VertexShader, PixelShader, DepthMode, BlendMode>(vertexShader, pixelShader, blend);
+}
+
+//stock shaders
+
+//screen position only
+struct PositionShader
+{
+    typedef Varyings<0> Output;
+
+    Vec3 operator()(const Vertex& buffer, unsigned int, unsigned int vertex, Output&) const {
+        const Vec4& p = buffer.positions[vertex];
+        return {p.x, p.y, p.z};
+    }
+};
+
+//gray level (0 - 255) of the whole triangle from its flat shading level
+struct FaceGrayShader
+{
+    typedef Varyings<1> Output;
+
+    Vec3 operator()(const Vertex& buffer, unsigned int triangle, unsigned int vertex, Output& out) const {
+        out.v[0] = 230.0f * buffer.shadingLevel[triangle] + 25.0f;
+        const Vec4& p = buffer.positions[vertex];
+        return {p.x, p.y, p.z};
+    }
+};
+
+//gray level (0 - 255) per corner from the Gouraud vertex light
+struct VertexGrayShader
+{
+    typedef Varyings<1> Output;
+
+    Vec3 operator()(const Vertex& buffer, unsigned int, unsigned int vertex, Output& out) const {
+        out.v[0] = 230.0f * buffer.vertexLight[vertex] + 25.0f;
+        const Vec4& p = buffer.positions[vertex];
+        return {p.x, p.y, p.z};
+    }
+};
+
+struct SolidColorShader
+{
+    uint32_t color;
+
+    template<typename Input>
+    uint32_t operator()(const Input&, unsigned int) const { return color; }
+};
+
+//opaque gray from the first varying, clamped since pixel centers can be slightly outside the corners
+struct GrayShader
+{
+    uint32_t operator()(const Varyings<1>& in, unsigned int) const {
+        uint32_t g = uint32_t(std::min(std::max(in.v[0], 0.0f), 255.0f));
+        return g << 24 | g << 16 | g << 8 | 0xff;
+    }
+};
+
+}
+
+#endif //PIPELINE_H
@@ -0,0 +1,134 @@
+#ifndef RASTERIZER_H
+#define RASTERIZER_H
+
+#include <math.h>
+#include <algorithm>
+#include "Math.hpp"
+
+namespace paint {
+
+//pixels [x0, x1) x [y0, y1) a triangle is clipped to
+struct RasterRect
+{
+    int x0;
+    int y0;
+    int x1;
+    int y1;
+};
+
+//screen space triangle (x, y in pixels, z depth) prepared for the scanline rasterizer:
+//corners sorted top to bottom and the depth plane
+struct TriangleSetup
+{
+    const Vec3* top;
+    const Vec3* mid;
+    const Vec3* bot;
+    unsigned int order[3]; //input corner of top, mid and bot
+    float area; //twice the signed area, positive if mid is right of the long edge (top to bot)
+    float invArea;
+    float dzdx;
+    float dzdy;
+
+    //false for triangles too thin to cover a pixel center
+    bool setup(const Vec3& vec1, const Vec3& vec2, const Vec3& vec3) {
+        top = &vec1;
+        mid = &vec2;
+        bot = &vec3;
+        order[0] = 0;
+        order[1] = 1;
+        order[2] = 2;
+
+        //check to swap top and mid
+        if (top->y > mid->y) {
+            std::swap(top, mid);
+            std::swap(order[0], order[1]);
+        }
+
+        //check to swap mid and bot
+        if (mid->y > bot->y) {
+            std::swap(mid, bot);
+            std::swap(order[1], order[2]);
+
+            //check if top and mid need to be swapped after mid/bottom swap
+            if (top->y > mid->y) {
+                std::swap(top, mid);
+                std::swap(order[0], order[1]);
+            }
+        }
+
+        area = (mid->x - top->x) * (bot->y - top->y) - (bot->x - top->x) * (mid->y - top->y);
+        if (fabs(area) < 0.0001f)
+            return false;
+
+        //depth gradients (z is linear in screen space after the perspective divide)
+        invArea = 1.0f / area;
+        gradient(top->z, mid->z, bot->z, dzdx, dzdy);
+        return true;
+    }
+
+    //screen space gradient of an attribute given at the sorted corners
+    void gradient(float atTop, float atMid, float atBot, float& ddx, float& ddy) const {
+        ddx = ((atMid - atTop) * (bot->y - top->y) - (atBot - atTop) * (mid->y - top->y)) * invArea;
+        ddy = ((atBot - atTop) * (mid->x - top->x) - (atMid - atTop) * (bot->x - top->x)) * invArea;
+    }
+
+    //attribute at the center of pixel x on the row with center yc
+    float valueAt(float atTop, float ddx, float ddy, int x, float yc) const {
+        return atTop + (float(x) + 0.5f - top->x) * ddx + (yc - top->y) * ddy;
+    }
+};
+
+//walks the rows of a set up triangle with top-left fill convention (pixel centers at +0.5)
+//and calls span(y, xStart, xEnd) for every row with covered pixel centers inside rect
+//row and span bounds are clamped during setup, so spans need no bounds checks
+template<typename Span>
+void scanTriangle(const TriangleSetup& t, const RasterRect& rect, Span&& span)
+{
+    const Vec3* top = t.top;
+    const Vec3* mid = t.mid;
+    const Vec3* bot = t.bot;
+
+    int yStart = std::max(int(ceil(top->y - 0.5f)), rect.y0);
+    int yEnd = std::min(int(ceil(bot->y - 0.5f)), rect.y1);
+
+    float longSlope = (bot->x - top->x) / (bot->y - top->y);
+    float topSlope = mid->y > top->y ? (mid->x - top->x) / (mid->y - top->y) : 0.0f;
+    float botSlope = bot->y > mid->y ? (bot->x - mid->x) / (bot->y - mid->y) : 0.0f;
+
+    for (int y = yStart; y < yEnd; ++y)
+    {
+        float yc = float(y) + 0.5f;
+        float xLong = top->x + (yc - top->y) * longSlope;
+        float xShort = yc < mid->y ? top->x + (yc - top->y) * topSlope : mid->x + (yc - mid->y) * botSlope;
+
+        float xLeft = t.area > 0.0f ? xLong : xShort;
+        float xRight = t.area > 0.0f ? xShort : xLong;
+
+        int xStart = std::max(int(ceil(xLeft - 0.5f)), rect.x0);
+        int xEnd = std::min(int(ceil(xRight - 0.5f)), rect.x1);
+        if (xStart < xEnd)
+            span(y, xStart, xEnd);
+    }
+}
+
+//depth only fast path: keeps the nearest depth per pixel, no color, no counters
+//depth rows are stride floats apart
+inline void rasterizeDepth(const Vec3& a, const Vec3& b, const Vec3& c, float* depth, int stride, const RasterRect& rect)
+{
+    TriangleSetup t;
+    if (!t.setup(a, b, c))
+        return;
+    scanTriangle(t, rect, [&](int y, int xStart, int xEnd) {
+        float z = t.valueAt(t.top->z, t.dzdx, t.dzdy, xStart, float(y) + 0.5f);
+        float* row = depth + y * stride;
+        for (int x = xStart; x < xEnd; ++x)
+        {
+            row[x] = std::min(row[x], z);
+            z += t.dzdx;
+        }
+    });
+}
+
+}
+
+#endif //RASTERIZER_H
@@ -0,0 +1,148 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <stdint.h>
+#include <math.h>
+#include <assert.h>
+#include <vector>
+#include <algorithm>
+#include "Math.hpp"
+#include "Material.hpp"
+#include "Scene.hpp"
+
+namespace paint {
+
+struct DrawCommand
+{
+    uint64_t key;
+    EntityId entity;
+    Material material;
+};
+
+//collects the draws of a frame and orders them by a 64 bit sort key:
+//  opaque:      0 | depth band (8) | state (16) | depth (39)   front to back, state batched within a band
+//  translucent: 1 | inverted depth (39) | state (16) | 0 (8)   back to front, state only breaks ties
+//opaque draws go first so translucent ones blend over a finished depth buffer
+//equal keys are ordered by entity, so the order does not depend on how the draws were submitted
+//several threads can record draws at once, each into a command buffer of its own, merged at the end of the frame
+class RenderQueue {
+public:
+    //draws recorded by one thread, owned by it until merge() so recording takes no lock
+    class CommandBuffer {
+    private:
+        friend class RenderQueue;
+        std::vector<DrawCommand> m_commands; //capacity is kept between frames
+    public:
+        unsigned int size() const {
+            return m_commands.size();
+        }
+
+        //by key, so merge() only has to interleave, the recording thread can do it
+        void sort() {
+            std::sort(m_commands.begin(), m_commands.end(), isBefore);
+        }
+    };
+private:
+    static constexpr unsigned int DEPTH_BITS = 39;
+    static constexpr unsigned int BAND_BITS = 8;
+    static constexpr unsigned int STATE_BITS = 16;
+    static constexpr uint64_t TRANSLUCENT_BIT = uint64_t(1) << 63;
+
+    std::vector<DrawCommand> m_commands;
+    std::vector<DrawCommand> m_merged; //scratch for merge()
+    float m_near;
+    float m_far;
+public:
+    //keys are quantized over the view depth range of the projection (z' = a * z + b, w' = z)
+    RenderQueue(const Mat4& projection) :
+            m_near(-projection.fourthCol.z / projection.thirdCol.z),
+            m_far(projection.fourthCol.z / (1.0f - projection.thirdCol.z)) {};
+
+    void clear() {
+        m_commands.clear();
+    }
+
+    //viewDepth is the view space z of the entity (distance along the view direction)
+    void submit(EntityId entity, const Material& material, float viewDepth) {
+        m_commands.push_back({makeKey(material, viewDepth), entity, material});
+    }
+
+    //as submit(), into buffer, only reads the queue
+    void record(CommandBuffer& buffer, EntityId entity, const Material& material, float viewDepth) const {
+        buffer.m_commands.push_back({makeKey(material, viewDepth), entity, material});
+    }
+
+    void sort() {
+        std::sort(m_commands.begin(), m_commands.end(), isBefore);
+    }
+
+    //sorts the queue and merges the sorted buffers into it, which are left empty
+    //after all recording threads are done, the result is the same however the draws were spread over the buffers
+    void merge(std::vector<CommandBuffer>& buffers) {
+        sort();
+        size_t total = m_commands.size();
+        for (const CommandBuffer& buffer : buffers) {
+            assert(std::is_sorted(buffer.m_commands.begin(), buffer.m_commands.end(), isBefore));
+            total += buffer.m_commands.size();
+        }
+        m_merged.clear();
+        m_merged.reserve(total);
+        //the next command of every run, one run per buffer and one for the queue, few enough for a linear search
+        std::vector<std::pair<const DrawCommand*, const DrawCommand*>> runs;
+        runs.reserve(buffers.size() + 1);
+        runs.push_back({m_commands.data(), m_commands.data() + m_commands.size()});
+        for (const CommandBuffer& buffer : buffers)
+            runs.push_back({buffer.m_commands.data(), buffer.m_commands.data() + buffer.m_commands.size()});
+        while (m_merged.size() < total) {
+            unsigned int first = runs.size();
+            for (unsigned int k = 0; k < runs.size(); ++k) {
+                if (runs[k].first != runs[k].second && (first == runs.size() || isBefore(*runs[k].first, *runs[first].first)))
+                    first = k;
+            }
+            m_merged.push_back(*runs[first].first++);
+        }
+        m_commands.swap(m_merged);
+        for (CommandBuffer& buffer : buffers)
+            buffer.m_commands.clear();
+    }
+
+    std::vector<DrawCommand>::const_iterator begin() const {
+        return m_commands.begin();
+    }
+
+    std::vector<DrawCommand>::const_iterator end() const {
+        return m_commands.end();
+    }
+
+    unsigned int size() const {
+        return m_commands.size();
+    }
+
+    uint64_t makeKey(const Material& material, float viewDepth) const {
+        uint64_t depth = quantizeDepth(viewDepth);
+        uint64_t state = material.getStateKey() & ((1u << STATE_BITS) - 1);
+        if (material.isTranslucent()) {
+            uint64_t inverted = ((uint64_t(1) << DEPTH_BITS) - 1) - depth;
+            return TRANSLUCENT_BIT | inverted << (STATE_BITS + BAND_BITS) | state << BAND_BITS;
+        }
+        uint64_t band = depth >> (DEPTH_BITS - BAND_BITS);
+        return band << (STATE_BITS + DEPTH_BITS) | state << DEPTH_BITS | depth;
+    }
+
+private:
+    static bool isBefore(const DrawCommand& a, const DrawCommand& b) {
+        return a.key < b.key || (a.key == b.key && a.entity < b.entity);
+    }
+
+    //logarithmic in depth so bands cover the same relative distance near and far
+    uint64_t quantizeDepth(float viewDepth) const {
+        float t = 0.0f;
+        if (viewDepth > m_near)
+            t = std::min(float(log(viewDepth / m_near) / log(m_far / m_near)), 1.0f);
+        return uint64_t(double(t) * double((uint64_t(1) << DEPTH_BITS) - 1));
+    }
+};
+
+}
+
+#endif //RENDERQUEUE_H
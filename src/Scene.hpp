@@ -0,0 +1,384 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <vector>
+#include <algorithm>
+#include "Math.hpp"
+#include "Bounds.hpp"
+#include "Entity.hpp"
+#include "Light.hpp"
+
+namespace paint {
+
+typedef unsigned int EntityId;
+
+//owns entities and keeps a dynamic AABB tree (bounding volume hierarchy) over their world bounds
+//leaves store loose (fattened) boxes, so small moves only touch the tree when an entity leaves its box
+class Scene {
+private:
+    static constexpr int NULL_NODE = -1;
+    static constexpr float LOOSE_MARGIN = 0.1f; //fraction of the largest box extent added to leaf boxes
+
+    struct Node {
+        AABB box;
+        int parent = NULL_NODE;
+        int left = NULL_NODE;
+        int right = NULL_NODE; //left is NULL_NODE for leaves
+        int height = 0; //leaves are 0, -1 for free nodes
+        EntityId entity = 0;
+
+        bool isLeaf() const {
+            return left == NULL_NODE;
+        }
+    };
+
+    std::vector<Entity> m_entities; //EntityId is the index
+    std::vector<int> m_leaves; //leaf node of each entity
+    std::vector<Node> m_nodes;
+    std::vector<int> m_freeNodes;
+    int m_root;
+    std::vector<Light> m_lights; //world space, LightId is the index
+public:
+    Scene() : m_root(NULL_NODE) {};
+
+    EntityId add(const Entity& entity) {
+        EntityId id = m_entities.size();
+        m_entities.push_back(entity);
+
+        int leaf = allocateNode();
+        m_nodes.at(leaf).box = getLooseBounds(getWorldBounds(id));
+        m_nodes.at(leaf).entity = id;
+        m_leaves.push_back(leaf);
+        insertLeaf(leaf);
+        return id;
+    }
+
+    const Entity& get(EntityId id) const {
+        return m_entities.at(id);
+    }
+
+    unsigned int size() const {
+        return m_entities.size();
+    }
+
+    //entity transforms go through the scene so the hierarchy stays up to date
+    void setScale(EntityId id, Vec3 scale) {
+        m_entities.at(id).setScale(scale);
+        refit(id);
+    }
+
+    void scaleBy(EntityId id, Vec3 scale) {
+        m_entities.at(id).scaleBy(scale);
+        refit(id);
+    }
+
+    void rotateTo(EntityId id, float angle) {
+        m_entities.at(id).rotateTo(angle);
+        refit(id);
+    }
+
+    void rotateBy(EntityId id, float angle) {
+        m_entities.at(id).rotateBy(angle);
+        refit(id);
+    }
+
+    void moveTo(EntityId id, Vec3 position) {
+        m_entities.at(id).moveTo(position);
+        refit(id);
+    }
+
+    void moveBy(EntityId id, Vec3 translation) {
+        m_entities.at(id).moveBy(translation);
+        refit(id);
+    }
+
+    void setOccluder(EntityId id, bool isOccluder) {
+        m_entities.at(id).setOccluder(isOccluder);
+    }
+
+    void setMaterial(EntityId id, const Material& material) {
+        m_entities.at(id).setMaterial(material);
+    }
+
+    LightId addLight(const Light& light) {
+        m_lights.push_back(light);
+        return m_lights.size() - 1;
+    }
+
+    void setLight(LightId id, const Light& light) {
+        m_lights.at(id) = light;
+    }
+
+    const Light& getLight(LightId id) const {
+        return m_lights.at(id);
+    }
+
+    const std::vector<Light>& getLights() const {
+        return m_lights;
+    }
+
+    //level of detail is render state, it does not change the bounds
+    unsigned int selectLod(EntityId id, float screenSize) {
+        return m_entities.at(id).selectLod(screenSize);
+    }
+
+    AABB getWorldBounds(EntityId id) const {
+        const Entity& entity = m_entities.at(id);
+        return transformAABB(entity.getAABB(), entity.getModelMatrix());
+    }
+
+    //same sphere then box test Camera does for a single entity, in world space
+    bool isVisible(const Frustum& frustum, EntityId id) const {
+        const Entity& entity = m_entities.at(id);
+        Mat4 model = entity.getModelMatrix();
+        if (!frustum.intersects(transformBoundingSphere(entity.getBoundingSphere(), model)))
+            return false;
+        return frustum.intersects(transformAABB(entity.getAABB(), model));
+    }
+
+    //world space bounds of the whole scene (loose)
+    AABB getBounds() const {
+        return m_root == NULL_NODE ? AABB() : m_nodes.at(m_root).box;
+    }
+
+    //appends entities whose world bounds intersect the frustum (planes in world space)
+    //subtrees fully inside the frustum are collected without further plane tests
+    //returns the number of tree nodes visited
+    unsigned int query(const Frustum& frustum, std::vector<EntityId>& visible) const {
+        if (m_root == NULL_NODE)
+            return 0;
+
+        unsigned int visited = 0;
+        int stack[64];
+        int top = 0;
+        stack[top++] = m_root;
+        while (top > 0) {
+            const Node& node = m_nodes[stack[--top]];
+            ++visited;
+
+            Containment c = frustum.classify(node.box);
+            if (c == Containment::Outside)
+                continue;
+
+            if (node.isLeaf()) {
+                //loose box intersects, test the tight volumes
+                if (c == Containment::Inside || isVisible(frustum, node.entity))
+                    visible.push_back(node.entity);
+            } else if (c == Containment::Inside) {
+                collectLeaves(node.left, visible);
+                collectLeaves(node.right, visible);
+            } else {
+                assert(top + 2 <= 64);
+                stack[top++] = node.left;
+                stack[top++] = node.right;
+            }
+        }
+        return visited;
+    }
+
+private:
+    //update leaf after the entity changed, reinsert only if it left its loose box
+    void refit(EntityId id) {
+        int leaf = m_leaves.at(id);
+        AABB bounds = getWorldBounds(id);
+        if (m_nodes.at(leaf).box.contains(bounds))
+            return;
+
+        removeLeaf(leaf);
+        m_nodes.at(leaf).box = getLooseBounds(bounds);
+        insertLeaf(leaf);
+    }
+
+    static AABB getLooseBounds(const AABB& box) {
+        if (box.isEmpty())
+            return box;
+        Vec3 e = box.extents();
+        float margin = LOOSE_MARGIN * std::max(e.x, std::max(e.y, e.z));
+        AABB ret;
+        ret.min = box.min - Vec3(margin, margin, margin);
+        ret.max = box.max + Vec3(margin, margin, margin);
+        return ret;
+    }
+
+    void collectLeaves(int index, std::vector<EntityId>& visible) const {
+        const Node& node = m_nodes[index];
+        if (node.isLeaf()) {
+            visible.push_back(node.entity);
+            return;
+        }
+        collectLeaves(node.left, visible);
+        collectLeaves(node.right, visible);
+    }
+
+    int allocateNode() {
+        if (!m_freeNodes.empty()) {
+            int index = m_freeNodes.back();
+            m_freeNodes.pop_back();
+            m_nodes.at(index) = Node();
+            return index;
+        }
+        m_nodes.emplace_back();
+        return m_nodes.size() - 1;
+    }
+
+    void freeNode(int index) {
+        m_nodes.at(index).height = -1;
+        m_freeNodes.push_back(index);
+    }
+
+    //find the cheapest sibling by perimeter increase and pair the leaf with it
+    void insertLeaf(int leaf) {
+        if (m_root == NULL_NODE) {
+            m_root = leaf;
+            m_nodes.at(leaf).parent = NULL_NODE;
+            return;
+        }
+
+        AABB leafBox = m_nodes.at(leaf).box;
+        int index = m_root;
+        while (!m_nodes.at(index).isLeaf()) {
+            const Node& node = m_nodes.at(index);
+            float area = node.box.perimeter();
+            float combinedArea = AABB::merge(node.box, leafBox).perimeter();
+
+            //cost of creating a new parent for this node and the leaf
+            float cost = 2.0f * combinedArea;
+            //minimum cost of pushing the leaf further down the tree
+            float inheritanceCost = 2.0f * (combinedArea - area);
+
+            float leftCost = getDescendCost(node.left, leafBox) + inheritanceCost;
+            float rightCost = getDescendCost(node.right, leafBox) + inheritanceCost;
+
+            if (cost < leftCost && cost < rightCost)
+                break;
+
+            index = leftCost < rightCost ? node.left : node.right;
+        }
+
+        int sibling = index;
+        int oldParent = m_nodes.at(sibling).parent;
+        int newParent = allocateNode();
+        m_nodes.at(newParent).parent = oldParent;
+        m_nodes.at(newParent).box = AABB::merge(leafBox, m_nodes.at(sibling).box);
+        m_nodes.at(newParent).height = m_nodes.at(sibling).height + 1;
+        m_nodes.at(newParent).left = sibling;
+        m_nodes.at(newParent).right = leaf;
+        m_nodes.at(sibling).parent = newParent;
+        m_nodes.at(leaf).parent = newParent;
+
+        if (oldParent == NULL_NODE) {
+            m_root = newParent;
+        } else if (m_nodes.at(oldParent).left == sibling) {
+            m_nodes.at(oldParent).left = newParent;
+        } else {
+            m_nodes.at(oldParent).right = newParent;
+        }
+
+        refitAncestors(m_nodes.at(leaf).parent);
+    }
+
+    float getDescendCost(int index, const AABB& leafBox) const {
+        const Node& node = m_nodes.at(index);
+        float combined = AABB::merge(leafBox, node.box).perimeter();
+        return node.isLeaf() ? combined : combined - node.box.perimeter();
+    }
+
+    void removeLeaf(int leaf) {
+        if (leaf == m_root) {
+            m_root = NULL_NODE;
+            return;
+        }
+
+        int parent = m_nodes.at(leaf).parent;
+        int grandParent = m_nodes.at(parent).parent;
+        int sibling = m_nodes.at(parent).left == leaf ? m_nodes.at(parent).right : m_nodes.at(parent).left;
+
+        if (grandParent == NULL_NODE) {
+            m_root = sibling;
+            m_nodes.at(sibling).parent = NULL_NODE;
+            freeNode(parent);
+            return;
+        }
+
+        if (m_nodes.at(grandParent).left == parent)
+            m_nodes.at(grandParent).left = sibling;
+        else
+            m_nodes.at(grandParent).right = sibling;
+        m_nodes.at(sibling).parent = grandParent;
+        freeNode(parent);
+
+        refitAncestors(grandParent);
+    }
+
+    //walk to the root fixing boxes and heights, rebalancing on the way
+    void refitAncestors(int index) {
+        while (index != NULL_NODE) {
+            index = balance(index);
+
+            Node& node = m_nodes.at(index);
+            const Node& left = m_nodes.at(node.left);
+            const Node& right = m_nodes.at(node.right);
+            node.height = 1 + std::max(left.height, right.height);
+            node.box = AABB::merge(left.box, right.box);
+
+            index = node.parent;
+        }
+    }
+
+    //rotate a grandchild up if the subtree of a is unbalanced, returns the new subtree root
+    int balance(int a) {
+        Node& nodeA = m_nodes.at(a);
+        if (nodeA.isLeaf() || nodeA.height < 2)
+            return a;
+
+        int b = nodeA.left;
+        int c = nodeA.right;
+        int difference = m_nodes.at(c).height - m_nodes.at(b).height;
+
+        if (difference > 1)
+            return rotateUp(a, c, b);
+        if (difference < -1)
+            return rotateUp(a, b, c);
+        return a;
+    }
+
+    //child is the taller child of a, other is the remaining child
+    int rotateUp(int a, int child, int other) {
+        Node& nodeA = m_nodes.at(a);
+        Node& nodeChild = m_nodes.at(child);
+        int f = nodeChild.left;
+        int g = nodeChild.right;
+
+        //swap a and child
+        nodeChild.parent = nodeA.parent;
+        nodeA.parent = child;
+        if (nodeChild.parent == NULL_NODE) {
+            m_root = child;
+        } else if (m_nodes.at(nodeChild.parent).left == a) {
+            m_nodes.at(nodeChild.parent).left = child;
+        } else {
+            m_nodes.at(nodeChild.parent).right = child;
+        }
+
+        //the taller grandchild stays under child, the shorter one moves to a
+        int keep = m_nodes.at(f).height > m_nodes.at(g).height ? f : g;
+        int move = keep == f ? g : f;
+        nodeChild.left = a;
+        nodeChild.right = keep;
+        nodeA.left = other;
+        nodeA.right = move;
+        m_nodes.at(move).parent = a;
+        m_nodes.at(keep).parent = child;
+        m_nodes.at(other).parent = a;
+
+        nodeA.box = AABB::merge(m_nodes.at(other).box, m_nodes.at(move).box);
+        nodeA.height = 1 + std::max(m_nodes.at(other).height, m_nodes.at(move).height);
+        nodeChild.box = AABB::merge(nodeA.box, m_nodes.at(keep).box);
+        nodeChild.height = 1 + std::max(nodeA.height, m_nodes.at(keep).height);
+        return child;
+    }
+};
+
+}
+
+#endif //SCENE_H
@@ -2,6 +2,8 @@
 #include <memory>
 #include <assert.h>
 #include <limits>
+#include <algorithm>
+#include <math.h>
 
 namespace paint
 {
@@ -11,12 +13,37 @@ namespace paint
 Screen::Screen(int width, int height) : m_window(nullptr),
                                         m_renderer(nullptr),
                                         m_texture(nullptr),
+                                        m_framebuffers{nullptr, nullptr, nullptr},
                                         m_buffer(nullptr),
+                                        m_framebuffer(0),
+                                        m_presentMode(PresentMode::Update),
+                                        m_streamingTextures{nullptr, nullptr, nullptr},
+                                        m_lockedPixels{nullptr, nullptr, nullptr},
+                                        m_lockedPitch{0, 0, 0},
+                                        m_zeroCopy(false),
+                                        m_presentMilliseconds(0.0f),
+                                        m_queueFront(0),
+                                        m_queuedFrames(0),
+                                        m_presentStop(false),
+                                        m_presentStarted(false),
+                                        m_refreshMilliseconds(0.0f),
+                                        m_intervals{},
+                                        m_vsyncWaits{},
+                                        m_queueWaits{},
+                                        m_framesPresented(0),
+                                        m_framesLate(0),
+                                        m_lastPresent(0),
                                         m_zBuffer(nullptr),
                                         m_color(0x000000f),
                                         SCREEN_HEIGHT(height),
-                                        SCREEN_WIDTH(width)
+                                        SCREEN_WIDTH(width),
+                                        m_scissor({0, 0, width, height}),
+                                        m_opacity(1.0f),
+                                        m_pixelsWritten(0),
+                                        m_hiddenSurface(HiddenSurface::ZBuffer),
+                                        m_spansResolved(false)
 {
+    m_inputs.reserve(2 * (int(Input::Quit) + 1)); //every key plus repeated quit events, refilled each frame without allocating
     initialize();
 }
 
@@ -33,24 +60,21 @@ bool Screen::initialize()
     {
         return false;
     }
-    //create renderer
-    m_renderer = SDL_CreateRenderer(m_window, -1, SDL_RENDERER_PRESENTVSYNC);
-    if (m_renderer == nullptr)
+    if (!createRenderer())
     {
         SDL_DestroyWindow(m_window);
         return false;
     }
-    //create texture
-    m_texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STATIC, SCREEN_WIDTH, SCREEN_HEIGHT);
-    if (m_texture == nullptr)
+    SDL_DisplayMode mode;
+    if (SDL_GetWindowDisplayMode(m_window, &mode) == 0 && mode.refresh_rate > 0)
+        m_refreshMilliseconds = 1000.0f / float(mode.refresh_rate);
+
+    for (Uint32*& framebuffer : m_framebuffers)
     {
-        SDL_DestroyRenderer(m_renderer);
-        SDL_DestroyWindow(m_window);
-        return false;
+        framebuffer = new Uint32[SCREEN_WIDTH * SCREEN_HEIGHT];
+        memset(framebuffer, 0, sizeof(Uint32) * SCREEN_WIDTH * SCREEN_HEIGHT);
     }
-
-    m_buffer = new Uint32[SCREEN_WIDTH * SCREEN_HEIGHT];
-    memset(m_buffer, 0, sizeof(Uint32) * SCREEN_WIDTH * SCREEN_HEIGHT);
+    m_buffer = m_framebuffers[0];
 
     m_zBuffer = new float[SCREEN_WIDTH * SCREEN_HEIGHT];
     memset(m_zBuffer, 0, sizeof(float) * SCREEN_WIDTH * SCREEN_HEIGHT);
@@ -59,6 +83,32 @@ bool Screen::initialize()
     return true;
 }
 
+bool Screen::createRenderer()
+{
+    m_renderer = SDL_CreateRenderer(m_window, -1, SDL_RENDERER_PRESENTVSYNC);
+    if (m_renderer == nullptr)
+        return false;
+    m_texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STATIC, SCREEN_WIDTH, SCREEN_HEIGHT);
+    if (m_texture == nullptr)
+    {
+        SDL_DestroyRenderer(m_renderer);
+        m_renderer = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void Screen::destroyRenderer()
+{
+    releaseStreamingTextures();
+    if (m_texture != nullptr)
+        SDL_DestroyTexture(m_texture);
+    if (m_renderer != nullptr)
+        SDL_DestroyRenderer(m_renderer);
+    m_texture = nullptr;
+    m_renderer = nullptr;
+}
+
 
 void Screen::setColor(Uint8 t_red, Uint8 t_green, Uint8 t_blue)
 {
@@ -77,19 +127,72 @@ void Screen::setColor(uint32_t color) {
 
 void Screen::putPixel(int x, int y, float depth)
 {
-    if(x < 0 || x > 799)
-        return;
-    if(y < 0 || y > 599)
-        return;
+    assert(x >= 0 && x < SCREEN_WIDTH);
+    assert(y >= 0 && y < SCREEN_HEIGHT);
 
     int index = y * SCREEN_WIDTH + x;
-    //check z-buffer
-    if(depth < m_zBuffer[index]) {
+    //check z-buffer, span buffer mode draws over everything
+    if(m_zBuffer == nullptr) {
+        m_buffer[index] = m_color;
+    } else if(depth < m_zBuffer[index]) {
         m_zBuffer[index] = depth;
         m_buffer[index] = m_color;
     }
 }
 
+void Screen::setScissor(const SDL_Rect& rect)
+{
+    int left = std::max(rect.x, 0);
+    int top = std::max(rect.y, 0);
+    int right = std::min(rect.x + rect.w, SCREEN_WIDTH);
+    int bottom = std::min(rect.y + rect.h, SCREEN_HEIGHT);
+    m_scissor = {left, top, std::max(right - left, 0), std::max(bottom - top, 0)};
+}
+
+RenderTarget Screen::getRenderTarget() const
+{
+    return {m_buffer, m_zBuffer, SCREEN_WIDTH, {m_scissor.x, m_scissor.y, m_scissor.x + m_scissor.w, m_scissor.y + m_scissor.h}, 0};
+}
+
+void Screen::setHiddenSurface(HiddenSurface mode)
+{
+    m_hiddenSurface = mode;
+    if (mode == HiddenSurface::SpanBuffer)
+    {
+        delete[] m_zBuffer;
+        m_zBuffer = nullptr;
+        m_spans.resize(SCREEN_HEIGHT);
+        m_spansResolved = false;
+    }
+    else
+    {
+        if (m_zBuffer == nullptr)
+            m_zBuffer = new float[SCREEN_WIDTH * SCREEN_HEIGHT];
+        resetZBuffer();
+        m_spans.resize(0);
+    }
+}
+
+size_t Screen::getHiddenSurfaceBytes() const
+{
+    if (m_hiddenSurface == HiddenSurface::SpanBuffer)
+        return m_spans.getBytes();
+    return size_t(SCREEN_WIDTH) * SCREEN_HEIGHT * sizeof(float);
+}
+
+void Screen::resolve()
+{
+    if (m_hiddenSurface != HiddenSurface::SpanBuffer || m_spansResolved)
+        return;
+    m_pixelsWritten += m_spans.resolve(m_buffer, SCREEN_WIDTH);
+    m_spansResolved = true;
+}
+
+void Screen::setOpacity(float opacity)
+{
+    m_opacity = std::min(std::max(opacity, 0.0f), 1.0f);
+}
+
 void Screen::drawLine(const Vec3& v0, const Vec3& v1)
 {
     /*BRESENHAM'S ALGORITHM*/
@@ -112,7 +215,8 @@ void Screen::drawLine(const Vec3& v0, const Vec3& v1)
     { //horizontal line (used for rasterizing triangles)
         while(true) {
             float z = interpolateZ(v0, v1, {float(x0), float(y0), 0.0f});
-            putPixel(x0, y0, z);
+            if (isInScissor(x0, y0))
+                putPixel(x0, y0, z);
             if(x0 == x1)
                 break;
 
@@ -123,7 +227,8 @@ void Screen::drawLine(const Vec3& v0, const Vec3& v1)
     { //vertical line 
         while(true) {
             float z = interpolateZ(v0, v1, {float(x0), float(y0), 0.0f});
-            putPixel(x0, y0, z);
+            if (isInScissor(x0, y0))
+                putPixel(x0, y0, z);
             if(y0 == y1)
                 break;
             y0 += sy;
@@ -136,7 +241,8 @@ void Screen::drawLine(const Vec3& v0, const Vec3& v1)
         while (true)
         {
             float z = interpolateZ(v0, v1, {float(x0), float(y0), 0.0f});
-            putPixel(x0, y0, z); //draw pixel at x0, y0
+            if (isInScissor(x0, y0))
+                putPixel(x0, y0, z); //draw pixel at x0, y0
             if (x0 == x1 && y0 == y1) //leave loop if both points are on the same pixel
             {
                 break;
@@ -161,251 +267,438 @@ void Screen::drawPolygon(Vertex &vertexBuffer)
 {
     assert(vertexBuffer.indices.size() <= vertexBuffer.cullFlags.size());
 
-    //perspective divide
-    for (Vec4 &v : vertexBuffer.positions)
+    //same gray levels as the shaders below, one triangle at a time into the spans
+    if (m_hiddenSurface == HiddenSurface::SpanBuffer)
     {
-        if(abs(v.w) >= 200.0f) //geometric clipping will take care of negative and 0 w'. 
-            v = {v.x/v.w, v.y/v.w, v.z/v.w, 1.0f}; 
+        perspectiveDivide(vertexBuffer);
+        bool gouraud = vertexBuffer.vertexLight.size() == vertexBuffer.positions.size();
+        for (unsigned int k = 0; k < vertexBuffer.indices.size(); ++k)
+        {
+            if (vertexBuffer.cullFlags[k])
+                continue;
+            const Index& i = vertexBuffer.indices[k];
+            unsigned int corners[3] = {i.x, i.y, i.z};
+            Vec3 p[3];
+            float grays[3];
+            for (unsigned int n = 0; n < 3; ++n)
+            {
+                const Vec4& v = vertexBuffer.positions[corners[n]];
+                p[n] = {v.x, v.y, v.z};
+                grays[n] = 230.0f * (gouraud ? vertexBuffer.vertexLight[corners[n]] : vertexBuffer.shadingLevel[k]) + 25.0f;
+            }
+            spanTriangle(p[0], p[1], p[2], grays);
+        }
+        return;
     }
 
-
-    unsigned int vertexBufferSize = vertexBuffer.positions.size();
-    for(unsigned int k = 0; k < vertexBuffer.indices.size(); ++k) 
+    //Gouraud: gray level per corner, interpolated by the rasterizer
+    if (vertexBuffer.vertexLight.size() == vertexBuffer.positions.size())
     {
-        const Index& i = vertexBuffer.indices.at(k);
-        //if cullFlag is true, continue loop
-        if(vertexBuffer.cullFlags.at(k))
-            continue;
-        assert(i.x < vertexBufferSize);
-        assert(i.y < vertexBufferSize);
-        assert(i.z < vertexBufferSize);
-
-
-        Vec3 vec[3];
-        vec[0] = {vertexBuffer.positions.at(i.x).x, vertexBuffer.positions.at(i.x).y, vertexBuffer.positions.at(i.x).z};
-        vec[1] = {vertexBuffer.positions.at(i.y).x, vertexBuffer.positions.at(i.y).y, vertexBuffer.positions.at(i.y).z};
-        vec[2] = {vertexBuffer.positions.at(i.z).x, vertexBuffer.positions.at(i.z).y, vertexBuffer.positions.at(i.z).z};
+        drawPolygon(vertexBuffer, VertexGrayShader(), GrayShader());
+        return;
+    }
+    //gray based how much triangle is turned towards light source
+    drawPolygon(vertexBuffer, FaceGrayShader(), GrayShader());
+}
 
-/*
-        drawLine(vec[0], vec[1]);
-        drawLine(vec[1], vec[2]);
-        drawLine(vec[2], vec[0]);*/
+void Screen::perspectiveDivide(Vertex &vertexBuffer)
+{
+    //clipping left every referenced vertex in front of the near plane, so w > 0
+    for (Vec4 &v : vertexBuffer.positions)
+        v = {v.x/v.w, v.y/v.w, v.z/v.w, 1.0f};
+}
 
-        //set color based how much triangle is turned towards light source 
-        char c = 230 * vertexBuffer.shadingLevel.at(k) + 25;
-        setColor(c, c, c);
-        fillTriangle(vec[0], vec[1], vec[2]);
+//span buffer mode: opaque triangles are clipped into the spans, translucent ones are blended where they are
+//nearer than the resolved spans, grays per corner or nullptr for the current color
+void Screen::spanTriangle(const Vec3 &vec1, const Vec3 &vec2, const Vec3 &vec3, const float* grays)
+{
+    TriangleSetup t;
+    if (!t.setup(vec1, vec2, vec3))
+        return;
+    uint32_t color = grays ? 0xffffffff : m_color;
+    float top = 255.0f;
+    float ddx = 0.0f;
+    float ddy = 0.0f;
+    if (grays)
+    {
+        top = grays[t.order[0]];
+        t.gradient(top, grays[t.order[1]], grays[t.order[2]], ddx, ddy);
     }
+    bool translucent = m_opacity < 1.0f;
+    if (translucent)
+        resolve();
+    BlendAlpha blend = {Uint32(m_opacity * 256.0f)};
+    RasterRect rect = {m_scissor.x, m_scissor.y, m_scissor.x + m_scissor.w, m_scissor.y + m_scissor.h};
+    scanTriangle(t, rect, [&](int y, int xStart, int xEnd)
+    {
+        float yc = float(y) + 0.5f;
+        float z = t.valueAt(t.top->z, t.dzdx, t.dzdy, xStart, yc);
+        float gray = t.valueAt(top, ddx, ddy, xStart, yc);
+        if (!translucent)
+        {
+            m_spans.insert(y, xStart, xEnd, z, t.dzdx, color, gray, ddx);
+            return;
+        }
+        Uint32* row = m_buffer + y * SCREEN_WIDTH;
+        m_spans.forEachVisible(y, xStart, xEnd, z, t.dzdx, [&](int x0, int x1)
+        {
+            for (int x = x0; x < x1; ++x)
+                row[x] = blend(SpanBuffer::shade(color, gray + float(x - xStart) * ddx), row[x]);
+            m_pixelsWritten += x1 - x0;
+        });
+    });
 }
 
+//triangle in the current color
+void Screen::fillTriangle(const Vec3 &vec1, const Vec3 &vec2, const Vec3 &vec3)
+{
+    if (m_hiddenSurface == HiddenSurface::SpanBuffer)
+    {
+        spanTriangle(vec1, vec2, vec3, nullptr);
+        return;
+    }
+    drawWithPipeline(PositionShader(), SolidColorShader{m_color}, [&](const auto& pipeline, RenderTarget& target)
+    {
+        pipeline.rasterize(vec1, vec2, vec3, nullptr, target);
+    });
+}
 
+//triangle with a gray level (0 - 255) per corner, interpolated with the same gradients as depth
+void Screen::fillTriangle(const Vec3 &vec1, const Vec3 &vec2, const Vec3 &vec3, const float* grays)
+{
+    if (m_hiddenSurface == HiddenSurface::SpanBuffer)
+    {
+        spanTriangle(vec1, vec2, vec3, grays);
+        return;
+    }
+    Varyings<1> corners[3] = {{{grays[0]}}, {{grays[1]}}, {{grays[2]}}};
+    drawWithPipeline(VertexGrayShader(), GrayShader(), [&](const auto& pipeline, RenderTarget& target)
+    {
+        pipeline.rasterize(vec1, vec2, vec3, corners, target);
+    });
+}
 
-void Screen::fillTriangle(const Vec3 &vec1, const Vec3 &vec2, const Vec3 &vec3)
+void Screen::render()
 {
-    const Vec3 *top = &vec1;
-    const Vec3 *mid = &vec2;
-    const Vec3 *bot = &vec3;
+    resolve();
+    present(m_framebuffer);
+    selectFramebuffer(m_framebuffer + 1); //the next one in the ring, it waits while that is still queued
+}
 
-    //check to swap top and mid
-    if(top->y > mid->y) {
-        std::swap(top, mid);
+//the frame pipeline draws into one framebuffer on its raster thread while the others wait for or go through presentation
+void Screen::selectFramebuffer(unsigned int index)
+{
+    m_framebuffer = index % FRAMEBUFFER_COUNT;
+    if (m_presentThread.joinable())
+    {
+        std::unique_lock<std::mutex> lock(m_presentMutex);
+        m_presentChanged.wait(lock, [this]() { return !isQueued(m_framebuffer); });
     }
+    m_buffer = m_framebuffers[m_framebuffer];
+}
 
-    //check to swap mid and bot
-    if(mid->y > bot->y) {
-        std::swap(mid, bot);
+//with a present thread the framebuffer is only queued, the caller goes on with the next frame instead of waiting
+//for the vertical blank
+void Screen::present(unsigned int index)
+{
+    index %= FRAMEBUFFER_COUNT;
+    if (!m_presentThread.joinable())
+    {
+        presentFramebuffer(index, SDL_GetPerformanceCounter());
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_presentMutex);
+        assert(m_queuedFrames < FRAMEBUFFER_COUNT && !isQueued(index));
+        m_presentQueue[(m_queueFront + m_queuedFrames) % FRAMEBUFFER_COUNT] = {index, SDL_GetPerformanceCounter()};
+        ++m_queuedFrames;
+    }
+    m_presentChanged.notify_all();
+}
 
-        //check if top and mid need to be swapped after mid/bottom swap
-        if(top->y > mid->y) {
-            std::swap(top, mid);
+//streaming: unlocking uploads what was drawn into the locked pixels, then the texture is locked again for a later
+//frame, without zero copy the framebuffer is copied into the locked pixels row by row first
+//only changes m_framebuffers[index], m_buffer is the drawing thread's
+void Screen::presentFramebuffer(unsigned int index, Uint64 queued)
+{
+    Uint64 start = SDL_GetPerformanceCounter();
+    SDL_Texture* texture = m_texture;
+    if (m_presentMode == PresentMode::Streaming)
+    {
+        texture = m_streamingTextures[index];
+        if (m_lockedPixels[index] != nullptr)
+        {
+            if (!m_zeroCopy)
+            {
+                for (int y = 0; y < SCREEN_HEIGHT; ++y)
+                    memcpy(reinterpret_cast<Uint8*>(m_lockedPixels[index]) + y * m_lockedPitch[index],
+                           m_framebuffers[index] + y * SCREEN_WIDTH, SCREEN_WIDTH * sizeof(Uint32));
+            }
+            SDL_UnlockTexture(texture);
+            m_lockedPixels[index] = nullptr;
+            if (m_zeroCopy)
+                m_framebuffers[index] = nullptr;
         }
     }
+    else
+    {
+        SDL_UpdateTexture(m_texture, nullptr, m_framebuffers[index], SCREEN_WIDTH * sizeof(Uint32));
+    }
+    SDL_RenderClear(m_renderer);
+    SDL_RenderCopy(m_renderer, texture, nullptr, nullptr);
+    Uint64 vsync = SDL_GetPerformanceCounter();
+    SDL_RenderPresent(m_renderer);
+    Uint64 end = SDL_GetPerformanceCounter();
+    //a texture that can not be locked again (lost device) is drawn into private memory and tried again next time
+    if (m_presentMode == PresentMode::Streaming && !lockFramebuffer(index) && m_framebuffers[index] == nullptr)
+        m_framebuffers[index] = new Uint32[SCREEN_WIDTH * SCREEN_HEIGHT];
+
+    double milliseconds = 1000.0 / double(SDL_GetPerformanceFrequency());
+    std::lock_guard<std::mutex> lock(m_presentMutex);
+    m_presentMilliseconds = float(double(vsync - start) * milliseconds);
+    if (m_lastPresent != 0)
+    {
+        unsigned int slot = (m_framesPresented - 1) % PACING_WINDOW;
+        m_intervals[slot] = float(double(end - m_lastPresent) * milliseconds);
+        m_vsyncWaits[slot] = float(double(end - vsync) * milliseconds);
+        m_queueWaits[slot] = float(double(start - queued) * milliseconds);
+        if (m_refreshMilliseconds > 0.0f && m_intervals[slot] > 1.5f * m_refreshMilliseconds)
+            ++m_framesLate;
+    }
+    m_lastPresent = end;
+    ++m_framesPresented;
+}
 
-    if(int(top->y) == int(mid->y)) { //flap top
-        const Vec3* left = top;
-        const Vec3* right = mid;
-        if(left->x > right->x)
-            std::swap(left, right);
-        fillBetweenLines(*left, *bot, *right, *bot);
-    }else if(int(mid->y) == int(bot->y)) { //flat bottom
-        const Vec3* left = bot;
-        const Vec3* right = mid;
-        if(left->x > right->x)
-            std::swap(left, right);
-         fillBetweenLines(*top, *left, *top, *right);
-    }else{ //split triangle into flat/bottom triangles
-        float a = top->y - bot->y;
-        float b = bot->x - top->x;
-        float c = top->x * bot->y - bot->x * top->y;
-        Vec3 newMid;
-        if(abs(a) > 0.01f) {
-            newMid = {(-b * mid->y - c) / a, mid->y, 0.0f};
-        }else{ //vertical line (approx.) between top and bottom
-            newMid = {top->x, mid->y, 0.0f};
-        }
+bool Screen::isQueued(unsigned int index) const
+{
+    for (unsigned int k = 0; k < m_queuedFrames; ++k)
+    {
+        if (m_presentQueue[(m_queueFront + k) % FRAMEBUFFER_COUNT].index == index)
+            return true;
+    }
+    return false;
+}
 
-        float newZ = interpolateZ(*top, *bot, newMid);
-        newMid.z = newZ; 
-
-        const Vec3 *left = mid;
-        const Vec3 *right = &newMid;
-        if (left->x > right->x)
-            std::swap(left, right);
-        fillBetweenLines(*top, *left, *top, *right);
-        fillBetweenLines(*left, *bot, *right, *bot);
-    }
-}
-
-void Screen::fillBetweenLines(const Vec3 &v0, const Vec3 &v1, const Vec3 &v2, const Vec3 &v3)
-{
-    //let's rewrite this to make it easier to read. fuck speed (for now anyway)
-
-    //left line
-    int x0l = int(v0.x);
-    int y0l = int(v0.y);
-    int z0l = int(v0.z);
-    int x1l = int(v1.x);
-    int y1l = int(v1.y);
-    int z1l = int(v1.z);
-    int sxl = x0l < x1l ? 1 : -1;
-    int syl = y0l < y1l ? 1 : -1;
-    int szl = z0l < z1l ? 1 : -1;
-    int dxl = abs(x1l - x0l);
-    int dyl = -abs(y1l - y0l);
-    int dzl = -abs(z1l - z0l);
-    int errl = dxl + dyl;
-
-    int errlA = dyl + dzl;
-    int y0lA = int(v0.y);
-
-    //right line
-    int x0r = int(v2.x);
-    int y0r = int(v2.y);
-    int z0r = int(v2.z);
-    int x1r = int(v3.x);
-    int y1r = int(v3.y);
-    int z1r = int(v3.z);
-    int sxr = x0r < x1r ? 1 : -1;
-    int syr = y0r < y1r ? 1 : -1;
-    int szr = z0r < z1r ? 1 : -1;
-    int dxr = abs(x1r - x0r);
-    int dyr = -abs(y1r - y0r);
-    int dzr = abs(z1r - z0r);
-    int errr = dxr + dyr;
-
-    int errrA = dyr + dzr;
-    int y0rA = int(v2.y);
+float Screen::getPresentMilliseconds() const
+{
+    std::lock_guard<std::mutex> lock(m_presentMutex);
+    return m_presentMilliseconds;
+}
 
-    while (true)
+PresentPacing Screen::getPresentPacing() const
+{
+    std::lock_guard<std::mutex> lock(m_presentMutex);
+    PresentPacing pacing;
+    pacing.framesPresented = m_framesPresented;
+    pacing.framesLate = m_framesLate;
+    pacing.queued = m_queuedFrames;
+    unsigned int samples = std::min(m_framesPresented > 0 ? m_framesPresented - 1 : 0u, PACING_WINDOW);
+    if (samples == 0)
+        return pacing;
+    double sum = 0.0;
+    double squares = 0.0;
+    double vsync = 0.0;
+    double queue = 0.0;
+    for (unsigned int k = 0; k < samples; ++k)
     {
-        Vec3 vc0 = {float(x0l), float(y0l), float(z0l)};
-        Vec3 vc1 = {float(x0r), float(y0r), float(z0r)};
+        sum += m_intervals[k];
+        squares += double(m_intervals[k]) * m_intervals[k];
+        vsync += m_vsyncWaits[k];
+        queue += m_queueWaits[k];
+        pacing.maxIntervalMilliseconds = std::max(pacing.maxIntervalMilliseconds, m_intervals[k]);
+    }
+    double mean = sum / samples;
+    pacing.intervalMilliseconds = float(mean);
+    pacing.jitterMilliseconds = float(sqrt(std::max(squares / samples - mean * mean, 0.0)));
+    pacing.vsyncMilliseconds = float(vsync / samples);
+    pacing.queueMilliseconds = float(queue / samples);
+    return pacing;
+}
 
-        float z0 = interpolateZ(v0, v1, vc0);
-        vc0.z = z0;
-        float z1 = interpolateZ(v2, v3, vc1);
-        vc1.z = z1;
+//SDL wants a renderer used on the thread that created it, so it is created again on the present thread
+bool Screen::startPresentThread()
+{
+    if (m_presentThread.joinable())
+        return true;
+    destroyRenderer();
+    m_presentStop = false;
+    m_presentStarted = false;
+    m_presentThread = std::thread([this]() { presentLoop(); });
+    {
+        std::unique_lock<std::mutex> lock(m_presentMutex);
+        m_presentChanged.wait(lock, [this]() { return m_presentStarted; });
+    }
+    bool started = m_renderer != nullptr;
+    if (!started)
+    {
+        m_presentThread.join();
+        createRenderer();
+        if (m_presentMode == PresentMode::Streaming && !createStreamingTextures())
+            m_presentMode = PresentMode::Update;
+    }
+    selectFramebuffer(m_framebuffer); //framebuffers may point into textures locked by the present thread
+    return started;
+}
 
-        //draw horizontal line (y0l == y0r)
-        drawLine(vc0, vc1);
+void Screen::stopPresentThread()
+{
+    if (!m_presentThread.joinable())
+        return;
+    joinPresentThread();
+    createRenderer();
+    if (m_presentMode == PresentMode::Streaming && !createStreamingTextures())
+        m_presentMode = PresentMode::Update;
+    selectFramebuffer(m_framebuffer);
+}
+
+void Screen::joinPresentThread()
+{
+    if (!m_presentThread.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m_presentMutex);
+        m_presentStop = true;
+    }
+    m_presentChanged.notify_all();
+    m_presentThread.join();
+}
+
+//presents queued framebuffers in order until stopped and the queue is empty, a framebuffer leaves the queue
+//once it has been shown, so the drawing thread never writes one that is still being uploaded
+void Screen::presentLoop()
+{
+    bool ready = createRenderer();
+    //streaming textures that worked on the old renderer may fail on this one, frames are copied then
+    if (ready && m_presentMode == PresentMode::Streaming && !createStreamingTextures())
+        m_presentMode = PresentMode::Update;
+    {
+        std::lock_guard<std::mutex> lock(m_presentMutex);
+        m_presentStarted = true;
+    }
+    m_presentChanged.notify_all();
+    if (!ready)
+        return;
 
-        if (y0r == y1l)
+    while (true)
+    {
+        QueuedFrame frame;
         {
-            break;
+            std::unique_lock<std::mutex> lock(m_presentMutex);
+            m_presentChanged.wait(lock, [this]() { return m_queuedFrames > 0 || m_presentStop; });
+            if (m_queuedFrames == 0)
+                break;
+            frame = m_presentQueue[m_queueFront];
         }
-        //loop left until y0l is incremented by 1
-        while (true)
+        presentFramebuffer(frame.index, frame.queued);
         {
-            if (x0l == x1l && y0l == y1l)
-                break;
-            int e2 = errl * 2;
-            if (e2 >= dyl)
-            {
-                errl += dyl;
-                x0l += sxl;
-            }
-            if (e2 <= dxl)
-            {
-                errl += dxl;
-                y0l += syl;
-                break;
-            }
+            std::lock_guard<std::mutex> lock(m_presentMutex);
+            m_queueFront = (m_queueFront + 1) % FRAMEBUFFER_COUNT;
+            --m_queuedFrames;
         }
+        m_presentChanged.notify_all();
+    }
+    destroyRenderer();
+}
 
-        //loop y0lA (alternative) to keep track with y0l (and increment z0l at the same time)
-        while (y0lA != y0l)
+bool Screen::setPresentMode(PresentMode mode)
+{
+    if (mode == m_presentMode)
+        return true;
+    if (m_presentThread.joinable())
+        return false;
+    if (mode == PresentMode::Update)
+    {
+        releaseStreamingTextures();
+        m_presentMode = mode;
+        selectFramebuffer(m_framebuffer);
+        return true;
+    }
+    if (!createStreamingTextures())
+        return false;
+    m_presentMode = mode;
+    selectFramebuffer(m_framebuffer);
+    return true;
+}
+
+bool Screen::createStreamingTextures()
+{
+    for (SDL_Texture*& texture : m_streamingTextures)
+    {
+        texture = SDL_CreateTexture(m_renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH, SCREEN_HEIGHT);
+        if (texture == nullptr)
         {
-            int e2 = errlA * 2;
-            if (e2 >= dyl)
-            {
-                errlA += dyl;
-                z0l += szl;
-            }
-            if (e2 <= dzl)
-            {
-                errlA += dzl;
-                y0lA += syl;
-            }
+            releaseStreamingTextures();
+            return false;
         }
-
-        //loop right until y0r is incremented by 1 (and equal to y0l)
-        while (true)
+    }
+    m_zeroCopy = true;
+    for (unsigned int index = 0; index < FRAMEBUFFER_COUNT; ++index)
+    {
+        void* pixels;
+        int pitch;
+        if (SDL_LockTexture(m_streamingTextures[index], nullptr, &pixels, &pitch) != 0)
         {
-            if (x0r == x1r && y0r == y1r)
-                break;
-            int e2 = errr * 2;
-            if (e2 >= dyr)
-            {
-                errr += dyr;
-                x0r += sxr;
-            }
-            if (e2 <= dxr)
-            {
-                errr += dxr;
-                y0r += syr;
-                break;
-            }
+            releaseStreamingTextures();
+            return false;
         }
-
-        //loop y0lA (alternative) to keep track with y0l (and increment z0l at the same time)
-        while (y0rA != y0r)
+        m_lockedPixels[index] = static_cast<Uint32*>(pixels);
+        m_lockedPitch[index] = pitch;
+        m_zeroCopy = m_zeroCopy && pitch == int(SCREEN_WIDTH * sizeof(Uint32));
+    }
+    //rows padded by the driver keep the private framebuffers, the rasterizer assumes the screen width as row pitch
+    if (m_zeroCopy)
+    {
+        for (unsigned int index = 0; index < FRAMEBUFFER_COUNT; ++index)
         {
-            int e2 = errrA * 2;
-            if (e2 >= dyr)
-            {
-                errrA += dyr;
-                z0r += szr;
-            }
-            if (e2 <= dzr)
-            {
-                errrA += dzr;
-                y0rA += syr;
-            }
+            delete[] m_framebuffers[index];
+            m_framebuffers[index] = m_lockedPixels[index];
         }
     }
+    return true;
 }
 
-void Screen::render()
+bool Screen::lockFramebuffer(unsigned int index)
 {
-    SDL_UpdateTexture(m_texture, nullptr, m_buffer, SCREEN_WIDTH * sizeof(Uint32));
-    SDL_RenderClear(m_renderer);
-    SDL_RenderCopy(m_renderer, m_texture, nullptr, nullptr);
-    SDL_RenderPresent(m_renderer);
+    void* pixels;
+    int pitch;
+    if (SDL_LockTexture(m_streamingTextures[index], nullptr, &pixels, &pitch) != 0)
+        return false;
+    m_lockedPixels[index] = static_cast<Uint32*>(pixels);
+    m_lockedPitch[index] = pitch;
+    if (m_zeroCopy)
+    {
+        delete[] m_framebuffers[index]; //private memory after a failed lock
+        m_framebuffers[index] = m_lockedPixels[index];
+    }
+    return true;
 }
 
-void Screen::clear()
+void Screen::releaseStreamingTextures()
 {
-    resetZBuffer();
-
-    for (int col = 0; col < SCREEN_WIDTH; ++col)
+    for (unsigned int index = 0; index < FRAMEBUFFER_COUNT; ++index)
     {
-        for (int row = 0; row < SCREEN_HEIGHT; ++row)
-        {
-            putPixel(col, row, 0.0f);
-        }
+        if (m_zeroCopy && m_framebuffers[index] == m_lockedPixels[index])
+            m_framebuffers[index] = new Uint32[SCREEN_WIDTH * SCREEN_HEIGHT];
+        if (m_lockedPixels[index] != nullptr)
+            SDL_UnlockTexture(m_streamingTextures[index]);
+        if (m_streamingTextures[index] != nullptr)
+            SDL_DestroyTexture(m_streamingTextures[index]);
+        m_streamingTextures[index] = nullptr;
+        m_lockedPixels[index] = nullptr;
+        m_lockedPitch[index] = 0;
     }
+    m_zeroCopy = false;
+}
 
-    resetZBuffer();
+void Screen::clear()
+{
+    std::fill(m_buffer, m_buffer + SCREEN_WIDTH * SCREEN_HEIGHT, m_color);
+    if (m_hiddenSurface == HiddenSurface::SpanBuffer)
+        m_spans.clear();
+    else
+        resetZBuffer();
+    m_spansResolved = false;
+    m_pixelsWritten = 0;
 }
 
 //fill m_inputs with events that occurred that frame
@@ -523,20 +816,26 @@ float Screen::interpolateZ(const Vec3 &v0, const Vec3 &v1, const Vec3 &vc)
 
 void Screen::close()
 {
-    delete[] m_buffer;
+    joinPresentThread();
+    destroyRenderer();
+    for (Uint32*& framebuffer : m_framebuffers)
+    {
+        delete[] framebuffer;
+        framebuffer = nullptr;
+    }
     delete[] m_zBuffer;
-    SDL_DestroyTexture(m_texture);
-    SDL_DestroyRenderer(m_renderer);
     SDL_DestroyWindow(m_window);
 
     m_buffer = nullptr;
     m_zBuffer = nullptr;
-    m_texture = nullptr;
-    m_renderer = nullptr;
     m_window = nullptr;
     SDL_Quit();
 }
 
+void Screen::setTitle(const std::string& title)
+{
+    SDL_SetWindowTitle(m_window, title.c_str());
+}
 
 void Screen::drawTexture(int x, int y, const Texture& texture) {
     Uint32* buffer = texture.getTexture();
@@ -545,6 +844,8 @@ void Screen::drawTexture(int x, int y, const Texture& texture) {
 
     for(unsigned int row = 0; row < width; ++row) {
         for(unsigned int col = 0; col < height; ++col) {
+            if (!isInScissor(col + x, row + y))
+                continue;
             setColor(buffer[row * width + col]);
             putPixel(col + x, row + y, 0.0f);
         }
@@ -4,9 +4,17 @@
 #define SDL_MAIN_HANDLED
 #include "SDL.h"
 #include <vector>
+#include <assert.h>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "Math.hpp"
 #include "Vertex.hpp"
 #include "Texture.hpp"
+#include "Pipeline.hpp"
+#include "SpanBuffer.hpp"
+#include "Stats.hpp"
 
 namespace paint {
 
@@ -33,40 +41,168 @@ enum class Input {
     Quit
 };
 
+//how opaque triangles of the stock shaders hide each other
+enum class HiddenSurface {
+    ZBuffer = 0, //depth per pixel, tested as triangles are drawn
+    SpanBuffer //sorted spans per row, no depth plane, every pixel is written once when the spans are resolved
+};
+
+//how a finished framebuffer gets to the window
+enum class PresentMode {
+    Update = 0, //static texture, the framebuffer is copied into it with SDL_UpdateTexture
+    Streaming //a streaming texture per framebuffer, drawn into while locked, presented by unlocking it
+};
+
 class Screen
 {
+public:
+    static constexpr unsigned int FRAMEBUFFER_COUNT = 3;
 private:
+    static constexpr unsigned int PACING_WINDOW = 120; //presented frames the pacing stats are taken over
+
+    //handed to the present thread
+    struct QueuedFrame
+    {
+        unsigned int index;
+        Uint64 queued; //performance counter
+    };
+
     SDL_Window* m_window;
-    SDL_Renderer* m_renderer;
+    SDL_Renderer* m_renderer; //and the textures, used by the present thread only while it runs
     SDL_Texture* m_texture;
-    Uint32* m_buffer; 
+    Uint32* m_framebuffers[FRAMEBUFFER_COUNT]; //color planes, a ring: one drawn into, one presented, one waiting
+    Uint32* m_buffer; //the one draws go to
+    unsigned int m_framebuffer; //index of m_buffer
+    PresentMode m_presentMode;
+    SDL_Texture* m_streamingTextures[FRAMEBUFFER_COUNT]; //streaming mode only, locked except while presented
+    Uint32* m_lockedPixels[FRAMEBUFFER_COUNT]; //of the streaming textures, rows m_lockedPitch bytes apart
+    int m_lockedPitch[FRAMEBUFFER_COUNT];
+    bool m_zeroCopy; //streaming and every locked pitch is the screen width, framebuffers are the locked pixels
+    float m_presentMilliseconds; //of the last present, without the wait for the vertical blank, m_presentMutex held
+    std::thread m_presentThread;
+    mutable std::mutex m_presentMutex; //guards the queue, the pacing record and m_presentMilliseconds
+    std::condition_variable m_presentChanged;
+    QueuedFrame m_presentQueue[FRAMEBUFFER_COUNT]; //ring, the front one is being presented
+    unsigned int m_queueFront;
+    unsigned int m_queuedFrames;
+    bool m_presentStop;
+    bool m_presentStarted; //the present thread has created its renderer, or failed to
+    float m_refreshMilliseconds; //of the display, 0 if unknown
+    float m_intervals[PACING_WINDOW]; //ring of the last presents
+    float m_vsyncWaits[PACING_WINDOW];
+    float m_queueWaits[PACING_WINDOW];
+    unsigned int m_framesPresented;
+    unsigned int m_framesLate;
+    Uint64 m_lastPresent; //performance counter after the last SDL_RenderPresent, 0 before the first
     float* m_zBuffer;
     Uint32 m_color;
     std::vector<Input> m_inputs; 
     const int SCREEN_HEIGHT;
     const int SCREEN_WIDTH;
+    SDL_Rect m_scissor; //triangle raster bounds, always inside the screen
+    float m_opacity; //1 writes color and depth, below 1 blends color and leaves depth untouched
+    unsigned int m_pixelsWritten; //triangle pixels that passed the depth test since clear()
+    HiddenSurface m_hiddenSurface;
+    SpanBuffer m_spans; //span buffer mode only
+    bool m_spansResolved; //written into m_buffer since clear()
 public:
     Screen(int width, int height);
     bool initialize();
     void setColor(Uint8 red, Uint8 green, Uint8 blue);
     void setColor(uint32_t color);
-    void putPixel(int x, int y, float depth);
+    void putPixel(int x, int y, float depth); //x and y must be on screen
+    void setScissor(const SDL_Rect& rect); //clamped to screen
+    void setOpacity(float opacity); //applies to fillTriangle, clamped to [0, 1]
+    inline unsigned int getPixelsWritten() const { return m_pixelsWritten; };
+    inline const SDL_Rect& getScissor() const { return m_scissor; };
+    inline int getWidth() const { return SCREEN_WIDTH; };
+    inline int getHeight() const { return SCREEN_HEIGHT; };
+    RenderTarget getRenderTarget() const; //color and depth planes clipped to the scissor, z-buffer mode only
+    void setHiddenSurface(HiddenSurface mode); //the z-buffer is only allocated in its own mode
+    inline HiddenSurface getHiddenSurface() const { return m_hiddenSurface; };
+    size_t getHiddenSurfaceBytes() const; //z-buffer or span rows and pool
+    inline unsigned int getSpanCount() const { return m_spans.getSpanCount(); };
+    void resolve(); //span buffer: writes the opaque spans, before translucent draws and by render()
     void drawLine(const Vec3& v0, const Vec3& v1);
     void drawPolygon(Vertex& vertexBuffer);
+    template<typename VertexShader, typename PixelShader>
+    void drawPolygon(Vertex& vertexBuffer, const VertexShader& vertexShader, const PixelShader& pixelShader); //custom shaders, same depth and blend state, z-buffer mode only
+    template<typename Pass>
+    void drawPass(Vertex& vertexBuffer, Pass&& pass); //pass(vertexBuffer, target) after the perspective divide, opaque
     void fillTriangle(const Vec3& vec1, const Vec3& vec2, const Vec3& vec3);
+    void fillTriangle(const Vec3& vec1, const Vec3& vec2, const Vec3& vec3, const float* grays); //gray level per corner
     void render();
+    void selectFramebuffer(unsigned int index); //following clears and draws go to framebuffer index % 3, waits until it is not queued
+    void present(unsigned int index); //shows framebuffer index % 3 as it is, spans must be resolved, its contents are undefined after
+    bool setPresentMode(PresentMode mode); //false if the textures could not be created or locked or the present thread runs, the mode is kept then
+    bool startPresentThread(); //before drawing, false if it could not create a renderer, presentation stays on the caller's thread then
+    void stopPresentThread(); //presents the queued frames, the renderer is the caller's again
+    inline bool hasPresentThread() const { return m_presentThread.joinable(); };
+    PresentPacing getPresentPacing() const;
+    inline PresentMode getPresentMode() const { return m_presentMode; };
+    inline bool isZeroCopy() const { return m_zeroCopy; };
+    float getPresentMilliseconds() const; //upload and copy of the last present, safe while the present thread runs
     void clear();
     void processEvents(); //retrieves user input and fills m_inputs
     Input getNextEvent(); //get next event from m_inputs, removing it from vector
     inline bool hasEvents() const { return m_inputs.size() > 0;};
     void close();
+    void setTitle(const std::string& title);
     void drawTexture(int x, int y, const Texture& texture);
 private:
-    void fillBetweenLines(const Vec3& v0, const Vec3& v1, const Vec3& v2, const Vec3& v3);
+    inline bool isInScissor(int x, int y) const {
+        return x >= m_scissor.x && x < m_scissor.x + m_scissor.w && y >= m_scissor.y && y < m_scissor.y + m_scissor.h;
+    };
+    void perspectiveDivide(Vertex& vertexBuffer);
+    bool createRenderer(); //with the static texture, on the thread that will present
+    bool createStreamingTextures(); //locked, framebuffers point into them if the pitch allows
+    void destroyRenderer();
+    void joinPresentThread();
+    void presentLoop();
+    void presentFramebuffer(unsigned int index, Uint64 queued); //uploads and presents on the renderer's thread
+    bool isQueued(unsigned int index) const; //m_presentMutex held
+    bool lockFramebuffer(unsigned int index); //streaming mode, framebuffer index points into the locked texture if it can
+    void releaseStreamingTextures(); //unlocks and destroys them, framebuffers are allocated again if they were locked memory
+    void spanTriangle(const Vec3& vec1, const Vec3& vec2, const Vec3& vec3, const float* grays); //span buffer mode
+    template<typename VertexShader, typename PixelShader, typename Draw>
+    void drawWithPipeline(const VertexShader& vertexShader, const PixelShader& pixelShader, Draw&& draw);
     void resetZBuffer(); //sets z buffer distances to infinity (large number)
     float interpolateZ(const Vec3& v0, const Vec3& v1, const Vec3& vc);
 };
 
+//draw(pipeline, target) with the pipeline for the current opacity: opaque writes depth, translucent blends without it
+template<typename VertexShader, typename PixelShader, typename Draw>
+void Screen::drawWithPipeline(const VertexShader& vertexShader, const PixelShader& pixelShader, Draw&& draw)
+{
+    assert(m_hiddenSurface == HiddenSurface::ZBuffer);
+    RenderTarget target = getRenderTarget();
+    if (m_opacity < 1.0f)
+        draw(makePipeline<DepthTestOnly>(vertexShader, pixelShader, BlendAlpha{Uint32(m_opacity * 256.0f)}), target);
+    else
+        draw(makePipeline(vertexShader, pixelShader), target);
+    m_pixelsWritten += target.pixelsWritten;
+}
+
+template<typename VertexShader, typename PixelShader>
+void Screen::drawPolygon(Vertex& vertexBuffer, const VertexShader& vertexShader, const PixelShader& pixelShader)
+{
+    perspectiveDivide(vertexBuffer);
+    drawWithPipeline(vertexShader, pixelShader, [&](const auto& pipeline, RenderTarget& target) {
+        pipeline.draw(vertexBuffer, target);
+    });
+}
+
+//for passes that write planes of their own (visibility ids), target is the opaque color and depth state
+template<typename Pass>
+void Screen::drawPass(Vertex& vertexBuffer, Pass&& pass)
+{
+    assert(m_hiddenSurface == HiddenSurface::ZBuffer);
+    perspectiveDivide(vertexBuffer);
+    RenderTarget target = getRenderTarget();
+    pass(vertexBuffer, target);
+    m_pixelsWritten += target.pixelsWritten;
+}
+
 }
 
 
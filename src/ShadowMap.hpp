@@ -0,0 +1,198 @@
+#ifndef SHADOWMAP_H
+#define SHADOWMAP_H
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include "Math.hpp"
+#include "Bounds.hpp"
+#include "Vertex.hpp"
+#include "Rasterizer.hpp"
+#include "JobSystem.hpp"
+
+namespace paint {
+
+//depth of the scene seen from a directional light, rendered with the depth only path of the scanline rasterizer
+//an orthographic projection along the light direction is fitted around the given bounds every frame
+//points are looked up in map space: x, y in texels, z depth in [0, 1] growing away from the light
+//render() spreads the casters over the workers to move them into map space, then the map over them in bands of rows,
+//every band clipping all casters to its rows, the nearest depth per texel does not depend on the order
+class ShadowMap {
+public:
+    static constexpr float DEFAULT_BIAS = 0.002f; //depth units, keeps surfaces from shadowing themselves
+    static constexpr unsigned int BAND_ROWS = 32; //texel rows per rasterization job
+    static constexpr unsigned int BATCH_CASTERS = 16; //casters per transform job
+
+    struct Stats
+    {
+        unsigned int casters = 0; //entities rendered
+        unsigned int triangles = 0;
+    };
+private:
+    struct Caster
+    {
+        MeshData mesh;
+        Mat4 model;
+        unsigned int firstPosition; //in m_mapPositions
+        float yMin; //map space rows covered, set by the transform
+        float yMax;
+    };
+
+    unsigned int m_size; //texels along each side
+    unsigned int m_filterRadius;
+    float m_bias;
+    std::vector<float> m_depth;
+    std::vector<Caster> m_casters; //since begin()
+    std::vector<Vec3> m_mapPositions; //of every caster, reused between frames
+    Mat4 m_worldToMap;
+    float m_texelSize; //world units covered by a texel, the larger side
+    Stats m_stats;
+public:
+    ShadowMap() : m_size(0), m_filterRadius(0), m_bias(DEFAULT_BIAS), m_texelSize(0.0f) {};
+
+    //starts a map fitted around bounds (world space) seen along direction (the way the light travels)
+    //size texels squared, filterRadius as in getVisibility()
+    void begin(const AABB& bounds, const Vec3& direction, unsigned int size, unsigned int filterRadius) {
+        m_stats = Stats();
+        m_size = std::max(size, 1u);
+        m_filterRadius = filterRadius;
+        m_depth.resize(m_size * m_size); //cleared by the bands
+        m_casters.clear();
+        m_mapPositions.clear();
+        if (!bounds.isEmpty())
+            fit(bounds, direction);
+    }
+
+    //every triangle of mesh placed in the world by model is rendered by render(), both sides
+    //mesh must stay valid until then
+    void addCaster(const MeshData& mesh, const Mat4& model) {
+        m_casters.push_back({mesh, model, unsigned(m_mapPositions.size()), 0.0f, 0.0f});
+        m_mapPositions.resize(m_mapPositions.size() + mesh.vertexCount);
+        ++m_stats.casters;
+        m_stats.triangles += mesh.triangleCount;
+    }
+
+    //clears the map and rasterizes the depth of the casters added since begin() on the workers of jobs
+    void render(JobSystem& jobs) {
+        jobs.parallelFor(m_casters.size(), BATCH_CASTERS, [this](unsigned int begin, unsigned int end, unsigned int) {
+            for (unsigned int k = begin; k < end; ++k)
+                transformCaster(m_casters[k]);
+        });
+        unsigned int bands = (m_size + BAND_ROWS - 1) / BAND_ROWS;
+        jobs.parallelFor(bands, 1, [this](unsigned int begin, unsigned int end, unsigned int) {
+            for (unsigned int k = begin; k < end; ++k)
+                rasterizeRows(k * BAND_ROWS, std::min((k + 1) * BAND_ROWS, m_size));
+        });
+    }
+
+    //fraction of the texels around a map space point that do not hold anything nearer to the light
+    //percentage closer filtering over (2 * filterRadius + 1)^2 texels, points outside the map are lit
+    float getVisibility(const Vec3& p) const {
+        if (!(p.x >= 0.0f && p.y >= 0.0f && p.x < float(m_size) && p.y < float(m_size)))
+            return 1.0f;
+        int x = int(p.x);
+        int y = int(p.y);
+        int r = int(m_filterRadius);
+        int last = int(m_size) - 1;
+        float z = p.z - m_bias;
+        unsigned int lit = 0;
+        for (int dy = -r; dy <= r; ++dy) {
+            const float* row = &m_depth[std::min(std::max(y + dy, 0), last) * m_size];
+            for (int dx = -r; dx <= r; ++dx)
+                lit += z <= row[std::min(std::max(x + dx, 0), last)];
+        }
+        return float(lit) / float((2 * r + 1) * (2 * r + 1));
+    }
+
+    //world space to map space, affine
+    const Mat4& getWorldToMap() const {
+        return m_worldToMap;
+    }
+
+    unsigned int getSize() const {
+        return m_size;
+    }
+
+    //receivers look up the map a texel and a half off their surface along the normal, since a texel holds
+    //one depth for a sloped patch of surface the constant bias alone leaves acne on surfaces lit at an angle
+    float getNormalOffset() const {
+        return 1.5f * m_texelSize;
+    }
+
+    void setBias(float bias) {
+        m_bias = bias;
+    }
+
+    const Stats& getStats() const {
+        return m_stats;
+    }
+
+private:
+    void transformCaster(Caster& caster) {
+        Mat4 modelToMap = m_worldToMap * caster.model;
+        Vec3* positions = &m_mapPositions[caster.firstPosition];
+        caster.yMin = std::numeric_limits<float>::max();
+        caster.yMax = std::numeric_limits<float>::lowest();
+        for (unsigned int v = 0; v < caster.mesh.vertexCount; ++v) {
+            Vec4 m = modelToMap * caster.mesh.positions[v];
+            positions[v] = {m.x, m.y, m.z};
+            caster.yMin = std::min(caster.yMin, m.y);
+            caster.yMax = std::max(caster.yMax, m.y);
+        }
+    }
+
+    //clears rows [y0, y1) and rasterizes the casters reaching them, triangles with every corner above or below the
+    //rows are skipped before setup
+    void rasterizeRows(unsigned int y0, unsigned int y1) {
+        std::fill(m_depth.begin() + y0 * m_size, m_depth.begin() + y1 * m_size, 1.0f);
+        RasterRect rect = {0, int(y0), int(m_size), int(y1)};
+        float top = float(y0);
+        float bottom = float(y1);
+        for (const Caster& caster : m_casters) {
+            if (caster.yMax < top || caster.yMin >= bottom)
+                continue;
+            const Vec3* positions = &m_mapPositions[caster.firstPosition];
+            for (unsigned int k = 0; k < caster.mesh.triangleCount; ++k) {
+                const Index& i = caster.mesh.indices[k];
+                const Vec3& a = positions[i.x];
+                const Vec3& b = positions[i.y];
+                const Vec3& c = positions[i.z];
+                if (std::max(std::max(a.y, b.y), c.y) < top || std::min(std::min(a.y, b.y), c.y) >= bottom)
+                    continue;
+                rasterizeDepth(a, b, c, m_depth.data(), m_size, rect);
+            }
+        }
+    }
+
+    //light space rotation (x right, y up, z along the light) followed by the fit of bounds into the map
+    void fit(const AABB& bounds, const Vec3& direction) {
+        Vec3 f = direction * (1.0f / direction.magnitude());
+        Vec3 helper = fabs(f.y) < 0.99f ? Vec3(0.0f, 1.0f, 0.0f) : Vec3(1.0f, 0.0f, 0.0f);
+        Vec3 r = helper.crossProduct(f);
+        r = r * (1.0f / r.magnitude());
+        Vec3 u = f.crossProduct(r);
+
+        Mat4 rotation;
+        rotation.firstCol = {r.x, u.x, f.x, 0.0f};
+        rotation.secondCol = {r.y, u.y, f.y, 0.0f};
+        rotation.thirdCol = {r.z, u.z, f.z, 0.0f};
+        AABB lightBounds = transformAABB(bounds, rotation);
+
+        //texel centers cover the bounds, y down like the screen
+        Vec3 extent = lightBounds.max - lightBounds.min;
+        float size = float(m_size);
+        m_texelSize = std::max(extent.x, extent.y) / size;
+        Mat4 toMap;
+        toMap.firstCol = {size / std::max(extent.x, 1e-6f), 0.0f, 0.0f, 0.0f};
+        toMap.secondCol = {0.0f, -size / std::max(extent.y, 1e-6f), 0.0f, 0.0f};
+        toMap.thirdCol = {0.0f, 0.0f, 1.0f / std::max(extent.z, 1e-6f), 0.0f};
+        toMap.fourthCol = {-lightBounds.min.x * toMap.firstCol.x, -lightBounds.max.y * toMap.secondCol.y,
+                           -lightBounds.min.z * toMap.thirdCol.z, 1.0f};
+        m_worldToMap = toMap * rotation;
+    }
+};
+
+}
+
+#endif //SHADOWMAP_H
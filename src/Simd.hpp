@@ -0,0 +1,343 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <math.h>
+#include <algorithm>
+
+//SSE2 is part of x64 (MSVC does not define __SSE2__ there)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PAINT_SSE2 1
+#include <emmintrin.h>
+#endif
+
+//eight wide operations use AVX when the compiler targets it, two SSE2 halves otherwise
+#ifdef __AVX__
+#define PAINT_AVX 1
+#include <immintrin.h>
+#endif
+
+namespace paint {
+
+//result of a Float4 comparison, one lane per bit
+struct Mask4
+{
+#ifdef PAINT_SSE2
+    __m128 v;
+#else
+    bool v[4];
+#endif
+
+    Mask4 operator&(const Mask4& other) const {
+#ifdef PAINT_SSE2
+        return {_mm_and_ps(v, other.v)};
+#else
+        return {{v[0] && other.v[0], v[1] && other.v[1], v[2] && other.v[2], v[3] && other.v[3]}};
+#endif
+    }
+
+    Mask4 operator|(const Mask4& other) const {
+#ifdef PAINT_SSE2
+        return {_mm_or_ps(v, other.v)};
+#else
+        return {{v[0] || other.v[0], v[1] || other.v[1], v[2] || other.v[2], v[3] || other.v[3]}};
+#endif
+    }
+
+    //bit i is lane i
+    int getBits() const {
+#ifdef PAINT_SSE2
+        return _mm_movemask_ps(v);
+#else
+        return int(v[0]) | int(v[1]) << 1 | int(v[2]) << 2 | int(v[3]) << 3;
+#endif
+    }
+
+    bool any() const {
+        return getBits() != 0;
+    }
+
+    bool all() const {
+        return getBits() == 0xf;
+    }
+};
+
+//four floats processed together (SSE2, scalar fallback elsewhere)
+struct Float4
+{
+#ifdef PAINT_SSE2
+    __m128 v;
+#else
+    float v[4];
+#endif
+
+    static Float4 load(const float* p) {
+#ifdef PAINT_SSE2
+        return {_mm_loadu_ps(p)};
+#else
+        return {{p[0], p[1], p[2], p[3]}};
+#endif
+    }
+
+    void store(float* p) const {
+#ifdef PAINT_SSE2
+        _mm_storeu_ps(p, v);
+#else
+        std::copy(v, v + 4, p);
+#endif
+    }
+
+    static Float4 set(float a) {
+#ifdef PAINT_SSE2
+        return {_mm_set1_ps(a)};
+#else
+        return {{a, a, a, a}};
+#endif
+    }
+
+    //lanes in memory order
+    static Float4 set(float a, float b, float c, float d) {
+#ifdef PAINT_SSE2
+        return {_mm_setr_ps(a, b, c, d)};
+#else
+        return {{a, b, c, d}};
+#endif
+    }
+
+    Float4 operator+(const Float4& other) const {
+#ifdef PAINT_SSE2
+        return {_mm_add_ps(v, other.v)};
+#else
+        return {{v[0] + other.v[0], v[1] + other.v[1], v[2] + other.v[2], v[3] + other.v[3]}};
+#endif
+    }
+
+    Float4 operator-(const Float4& other) const {
+#ifdef PAINT_SSE2
+        return {_mm_sub_ps(v, other.v)};
+#else
+        return {{v[0] - other.v[0], v[1] - other.v[1], v[2] - other.v[2], v[3] - other.v[3]}};
+#endif
+    }
+
+    Float4 operator*(const Float4& other) const {
+#ifdef PAINT_SSE2
+        return {_mm_mul_ps(v, other.v)};
+#else
+        return {{v[0] * other.v[0], v[1] * other.v[1], v[2] * other.v[2], v[3] * other.v[3]}};
+#endif
+    }
+
+    Float4 operator/(const Float4& other) const {
+#ifdef PAINT_SSE2
+        return {_mm_div_ps(v, other.v)};
+#else
+        return {{v[0] / other.v[0], v[1] / other.v[1], v[2] / other.v[2], v[3] / other.v[3]}};
+#endif
+    }
+
+    static Float4 sqrt(const Float4& a) {
+#ifdef PAINT_SSE2
+        return {_mm_sqrt_ps(a.v)};
+#else
+        return {{::sqrtf(a.v[0]), ::sqrtf(a.v[1]), ::sqrtf(a.v[2]), ::sqrtf(a.v[3])}};
+#endif
+    }
+
+    Mask4 operator<(const Float4& other) const {
+#ifdef PAINT_SSE2
+        return {_mm_cmplt_ps(v, other.v)};
+#else
+        return {{v[0] < other.v[0], v[1] < other.v[1], v[2] < other.v[2], v[3] < other.v[3]}};
+#endif
+    }
+
+    Mask4 operator>=(const Float4& other) const {
+#ifdef PAINT_SSE2
+        return {_mm_cmpge_ps(v, other.v)};
+#else
+        return {{v[0] >= other.v[0], v[1] >= other.v[1], v[2] >= other.v[2], v[3] >= other.v[3]}};
+#endif
+    }
+
+    static Float4 min(const Float4& a, const Float4& b) {
+#ifdef PAINT_SSE2
+        return {_mm_min_ps(a.v, b.v)};
+#else
+        return {{std::min(a.v[0], b.v[0]), std::min(a.v[1], b.v[1]), std::min(a.v[2], b.v[2]), std::min(a.v[3], b.v[3])}};
+#endif
+    }
+
+    static Float4 max(const Float4& a, const Float4& b) {
+#ifdef PAINT_SSE2
+        return {_mm_max_ps(a.v, b.v)};
+#else
+        return {{std::max(a.v[0], b.v[0]), std::max(a.v[1], b.v[1]), std::max(a.v[2], b.v[2]), std::max(a.v[3], b.v[3])}};
+#endif
+    }
+
+    //a where mask is set, b elsewhere
+    static Float4 select(const Mask4& mask, const Float4& a, const Float4& b) {
+#ifdef PAINT_SSE2
+        return {_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v))};
+#else
+        return {{mask.v[0] ? a.v[0] : b.v[0], mask.v[1] ? a.v[1] : b.v[1],
+                 mask.v[2] ? a.v[2] : b.v[2], mask.v[3] ? a.v[3] : b.v[3]}};
+#endif
+    }
+};
+
+//result of a Float8 comparison, one lane per bit
+struct Mask8
+{
+#ifdef PAINT_AVX
+    __m256 v;
+#else
+    Mask4 lo;
+    Mask4 hi;
+#endif
+
+    Mask8 operator&(const Mask8& other) const {
+#ifdef PAINT_AVX
+        return {_mm256_and_ps(v, other.v)};
+#else
+        return {lo & other.lo, hi & other.hi};
+#endif
+    }
+
+    Mask8 operator|(const Mask8& other) const {
+#ifdef PAINT_AVX
+        return {_mm256_or_ps(v, other.v)};
+#else
+        return {lo | other.lo, hi | other.hi};
+#endif
+    }
+
+    //bit i is lane i
+    int getBits() const {
+#ifdef PAINT_AVX
+        return _mm256_movemask_ps(v);
+#else
+        return lo.getBits() | hi.getBits() << 4;
+#endif
+    }
+
+    bool any() const {
+        return getBits() != 0;
+    }
+
+    bool all() const {
+        return getBits() == 0xff;
+    }
+};
+
+//eight floats processed together
+struct Float8
+{
+#ifdef PAINT_AVX
+    __m256 v;
+#else
+    Float4 lo;
+    Float4 hi;
+#endif
+
+    static Float8 load(const float* p) {
+#ifdef PAINT_AVX
+        return {_mm256_loadu_ps(p)};
+#else
+        return {Float4::load(p), Float4::load(p + 4)};
+#endif
+    }
+
+    void store(float* p) const {
+#ifdef PAINT_AVX
+        _mm256_storeu_ps(p, v);
+#else
+        lo.store(p);
+        hi.store(p + 4);
+#endif
+    }
+
+    static Float8 set(float a) {
+#ifdef PAINT_AVX
+        return {_mm256_set1_ps(a)};
+#else
+        return {Float4::set(a), Float4::set(a)};
+#endif
+    }
+
+    Float8 operator+(const Float8& other) const {
+#ifdef PAINT_AVX
+        return {_mm256_add_ps(v, other.v)};
+#else
+        return {lo + other.lo, hi + other.hi};
+#endif
+    }
+
+    Float8 operator-(const Float8& other) const {
+#ifdef PAINT_AVX
+        return {_mm256_sub_ps(v, other.v)};
+#else
+        return {lo - other.lo, hi - other.hi};
+#endif
+    }
+
+    Float8 operator*(const Float8& other) const {
+#ifdef PAINT_AVX
+        return {_mm256_mul_ps(v, other.v)};
+#else
+        return {lo * other.lo, hi * other.hi};
+#endif
+    }
+
+    Float8 operator/(const Float8& other) const {
+#ifdef PAINT_AVX
+        return {_mm256_div_ps(v, other.v)};
+#else
+        return {lo / other.lo, hi / other.hi};
+#endif
+    }
+
+    static Float8 sqrt(const Float8& a) {
+#ifdef PAINT_AVX
+        return {_mm256_sqrt_ps(a.v)};
+#else
+        return {Float4::sqrt(a.lo), Float4::sqrt(a.hi)};
+#endif
+    }
+
+    Mask8 operator<(const Float8& other) const {
+#ifdef PAINT_AVX
+        return {_mm256_cmp_ps(v, other.v, _CMP_LT_OQ)};
+#else
+        return {lo < other.lo, hi < other.hi};
+#endif
+    }
+
+    Mask8 operator>=(const Float8& other) const {
+#ifdef PAINT_AVX
+        return {_mm256_cmp_ps(v, other.v, _CMP_GE_OQ)};
+#else
+        return {lo >= other.lo, hi >= other.hi};
+#endif
+    }
+
+    static Float8 min(const Float8& a, const Float8& b) {
+#ifdef PAINT_AVX
+        return {_mm256_min_ps(a.v, b.v)};
+#else
+        return {Float4::min(a.lo, b.lo), Float4::min(a.hi, b.hi)};
+#endif
+    }
+
+    static Float8 max(const Float8& a, const Float8& b) {
+#ifdef PAINT_AVX
+        return {_mm256_max_ps(a.v, b.v)};
+#else
+        return {Float4::max(a.lo, b.lo), Float4::max(a.hi, b.hi)};
+#endif
+    }
+};
+
+}
+
+#endif //SIMD_H
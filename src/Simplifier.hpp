@@ -0,0 +1,336 @@
+#ifndef SIMPLIFIER_H
+#define SIMPLIFIER_H
+
+#include <math.h>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include "Math.hpp"
+#include "Vertex.hpp"
+
+namespace paint {
+
+//mesh simplification by edge collapse with quadric error metrics (Garland and Heckbert)
+//used at load time to build level of detail meshes
+class Simplifier {
+private:
+    //symmetric 4x4 matrix, upper triangle stored row by row
+    struct Quadric {
+        double a[10] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+
+        //plane n * p + d = 0 (n normalized)
+        static Quadric fromPlane(double nx, double ny, double nz, double d, double weight) {
+            Quadric q;
+            q.a[0] = nx * nx; q.a[1] = nx * ny; q.a[2] = nx * nz; q.a[3] = nx * d;
+            q.a[4] = ny * ny; q.a[5] = ny * nz; q.a[6] = ny * d;
+            q.a[7] = nz * nz; q.a[8] = nz * d;
+            q.a[9] = d * d;
+            for (double& v : q.a)
+                v *= weight;
+            return q;
+        }
+
+        Quadric operator+(const Quadric& other) const {
+            Quadric q;
+            for (int i = 0; i < 10; ++i)
+                q.a[i] = a[i] + other.a[i];
+            return q;
+        }
+
+        double evaluate(const Vec3& p) const {
+            double x = p.x, y = p.y, z = p.z;
+            return a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x +
+                   a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y +
+                   a[7] * z * z + 2.0 * a[8] * z + a[9];
+        }
+
+        //position minimizing the error, false if the system is (nearly) singular
+        //or empty (a vertex with only degenerate triangles has no planes)
+        bool getOptimal(Vec3& p) const {
+            double det = a[0] * (a[4] * a[7] - a[5] * a[5]) - a[1] * (a[1] * a[7] - a[5] * a[2]) + a[2] * (a[1] * a[5] - a[4] * a[2]);
+            double scale = a[0] + a[4] + a[7];
+            if (scale <= 0.0 || fabs(det) <= 1e-9 * scale * scale * scale)
+                return false;
+            //Cramer's rule on A p = -b
+            double bx = -a[3], by = -a[6], bz = -a[8];
+            double dx = bx * (a[4] * a[7] - a[5] * a[5]) - a[1] * (by * a[7] - a[5] * bz) + a[2] * (by * a[5] - a[4] * bz);
+            double dy = a[0] * (by * a[7] - bz * a[5]) - bx * (a[1] * a[7] - a[5] * a[2]) + a[2] * (a[1] * bz - by * a[2]);
+            double dz = a[0] * (a[4] * bz - a[5] * by) - a[1] * (a[1] * bz - by * a[2]) + bx * (a[1] * a[5] - a[4] * a[2]);
+            p = {float(dx / det), float(dy / det), float(dz / det)};
+            return true;
+        }
+    };
+
+    struct Collapse {
+        double cost;
+        unsigned int v0;
+        unsigned int v1;
+        unsigned int version0;
+        unsigned int version1;
+        Vec3 target;
+
+        bool operator<(const Collapse& other) const {
+            return cost > other.cost; //min heap
+        }
+    };
+
+    std::vector<Vec3> m_positions;
+    std::vector<Quadric> m_quadrics;
+    std::vector<unsigned int> m_versions; //bumped when a vertex moves, stale collapses are skipped
+    std::vector<bool> m_removedVertices;
+    std::vector<Index> m_triangles;
+    std::vector<bool> m_removedTriangles;
+    std::vector<std::vector<unsigned int>> m_vertexTriangles;
+    std::priority_queue<Collapse> m_queue;
+    unsigned int m_triangleCount;
+
+public:
+    //returns a mesh with at most targetTriangles triangles, or as close as possible without flipping faces
+    static Vertex simplify(const Vertex& mesh, unsigned int targetTriangles) {
+        Simplifier s(mesh);
+        s.run(targetTriangles);
+        return s.getMesh();
+    }
+
+    //levels[0] is the original mesh, each following level has ratio times the triangles of the previous one
+    static std::vector<Vertex> buildLods(const Vertex& mesh, unsigned int levels, float ratio = 0.5f) {
+        std::vector<Vertex> lods;
+        lods.push_back(mesh);
+        Simplifier s(mesh);
+        for (unsigned int i = 1; i < levels; ++i) {
+            unsigned int target = (unsigned int)(lods.back().indices.size() * ratio);
+            s.run(target);
+            lods.push_back(s.getMesh());
+        }
+        return lods;
+    }
+
+private:
+    Simplifier(const Vertex& mesh) :
+        m_versions(mesh.positions.size(), 0),
+        m_removedVertices(mesh.positions.size(), false),
+        m_triangles(mesh.indices),
+        m_removedTriangles(mesh.indices.size(), false),
+        m_vertexTriangles(mesh.positions.size()),
+        m_triangleCount(mesh.indices.size())
+    {
+        for (const Vec4& p : mesh.positions)
+            m_positions.emplace_back(p.x, p.y, p.z);
+        m_quadrics.resize(m_positions.size());
+
+        for (unsigned int t = 0; t < m_triangles.size(); ++t) {
+            const Index& i = m_triangles.at(t);
+            m_vertexTriangles.at(i.x).push_back(t);
+            m_vertexTriangles.at(i.y).push_back(t);
+            m_vertexTriangles.at(i.z).push_back(t);
+
+            //area weighted plane quadric
+            Vec3 normal = (m_positions.at(i.y) - m_positions.at(i.x)).crossProduct(m_positions.at(i.z) - m_positions.at(i.x));
+            float length = normal.magnitude();
+            if (length <= 0.0f)
+                continue;
+            normal = normal * (1.0f / length);
+            Quadric q = Quadric::fromPlane(normal.x, normal.y, normal.z, -(normal * m_positions.at(i.x)), length * 0.5);
+            m_quadrics.at(i.x) = m_quadrics.at(i.x) + q;
+            m_quadrics.at(i.y) = m_quadrics.at(i.y) + q;
+            m_quadrics.at(i.z) = m_quadrics.at(i.z) + q;
+        }
+
+        addBoundaryQuadrics();
+
+        for (const Index& i : m_triangles) {
+            pushCollapse(i.x, i.y);
+            pushCollapse(i.y, i.z);
+            pushCollapse(i.z, i.x);
+        }
+    }
+
+    //border edges (used by one triangle) get a heavily weighted plane perpendicular to the face,
+    //so open borders stay in place
+    void addBoundaryQuadrics() {
+        for (unsigned int t = 0; t < m_triangles.size(); ++t) {
+            const Index& i = m_triangles.at(t);
+            unsigned int corners[3] = {i.x, i.y, i.z};
+            Vec3 faceNormal = (m_positions.at(i.y) - m_positions.at(i.x)).crossProduct(m_positions.at(i.z) - m_positions.at(i.x));
+            for (unsigned int k = 0; k < 3; ++k) {
+                unsigned int a = corners[k];
+                unsigned int b = corners[(k + 1) % 3];
+                if (countEdgeTriangles(a, b) != 1)
+                    continue;
+                Vec3 edge = m_positions.at(b) - m_positions.at(a);
+                Vec3 normal = edge.crossProduct(faceNormal);
+                float length = normal.magnitude();
+                if (length <= 0.0f)
+                    continue;
+                normal = normal * (1.0f / length);
+                Quadric q = Quadric::fromPlane(normal.x, normal.y, normal.z, -(normal * m_positions.at(a)), 100.0 * (edge * edge));
+                m_quadrics.at(a) = m_quadrics.at(a) + q;
+                m_quadrics.at(b) = m_quadrics.at(b) + q;
+            }
+        }
+    }
+
+    unsigned int countEdgeTriangles(unsigned int a, unsigned int b) const {
+        unsigned int count = 0;
+        for (unsigned int t : m_vertexTriangles.at(a)) {
+            if (!m_removedTriangles.at(t) && hasVertex(m_triangles.at(t), b))
+                ++count;
+        }
+        return count;
+    }
+
+    static bool hasVertex(const Index& i, unsigned int v) {
+        return i.x == v || i.y == v || i.z == v;
+    }
+
+    void pushCollapse(unsigned int v0, unsigned int v1) {
+        Quadric q = m_quadrics.at(v0) + m_quadrics.at(v1);
+        Collapse c;
+        c.v0 = v0;
+        c.v1 = v1;
+        c.version0 = m_versions.at(v0);
+        c.version1 = m_versions.at(v1);
+
+        //optimal point must stay near the edge, flat regions give unstable solutions
+        Vec3 midpoint = (m_positions.at(v0) + m_positions.at(v1)) * 0.5f;
+        Vec3 edge = m_positions.at(v1) - m_positions.at(v0);
+        if (!q.getOptimal(c.target) || (c.target - midpoint) * (c.target - midpoint) > edge * edge) {
+            //fall back to the best of the endpoints and midpoint
+            Vec3 candidates[3] = {m_positions.at(v0), m_positions.at(v1), midpoint};
+            c.target = candidates[0];
+            for (const Vec3& p : candidates) {
+                if (q.evaluate(p) < q.evaluate(c.target))
+                    c.target = p;
+            }
+        }
+        c.cost = q.evaluate(c.target);
+        m_queue.push(c);
+    }
+
+    //moving v0 and v1 to target must not flip any remaining triangle
+    bool flipsTriangles(unsigned int v0, unsigned int v1, const Vec3& target) const {
+        for (unsigned int v : {v0, v1}) {
+            for (unsigned int t : m_vertexTriangles.at(v)) {
+                const Index& i = m_triangles.at(t);
+                if (m_removedTriangles.at(t) || (hasVertex(i, v0) && hasVertex(i, v1)))
+                    continue;
+
+                Vec3 p[3] = {m_positions.at(i.x), m_positions.at(i.y), m_positions.at(i.z)};
+                Vec3 before = (p[1] - p[0]).crossProduct(p[2] - p[0]);
+                if (i.x == v) p[0] = target;
+                if (i.y == v) p[1] = target;
+                if (i.z == v) p[2] = target;
+                Vec3 after = (p[1] - p[0]).crossProduct(p[2] - p[0]);
+                if (before * after <= 0.0f)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    //link condition: the only vertices adjacent to both v0 and v1 may be the apexes of the triangles on the edge,
+    //any other common neighbor would be pinched into a non manifold fold
+    bool breaksLink(unsigned int v0, unsigned int v1) const {
+        std::vector<unsigned int> apexes;
+        std::vector<unsigned int> neighbors;
+        for (unsigned int t : m_vertexTriangles.at(v0)) {
+            if (m_removedTriangles.at(t))
+                continue;
+            const Index& i = m_triangles.at(t);
+            for (unsigned int v : {i.x, i.y, i.z}) {
+                if (v != v0 && v != v1)
+                    (hasVertex(i, v1) ? apexes : neighbors).push_back(v);
+            }
+        }
+        for (unsigned int t : m_vertexTriangles.at(v1)) {
+            const Index& i = m_triangles.at(t);
+            if (m_removedTriangles.at(t) || hasVertex(i, v0))
+                continue;
+            for (unsigned int v : {i.x, i.y, i.z}) {
+                if (v != v1 && std::find(apexes.begin(), apexes.end(), v) == apexes.end() &&
+                    std::find(neighbors.begin(), neighbors.end(), v) != neighbors.end())
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    void run(unsigned int targetTriangles) {
+        while (m_triangleCount > targetTriangles && !m_queue.empty()) {
+            Collapse c = m_queue.top();
+            m_queue.pop();
+
+            if (m_removedVertices.at(c.v0) || m_removedVertices.at(c.v1))
+                continue;
+            if (c.version0 != m_versions.at(c.v0) || c.version1 != m_versions.at(c.v1))
+                continue;
+            if (breaksLink(c.v0, c.v1) || flipsTriangles(c.v0, c.v1, c.target))
+                continue;
+
+            collapse(c.v0, c.v1, c.target);
+        }
+    }
+
+    //merge v1 into v0
+    void collapse(unsigned int v0, unsigned int v1, const Vec3& target) {
+        m_positions.at(v0) = target;
+        m_quadrics.at(v0) = m_quadrics.at(v0) + m_quadrics.at(v1);
+        m_removedVertices.at(v1) = true;
+        ++m_versions.at(v0);
+
+        for (unsigned int t : m_vertexTriangles.at(v1)) {
+            if (m_removedTriangles.at(t))
+                continue;
+            Index& i = m_triangles.at(t);
+            if (hasVertex(i, v0)) {
+                m_removedTriangles.at(t) = true;
+                --m_triangleCount;
+                continue;
+            }
+            if (i.x == v1) i.x = v0;
+            if (i.y == v1) i.y = v0;
+            if (i.z == v1) i.z = v0;
+            m_vertexTriangles.at(v0).push_back(t);
+        }
+        m_vertexTriangles.at(v1).clear();
+
+        //drop removed triangles from v0 and requeue its edges with the new version
+        std::vector<unsigned int>& triangles = m_vertexTriangles.at(v0);
+        triangles.erase(std::remove_if(triangles.begin(), triangles.end(),
+                                       [this](unsigned int t) { return m_removedTriangles.at(t); }),
+                        triangles.end());
+        for (unsigned int t : triangles) {
+            const Index& i = m_triangles.at(t);
+            for (unsigned int v : {i.x, i.y, i.z}) {
+                if (v != v0)
+                    pushCollapse(v0, v);
+            }
+        }
+    }
+
+    //compacts remaining vertices and triangles
+    Vertex getMesh() const {
+        Vertex mesh;
+        std::vector<unsigned int> remap(m_positions.size(), ~0u);
+        for (unsigned int t = 0; t < m_triangles.size(); ++t) {
+            if (m_removedTriangles.at(t))
+                continue;
+            const Index& i = m_triangles.at(t);
+            unsigned int corners[3] = {i.x, i.y, i.z};
+            for (unsigned int& v : corners) {
+                if (remap.at(v) == ~0u) {
+                    remap.at(v) = mesh.positions.size();
+                    const Vec3& p = m_positions.at(v);
+                    mesh.positions.emplace_back(p.x, p.y, p.z, 1.0f);
+                }
+                v = remap.at(v);
+            }
+            mesh.indices.emplace_back(corners[0], corners[1], corners[2]);
+        }
+        return mesh;
+    }
+};
+
+}
+
+#endif //SIMPLIFIER_H
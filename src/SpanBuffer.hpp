@@ -0,0 +1,243 @@
+#ifndef SPANBUFFER_H
+#define SPANBUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+namespace paint {
+
+//hidden surface removal without a depth plane: every row keeps a sorted list of non overlapping spans
+//incoming spans are clipped against the stored ones where they are farther (ties keep what is stored,
+//like the z-buffer), so after all opaque spans are in every pixel is written exactly once by resolve()
+//depth and a gray level are linear along a span, the pixel color is color scaled by the gray level
+class SpanBuffer {
+public:
+    static constexpr int32_t NONE = -1;
+
+    struct Span
+    {
+        int x0; //pixels [x0, x1)
+        int x1;
+        float z; //at the center of pixel x0
+        float dzdx;
+        float gray; //0 - 255 at the center of pixel x0
+        float dgray;
+        uint32_t color; //RGBA8888
+        int32_t next; //index of the span to the right, NONE at the end of the row
+    };
+private:
+    std::vector<int32_t> m_rows; //first span of every row
+    std::vector<Span> m_spans; //pool for every row, unlinked spans are kept in the free list
+    int32_t m_free;
+    unsigned int m_count; //linked spans
+public:
+    SpanBuffer() : m_free(NONE), m_count(0) {};
+
+    void resize(int height) {
+        m_rows.assign(height, NONE);
+        m_spans.clear();
+        m_free = NONE;
+        m_count = 0;
+    }
+
+    //empties every row, pool memory is kept for the next frame
+    void clear() {
+        std::fill(m_rows.begin(), m_rows.end(), NONE);
+        m_spans.clear();
+        m_free = NONE;
+        m_count = 0;
+    }
+
+    //adds pixels [xStart, xEnd) of row y where they are nearer than the stored spans
+    //z and gray at the center of xStart, stepping dzdx and dgray per pixel
+    void insert(int y, int xStart, int xEnd, float z, float dzdx, uint32_t color, float gray, float dgray) {
+        Span incoming = {xStart, xEnd, z, dzdx, gray, dgray, color, NONE};
+        int32_t previous = NONE;
+        int32_t current = m_rows[y];
+        int32_t lastPiece = NONE; //of incoming, adjacent pieces are merged
+        int x = xStart;
+        while (x < xEnd) {
+            while (current != NONE && m_spans[current].x1 <= x) {
+                previous = current;
+                current = m_spans[current].next;
+            }
+            //gap before the next stored span
+            if (current == NONE || m_spans[current].x0 >= xEnd) {
+                addPiece(y, incoming, x, xEnd, previous, lastPiece);
+                break;
+            }
+            Span stored = m_spans[current];
+            if (stored.x0 > x) {
+                addPiece(y, incoming, x, stored.x0, previous, lastPiece);
+                x = stored.x0;
+                continue;
+            }
+
+            int end = std::min(xEnd, stored.x1);
+            int visible0, visible1;
+            getNearer(incoming, stored, x, end, visible0, visible1);
+            if (visible0 < visible1) {
+                //stored keeps [x0, visible0) and [visible1, x1)
+                if (visible1 < stored.x1) {
+                    int32_t right = allocate(advance(stored, visible1));
+                    m_spans[right].next = m_spans[current].next;
+                    m_spans[current].next = right;
+                }
+                if (visible0 > stored.x0) {
+                    m_spans[current].x1 = visible0;
+                    previous = current;
+                } else {
+                    link(y, previous) = m_spans[current].next;
+                    release(current);
+                }
+                addPiece(y, incoming, visible0, visible1, previous, lastPiece);
+                current = m_spans[previous].next;
+            }
+            x = end;
+        }
+    }
+
+    //calls visible(x0, x1) for the parts of [xStart, xEnd) on row y nearer than the stored spans, nothing is stored
+    //for translucent spans drawn over the resolved opaque ones
+    template<typename Visible>
+    void forEachVisible(int y, int xStart, int xEnd, float z, float dzdx, Visible&& visible) const {
+        Span incoming = {xStart, xEnd, z, dzdx, 0.0f, 0.0f, 0, NONE};
+        int x = xStart;
+        for (int32_t current = m_rows[y]; current != NONE && x < xEnd; current = m_spans[current].next) {
+            const Span& stored = m_spans[current];
+            if (stored.x1 <= x)
+                continue;
+            if (stored.x0 >= xEnd)
+                break;
+            if (stored.x0 > x)
+                visible(x, stored.x0);
+            x = std::max(x, stored.x0);
+            int end = std::min(xEnd, stored.x1);
+            int visible0, visible1;
+            getNearer(incoming, stored, x, end, visible0, visible1);
+            if (visible0 < visible1)
+                visible(visible0, visible1);
+            x = end;
+        }
+        if (x < xEnd)
+            visible(x, xEnd);
+    }
+
+    //writes every stored span into color (rows width pixels apart), returns the pixels written
+    unsigned int resolve(uint32_t* color, int width) const {
+        unsigned int written = 0;
+        for (unsigned int y = 0; y < m_rows.size(); ++y) {
+            uint32_t* row = color + y * width;
+            for (int32_t current = m_rows[y]; current != NONE; current = m_spans[current].next) {
+                const Span& span = m_spans[current];
+                float gray = span.gray;
+                if (span.dgray == 0.0f) {
+                    std::fill(row + span.x0, row + span.x1, shade(span.color, gray));
+                } else {
+                    for (int x = span.x0; x < span.x1; ++x) {
+                        row[x] = shade(span.color, gray);
+                        gray += span.dgray;
+                    }
+                }
+                written += span.x1 - span.x0;
+            }
+        }
+        return written;
+    }
+
+    //color with RGB scaled by gray (0 - 255, clamped), alpha kept
+    static uint32_t shade(uint32_t color, float gray) {
+        uint32_t g = uint32_t(std::min(std::max(gray, 0.0f), 255.0f));
+        uint32_t r = (color >> 24) * g / 255;
+        uint32_t gr = (color >> 16 & 0xff) * g / 255;
+        uint32_t b = (color >> 8 & 0xff) * g / 255;
+        return r << 24 | gr << 16 | b << 8 | (color & 0xff);
+    }
+
+    //spans linked into rows
+    unsigned int getSpanCount() const {
+        return m_count;
+    }
+
+    //row heads plus the span pool
+    size_t getBytes() const {
+        return m_rows.size() * sizeof(int32_t) + m_spans.capacity() * sizeof(Span);
+    }
+
+private:
+    //next field of previous, the row head if previous is NONE
+    int32_t& link(int y, int32_t previous) {
+        return previous == NONE ? m_rows[y] : m_spans[previous].next;
+    }
+
+    //span moved to start at x, same line
+    static Span advance(const Span& span, int x) {
+        Span moved = span;
+        moved.x0 = x;
+        moved.z += float(x - span.x0) * span.dzdx;
+        moved.gray += float(x - span.x0) * span.dgray;
+        return moved;
+    }
+
+    //pixels [visible0, visible1) of [x, end) where incoming is nearer than stored, one interval since
+    //the depth difference is linear along the row
+    static void getNearer(const Span& incoming, const Span& stored, int x, int end, int& visible0, int& visible1) {
+        float difference = incoming.z + float(x - incoming.x0) * incoming.dzdx - stored.z - float(x - stored.x0) * stored.dzdx;
+        float slope = incoming.dzdx - stored.dzdx;
+        visible0 = x;
+        visible1 = end;
+        if (slope == 0.0f) {
+            if (difference >= 0.0f)
+                visible1 = x;
+            return;
+        }
+        //difference reaches zero at pixel x + crossing, nearer before it if slope > 0 and after it otherwise
+        float crossing = float(x) - difference / slope;
+        crossing = std::min(std::max(crossing, float(x) - 1.0f), float(end));
+        if (slope > 0.0f)
+            visible1 = std::max(int(ceil(crossing)), x);
+        else
+            visible0 = std::min(int(floor(crossing)) + 1, end);
+    }
+
+    //piece [x0, x1) of incoming after previous, which becomes the piece
+    void addPiece(int y, const Span& incoming, int x0, int x1, int32_t& previous, int32_t& lastPiece) {
+        if (lastPiece != NONE && lastPiece == previous && m_spans[lastPiece].x1 == x0) {
+            m_spans[lastPiece].x1 = x1;
+            return;
+        }
+        Span piece = advance(incoming, x0);
+        piece.x1 = x1;
+        int32_t index = allocate(piece);
+        int32_t& before = link(y, previous);
+        m_spans[index].next = before;
+        before = index;
+        previous = index;
+        lastPiece = index;
+    }
+
+    int32_t allocate(const Span& span) {
+        ++m_count;
+        if (m_free != NONE) {
+            int32_t index = m_free;
+            m_free = m_spans[index].next;
+            m_spans[index] = span;
+            return index;
+        }
+        m_spans.push_back(span);
+        return int32_t(m_spans.size() - 1);
+    }
+
+    void release(int32_t index) {
+        --m_count;
+        m_spans[index].next = m_free;
+        m_free = index;
+    }
+};
+
+}
+
+#endif //SPANBUFFER_H
@@ -3,12 +3,14 @@
 
 #include "Entity.hpp"
 #include "Vertex.hpp"
+#include "MeshGenerator.hpp"
 
 namespace paint {
 
+//icosphere entity, 20 * 4^subdivisions triangles
 class Sphere: public Entity {
 public:
-    Sphere() : Entity(v) {
+    Sphere(float radius, unsigned int subdivisions) : Entity(MeshGenerator::makeIcosphere(radius, subdivisions)) {
 
     }
 private:
@@ -0,0 +1,140 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+namespace paint {
+
+//frame pacing at the window over the last presented frames, measured where SDL_RenderPresent is called
+struct PresentPacing
+{
+    unsigned int framesPresented = 0;
+    unsigned int framesLate = 0; //since the start, shown over one and a half refresh periods after the one before
+    float intervalMilliseconds = 0.0f; //mean time between presents
+    float jitterMilliseconds = 0.0f; //standard deviation of that
+    float maxIntervalMilliseconds = 0.0f;
+    float vsyncMilliseconds = 0.0f; //mean time blocked in SDL_RenderPresent
+    float queueMilliseconds = 0.0f; //present thread, mean time a finished frame waited for it
+    unsigned int queued = 0; //present thread, frames waiting for it or being presented
+};
+
+//per frame counters, reset by Camera::beginFrame()
+struct FrameStats
+{
+    unsigned int entitiesDrawn = 0;
+    unsigned int entitiesCulled = 0; //rejected by bounding volume frustum test
+    unsigned int entitiesOccluded = 0; //hidden behind occluders in the occlusion buffer
+    unsigned int occluderTriangles = 0; //rasterized into the occlusion buffer
+    unsigned int bvhNodesVisited = 0; //scene hierarchy nodes tested against the frustum
+    unsigned int trianglesSubmitted = 0; //triangles of the selected level of detail, before backface culling
+    unsigned int clustersCulled = 0; //meshlets rejected by their normal cone or bounds
+    unsigned int clusterTrianglesCulled = 0; //triangles in those meshlets, never tested one by one
+    unsigned int lightsCulled = 0; //entity and light pairs skipped because the light can not reach the entity
+    unsigned int stateChanges = 0; //material switches between consecutive draws
+    unsigned int pixelsWritten = 0; //pixels that passed the depth test, more than the covered area means overdraw
+    size_t arenaBytes = 0; //frame arena memory used by pipeline temporaries
+    unsigned int shadowTriangles = 0; //rasterized into shadow maps
+    std::vector<float> shadowMilliseconds; //per shadowed light, map clear, fit and render over the workers
+    size_t gBufferBytes = 0; //deferred path, planes beyond the screen's color and depth
+    size_t visibilityBytes = 0; //visibility path, id plane and triangle records
+    unsigned int visibilityTriangles = 0; //visibility path, triangles kept for shading
+    float lightingMilliseconds = 0.0f; //deferred lighting pass
+    unsigned int lightTiles = 0; //deferred screen tiles with lit pixels
+    unsigned int tileLights = 0; //point lights evaluated summed over those tiles
+    unsigned int spans = 0; //span buffer mode, visible spans after the opaque draws
+    size_t spanBytes = 0; //span buffer mode, instead of the z-buffer
+    float frameMilliseconds = 0.0f; //frame pipeline, between this frame's presentation and the one before
+    float recordMilliseconds = 0.0f; //frame pipeline, input and geometry on the main thread
+    float rasterMilliseconds = 0.0f; //frame pipeline, on the raster thread
+    unsigned int latency = 0; //frame pipeline, frames between recording and presentation
+    unsigned int geometryBatches = 0; //job system, render queue entries and parts of large meshes processed as one job
+    unsigned int batchesStolen = 0; //job system, taken from another worker's deque
+    std::vector<float> workerUtilization; //job system, per worker busy fraction of the frame's parallel loops
+    PresentPacing pacing; //copied from the screen when the frame is shown
+
+    void reset() {
+        *this = FrameStats();
+    }
+
+    std::string toString() const {
+        return "drawn: " + std::to_string(entitiesDrawn) +
+               "  culled: " + std::to_string(entitiesCulled) +
+               "  occluded: " + std::to_string(entitiesOccluded) +
+               "  bvh nodes: " + std::to_string(bvhNodesVisited) +
+               "  triangles: " + std::to_string(trianglesSubmitted) +
+               "  clusters culled: " + std::to_string(clustersCulled) +
+               " (" + std::to_string(clusterTrianglesCulled) + " tris)" +
+               "  lights culled: " + std::to_string(lightsCulled) +
+               "  state changes: " + std::to_string(stateChanges) +
+               "  pixels: " + std::to_string(pixelsWritten) +
+               "  arena: " + std::to_string(arenaBytes / 1024) + " KB" +
+               shadowsToString() + deferredToString() + spansToString() + jobsToString() + pipelineToString() + pacingToString();
+    }
+
+private:
+    std::string shadowsToString() const {
+        if (shadowMilliseconds.empty())
+            return "";
+        std::string text = "  shadows:";
+        char buffer[32];
+        for (float milliseconds : shadowMilliseconds) {
+            snprintf(buffer, sizeof(buffer), " %.2f", milliseconds);
+            text += buffer;
+        }
+        return text + " ms (" + std::to_string(shadowTriangles) + " tris)";
+    }
+
+    std::string pipelineToString() const {
+        if (frameMilliseconds == 0.0f)
+            return "";
+        char buffer[96];
+        snprintf(buffer, sizeof(buffer), "  frame: %.2f ms (record %.2f, raster %.2f, latency %u)", frameMilliseconds,
+                 recordMilliseconds, rasterMilliseconds, latency);
+        return buffer;
+    }
+
+    std::string pacingToString() const {
+        if (pacing.framesPresented == 0)
+            return "";
+        char buffer[128];
+        snprintf(buffer, sizeof(buffer), "  present: %.2f ms +- %.2f (max %.2f, vsync %.2f, queue %.2f / %u, late %u)",
+                 pacing.intervalMilliseconds, pacing.jitterMilliseconds, pacing.maxIntervalMilliseconds,
+                 pacing.vsyncMilliseconds, pacing.queueMilliseconds, pacing.queued, pacing.framesLate);
+        return buffer;
+    }
+
+    std::string jobsToString() const {
+        if (workerUtilization.empty())
+            return "";
+        std::string text = "  jobs: " + std::to_string(geometryBatches) + " (" + std::to_string(batchesStolen) +
+                           " stolen), workers:";
+        for (float utilization : workerUtilization)
+            text += " " + std::to_string(int(utilization * 100.0f + 0.5f)) + "%";
+        return text;
+    }
+
+    std::string spansToString() const {
+        if (spanBytes == 0)
+            return "";
+        return "  spans: " + std::to_string(spans) + " (" + std::to_string(spanBytes / 1024) + " KB)";
+    }
+
+    std::string deferredToString() const {
+        if (gBufferBytes == 0 && visibilityBytes == 0)
+            return "";
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), "%.2f ms (%.1f point lights per tile)", lightingMilliseconds,
+                 lightTiles > 0 ? float(tileLights) / float(lightTiles) : 0.0f);
+        std::string text = gBufferBytes > 0 ? "  gbuffer: " + std::to_string(gBufferBytes / 1024) + " KB" :
+                           "  visibility: " + std::to_string(visibilityBytes / 1024) + " KB (" +
+                           std::to_string(visibilityTriangles) + " tris)";
+        return text + "  lighting: " + buffer;
+    }
+};
+
+}
+
+#endif //STATS_H
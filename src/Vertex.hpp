@@ -2,6 +2,7 @@
 #define VERTEX_H
 
 #include "Math.hpp"
+#include "Bounds.hpp"
 #include "Texture.hpp"
 #include <vector>
 
@@ -10,11 +11,85 @@ namespace paint {
 struct Vertex {
     std::vector<Vec4> positions; 
     std::vector<Index> indices; 
-    std::vector<Vec3> normals;
+    std::vector<Vec3> normals; //one per position, computed by Entity when the mesh has none
     std::vector<float> shadingLevel; //float 0 - 1 (multiple by color values to simulate lighting)
+    std::vector<float> vertexLight; //light level per position for Gouraud shading, empty otherwise
+    std::vector<Vec3> viewNormals; //view space normal per position for deferred Gouraud shading, empty otherwise
+    std::vector<Vec3> faceNormals; //view space normal per triangle for deferred flat shading, empty otherwise
     std::vector<bool> cullFlags;  //each cull flag is associated with an index
+    AABB aabb; //object space bounds, precomputed by Entity
+    BoundingSphere boundingSphere;
 };
 
+//read only triangles of a mesh, in a Vertex or in a mapped cooked mesh
+struct MeshData {
+    const Vec4* positions = nullptr;
+    const Index* indices = nullptr;
+    const Vec3* normals = nullptr; //one per position
+    unsigned int vertexCount = 0;
+    unsigned int triangleCount = 0;
+};
+
+inline MeshData getMeshData(const Vertex& vertex) {
+    MeshData mesh;
+    mesh.positions = vertex.positions.data();
+    mesh.indices = vertex.indices.data();
+    mesh.normals = vertex.normals.size() == vertex.positions.size() ? vertex.normals.data() : nullptr;
+    mesh.vertexCount = vertex.positions.size();
+    mesh.triangleCount = vertex.indices.size();
+    return mesh;
+}
+
+//drops what the last draw computed into a buffer that is reused for another one, capacity is kept
+inline void clearDrawState(Vertex& vertex) {
+    vertex.shadingLevel.clear();
+    vertex.vertexLight.clear();
+    vertex.viewNormals.clear();
+    vertex.faceNormals.clear();
+    vertex.cullFlags.clear();
+}
+
+//owning copy of mesh into vertex, for a drawable to transform in place
+//vertex may be the buffer of an earlier draw, its capacity is kept
+inline void copyMesh(const MeshData& mesh, Vertex& vertex) {
+    vertex.positions.assign(mesh.positions, mesh.positions + mesh.vertexCount);
+    vertex.indices.assign(mesh.indices, mesh.indices + mesh.triangleCount);
+    if (mesh.normals != nullptr)
+        vertex.normals.assign(mesh.normals, mesh.normals + mesh.vertexCount);
+    else
+        vertex.normals.clear();
+    clearDrawState(vertex);
+}
+
+inline Vertex copyMesh(const MeshData& mesh) {
+    Vertex vertex;
+    copyMesh(mesh, vertex);
+    return vertex;
+}
+
+//unit vertex normals, the average of the face normals around each vertex weighted by face area
+//vertices without a non degenerate face get a zero normal
+inline std::vector<Vec3> computeVertexNormals(const std::vector<Vec4>& positions, const std::vector<Index>& indices) {
+    std::vector<Vec3> normals(positions.size(), Vec3(0.0f, 0.0f, 0.0f));
+    for (const Index& i : indices) {
+        const Vec4& v0 = positions.at(i.x);
+        const Vec4& v1 = positions.at(i.y);
+        const Vec4& v2 = positions.at(i.z);
+        Vec3 a = {v1.x - v0.x, v1.y - v0.y, v1.z - v0.z};
+        Vec3 b = {v2.x - v0.x, v2.y - v0.y, v2.z - v0.z};
+        Vec3 normal = a.crossProduct(b); //length is twice the area
+        normals[i.x] = normals[i.x] + normal;
+        normals[i.y] = normals[i.y] + normal;
+        normals[i.z] = normals[i.z] + normal;
+    }
+    for (Vec3& n : normals) {
+        float length = n.magnitude();
+        if (length > 0.0f)
+            n = n * (1.0f / length);
+    }
+    return normals;
+}
+
 }
 
 #endif VERTEX_H
\ No newline at end of file
@@ -0,0 +1,143 @@
+#ifndef VISIBILITYBUFFER_H
+#define VISIBILITYBUFFER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <algorithm>
+#include <vector>
+#include "Math.hpp"
+#include "Vertex.hpp"
+#include "Material.hpp"
+#include "Pipeline.hpp"
+#include "Light.hpp"
+#include "GBuffer.hpp"
+
+namespace paint {
+
+//id of the visible triangle per pixel for visibility buffer shading
+//rasterization only tests depth and stores an id, the triangles drawn this frame are kept in screen space with
+//their view space normals, the lighting pass rebuilds the normal of every covered pixel from its triangle and
+//shades it once, so shading cost follows the resolution and not the overdraw
+class VisibilityBuffer {
+public:
+    static constexpr uint32_t EMPTY = 0; //ids are triangle indices + 1
+private:
+    int m_width;
+    int m_height;
+    std::vector<uint32_t> m_ids;
+    //per triangle drawn since clear(), three corners each
+    std::vector<Vec3> m_corners; //screen space
+    std::vector<Vec3> m_normals; //view space, not normalized
+    std::vector<uint8_t> m_surfaces; //GBuffer::Surface
+public:
+    VisibilityBuffer() : m_width(0), m_height(0) {};
+
+    //id plane for a width * height target, contents are undefined until clear()
+    void resize(int width, int height) {
+        if (width == m_width && height == m_height)
+            return;
+        m_width = width;
+        m_height = height;
+        m_ids.resize(size_t(width) * height);
+    }
+
+    //empties the id plane and forgets the triangles, their memory is kept for the next frame
+    void clear() {
+        std::fill(m_ids.begin(), m_ids.end(), EMPTY);
+        m_corners.clear();
+        m_normals.clear();
+        m_surfaces.clear();
+    }
+
+    unsigned int getTriangleCount() const {
+        return m_surfaces.size();
+    }
+
+    //rasterizes the unculled triangles of buffer (screen space, clipped) into the id plane, depth tested and written
+    //in target's depth plane, and keeps them with their normals as set up for shading: faceNormals for flat,
+    //viewNormals for Gouraud and none for unlit
+    void draw(const Vertex& buffer, ShadingMode shading, RenderTarget& target) {
+        assert(buffer.indices.size() <= buffer.cullFlags.size());
+        RenderTarget ids = target;
+        ids.color = m_ids.data();
+        for (unsigned int k = 0; k < buffer.indices.size(); ++k) {
+            if (buffer.cullFlags[k])
+                continue;
+            uint32_t id = addTriangle(buffer, k, shading);
+            const Vec3* c = &m_corners[(id - 1) * 3];
+            makePipeline(PositionShader(), SolidColorShader{id}).rasterize(c[0], c[1], c[2], nullptr, ids);
+        }
+        target.pixelsWritten = ids.pixelsWritten;
+    }
+
+    //id plane plus the triangle records
+    size_t getBytes() const {
+        return m_ids.size() * sizeof(uint32_t) + (m_corners.size() + m_normals.size()) * sizeof(Vec3) + m_surfaces.size();
+    }
+
+    int getWidth() const {
+        return m_width;
+    }
+
+    int getHeight() const {
+        return m_height;
+    }
+
+    //surface of the triangle covering pixel (x, y), its albedo goes into color and its normal is interpolated
+    //at the pixel center with the same screen space weights the rasterizer uses for depth
+    GBuffer::Surface fetch(int x, int y, unsigned int pixel, uint32_t& color, Vec3& normal) const {
+        uint32_t id = m_ids[pixel];
+        if (id == EMPTY)
+            return GBuffer::Empty;
+        unsigned int triangle = id - 1;
+        color = 0xffffffff; //materials carry no color yet, every surface is white
+        if (m_surfaces[triangle] != GBuffer::Lit)
+            return GBuffer::Surface(m_surfaces[triangle]);
+
+        const Vec3* c = &m_corners[triangle * 3];
+        const Vec3* n = &m_normals[triangle * 3];
+        float px = float(x) + 0.5f;
+        float py = float(y) + 0.5f;
+        float area = (c[1].x - c[0].x) * (c[2].y - c[0].y) - (c[2].x - c[0].x) * (c[1].y - c[0].y);
+        if (area == 0.0f) {
+            normal = n[0];
+            return GBuffer::Lit;
+        }
+        float w1 = ((px - c[0].x) * (c[2].y - c[0].y) - (c[2].x - c[0].x) * (py - c[0].y)) / area;
+        float w2 = ((c[1].x - c[0].x) * (py - c[0].y) - (px - c[0].x) * (c[1].y - c[0].y)) / area;
+        normal = n[0] + (n[1] - n[0]) * w1 + (n[2] - n[0]) * w2;
+        return GBuffer::Lit;
+    }
+
+    //shading pass: albedo of every covered pixel of target, lit pixels scaled by their light level as in
+    //GBuffer::resolve, the target's depth plane holds the depth of the stored ids
+    GBuffer::LightingStats resolve(const RenderTarget& target, const LightSet& lights, const Mat4& projection,
+                                   const Vec3& viewportScale, const Vec3& viewportOffset, JobSystem& jobs,
+                                   bool cullLights = true) const {
+        return GBuffer::resolveTiles(*this, target, lights, projection, viewportScale, viewportOffset, jobs, cullLights);
+    }
+
+private:
+    //triangle k of buffer after the ones kept, returns its id
+    uint32_t addTriangle(const Vertex& buffer, unsigned int k, ShadingMode shading) {
+        const Index& i = buffer.indices[k];
+        unsigned int vertices[3] = {i.x, i.y, i.z};
+        for (unsigned int corner = 0; corner < 3; ++corner) {
+            const Vec4& p = buffer.positions[vertices[corner]];
+            m_corners.emplace_back(p.x, p.y, p.z);
+            if (shading == ShadingMode::Gouraud)
+                m_normals.push_back(buffer.viewNormals[vertices[corner]]);
+            else if (shading == ShadingMode::Flat)
+                m_normals.push_back(buffer.faceNormals[k]);
+            else
+                m_normals.emplace_back();
+        }
+        m_surfaces.push_back(uint8_t(shading == ShadingMode::Unlit ? GBuffer::Unlit : GBuffer::Lit));
+        return uint32_t(m_surfaces.size());
+    }
+};
+
+}
+
+#endif //VISIBILITYBUFFER_H